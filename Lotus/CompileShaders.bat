@@ -1,5 +1,7 @@
 C:\VulkanSDK\1.3.268.0\Bin\glslc.exe shaders\simpleshader.vert -o shaders\simpleshader.vert.spv
 C:\VulkanSDK\1.3.268.0\Bin\glslc.exe shaders\simpleshader.frag -o shaders\simpleshader.frag.spv
+C:\VulkanSDK\1.3.268.0\Bin\glslc.exe shaders\quantizedshader.vert -o shaders\quantizedshader.vert.spv
+C:\VulkanSDK\1.3.268.0\Bin\glslc.exe -DVERTEX_COLOR shaders\quantizedshader.vert -o shaders\quantizedshader_color.vert.spv
 
 C:\VulkanSDK\1.3.268.0\Bin\glslc.exe shaders\pointlightshader.vert -o shaders\pointlightshader.vert.spv
 C:\VulkanSDK\1.3.268.0\Bin\glslc.exe shaders\pointlightshader.frag -o shaders\pointlightshader.frag.spv
@@ -0,0 +1,67 @@
+#version 450
+
+// Vertex shader for Model::VertexFormat::Quantized and QuantizedColor (compiled with -DVERTEX_COLOR).
+// The position dequantization is folded into the instance's modelMatrix on the CPU, its normalMatrix[3]
+// carries the texcoord offset (xy) and scale (zw).
+
+layout(location = 0) in vec4 position; // snorm16
+#ifdef VERTEX_COLOR
+layout(location = 1) in vec4 color;    // unorm8
+#endif
+layout(location = 2) in vec2 normal;   // octahedral snorm16
+layout(location = 3) in vec2 uv;       // unorm16
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragPosWorld;
+layout(location = 2) out vec3 fragNormalWorld;
+layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragTextureIndex;
+
+struct PointLight {
+	vec3 position;
+	vec4 color;
+};
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+	mat4 inverseViewMatrix;
+	vec4 ambientLightColor; // w is intensity
+	PointLight pointLights[10];
+	int numPointLights;
+} ubo;
+
+// one per drawn object, written by SimpleRenderSystem; objects sharing a model are drawn as instances
+struct Instance {
+	mat4 modelMatrix;
+	mat4 normalMatrix; // [3] holds the texcoord transform
+	uint textureIndex; // in the texture table, std430 pads the struct to 144 bytes
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer InstanceBuffer {
+	Instance instances[];
+};
+
+vec3 DecodeOctahedral(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main() {
+	Instance instance = instances[gl_InstanceIndex];
+	vec4 positionWorld = instance.modelMatrix * vec4(position.xyz, 1.0);
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * positionWorld;
+
+	fragNormalWorld = normalize(mat3(instance.normalMatrix) * DecodeOctahedral(normal));
+	fragPosWorld = positionWorld.xyz;
+#ifdef VERTEX_COLOR
+	fragColor = color.rgb;
+#else
+	fragColor = vec3(1.0);
+#endif
+	fragUv = instance.normalMatrix[3].xy + uv * instance.normalMatrix[3].zw;
+	fragTextureIndex = instance.textureIndex;
+}
\ No newline at end of file
@@ -1,12 +1,19 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 fragColor;
 layout (location = 1) in vec3 fragPositionWorld;
 layout (location = 2) in vec3 fragNormalWorld;
 layout (location = 3) in vec2 fragUv;
+layout (location = 4) flat in uint fragTextureIndex;
 
 layout (location = 0) out vec4 outColor;
 
+// specialization constants, set per permutation by SimpleRenderSystem; the defaults are the generic shader
+layout (constant_id = 0) const int LIGHT_COUNT = -1; // negative reads ubo.numPointLights
+layout (constant_id = 1) const bool TEXTURED = true;
+layout (constant_id = 2) const bool SPECULAR = true;
+
 struct PointLight {
 	vec3 position;
 	vec4 color;
@@ -21,12 +28,8 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	int numPointLights;
 } ubo;
 
-layout(set = 0, binding = 1) uniform sampler2D image;
-
-layout(push_constant) uniform Push {
-	mat4 modelMatrix;
-	mat4 normalMatrix;
-} push;
+// bindless texture table, see TextureRegistry
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
 void main() {
 	vec3 diffuseLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
@@ -36,7 +39,9 @@ void main() {
 	vec3 cameraPositionWorld = vec3(ubo.inverseViewMatrix[3].xyz);
 	vec3 viewDirection = normalize(cameraPositionWorld - fragPositionWorld);
 
-	for (int i = 0; i < ubo.numPointLights; i++)
+	// a constant trip count when specialized, so the loop unrolls
+	int lightCount = LIGHT_COUNT >= 0 ? LIGHT_COUNT : ubo.numPointLights;
+	for (int i = 0; i < lightCount; i++)
 	{
 		PointLight light = ubo.pointLights[i];
 		vec3 directionToLight = light.position.xyz - fragPositionWorld;
@@ -48,14 +53,22 @@ void main() {
 
 		diffuseLight += intensity * cosAngIncidence;
 
-		vec3 halfAngle = normalize(directionToLight + viewDirection);
-		float blinnTerm = dot(surfaceNormal, halfAngle);
-		blinnTerm = max(blinnTerm, 0);
-		blinnTerm = pow(blinnTerm, 32.0);
-		specularLight += intensity * blinnTerm;
+		if (SPECULAR)
+		{
+			vec3 halfAngle = normalize(directionToLight + viewDirection);
+			float blinnTerm = dot(surfaceNormal, halfAngle);
+			blinnTerm = max(blinnTerm, 0);
+			blinnTerm = pow(blinnTerm, 32.0);
+			specularLight += intensity * blinnTerm;
+		}
 	}
 
-	vec3 imageColor = texture(image, fragUv).xyz;
+	// untextured objects use the plain white texture, which samples to 1
+	vec3 imageColor = vec3(1.0);
+	if (TEXTURED)
+	{
+		imageColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragUv).xyz;
+	}
 
 	outColor = vec4((diffuseLight * fragColor + specularLight) * imageColor * fragColor, 1.0);
 }
\ No newline at end of file
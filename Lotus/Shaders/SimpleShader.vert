@@ -9,6 +9,7 @@ layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragPosWorld;
 layout(location = 2) out vec3 fragNormalWorld;
 layout(location = 3) out vec2 fragUv;
+layout(location = 4) flat out uint fragTextureIndex;
 
 struct PointLight {
 	vec3 position;
@@ -24,17 +25,25 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
 	int numPointLights;
 } ubo;
 
-layout(push_constant) uniform Push {
+// one per drawn object, written by SimpleRenderSystem; objects sharing a model are drawn as instances
+struct Instance {
 	mat4 modelMatrix;
-	mat4 normalMatrix;
-} push;
+	mat4 normalMatrix; // [3] holds the texcoord transform
+	uint textureIndex; // in the texture table, std430 pads the struct to 144 bytes
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer InstanceBuffer {
+	Instance instances[];
+};
 
 void main() {
-	vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+	Instance instance = instances[gl_InstanceIndex];
+	vec4 positionWorld = instance.modelMatrix * vec4(position, 1.0);
 	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * positionWorld;
 
-	fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+	fragNormalWorld = normalize(mat3(instance.normalMatrix) * normal);
 	fragPosWorld = positionWorld.xyz;
 	fragColor = color;
 	fragUv = uv;
+	fragTextureIndex = instance.textureIndex;
 }
\ No newline at end of file
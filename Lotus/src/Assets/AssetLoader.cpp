@@ -0,0 +1,121 @@
+#include "lotuspch.h"
+#include "AssetLoader.h"
+
+#include "Utils/ThreadPool.h"
+
+namespace Lotus {
+
+    AssetLoader::AssetLoader(Device& device)
+        : m_Device{ device }, m_State{ std::make_shared<State>() }
+    {
+    }
+
+    AssetLoader::~AssetLoader()
+    {
+        // pending uploads are dropped, their futures report a broken promise
+        std::lock_guard<std::mutex> lock(m_State->mutex);
+        m_State->uploads.clear();
+    }
+
+    AssetLoader::ModelFuture AssetLoader::LoadModelAsync(const std::string& filepath, const Model::ImportSettings& settings)
+    {
+        auto promise = std::make_shared<std::promise<std::shared_ptr<Model>>>();
+        ModelFuture future = promise->get_future().share();
+        m_State->pendingCount++;
+
+        Device* device = &m_Device;
+        std::shared_ptr<State> state = m_State;
+        ThreadPool::Get().Submit([device, state, promise, filepath, settings]()
+        {
+            auto result = std::make_shared<Model::ImportResult>();
+            try
+            {
+                Model::Import(filepath, settings, *result);
+            }
+            catch (...)
+            {
+                LOTUS_CORE_ERROR("Failed to load model {0}", filepath);
+                promise->set_exception(std::current_exception());
+                state->pendingCount--;
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->uploads.emplace_back([device, state, promise, result, format = settings.vertexFormat]()
+            {
+                try
+                {
+                    promise->set_value(std::make_shared<Model>(*device, result->data, format));
+                }
+                catch (...)
+                {
+                    promise->set_exception(std::current_exception());
+                }
+                state->pendingCount--;
+            });
+        });
+
+        return future;
+    }
+
+    AssetLoader::TextureFuture AssetLoader::LoadTextureAsync(const std::string& filepath)
+    {
+        auto promise = std::make_shared<std::promise<std::shared_ptr<Texture>>>();
+        TextureFuture future = promise->get_future().share();
+        m_State->pendingCount++;
+
+        Device* device = &m_Device;
+        std::shared_ptr<State> state = m_State;
+        ThreadPool::Get().Submit([device, state, promise, filepath]()
+        {
+            auto image = std::make_shared<Texture::ImageData>();
+            try
+            {
+                Texture::Decode(filepath, *image);
+            }
+            catch (...)
+            {
+                LOTUS_CORE_ERROR("Failed to load texture {0}", filepath);
+                promise->set_exception(std::current_exception());
+                state->pendingCount--;
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->uploads.emplace_back([device, state, promise, image]()
+            {
+                try
+                {
+                    promise->set_value(std::make_shared<Texture>(*device, *image));
+                }
+                catch (...)
+                {
+                    promise->set_exception(std::current_exception());
+                }
+                state->pendingCount--;
+            });
+        });
+
+        return future;
+    }
+
+    uint32_t AssetLoader::ProcessUploads(uint32_t maxUploads)
+    {
+        std::vector<std::function<void()>> uploads;
+        {
+            std::lock_guard<std::mutex> lock(m_State->mutex);
+            const size_t count = std::min<size_t>(maxUploads, m_State->uploads.size());
+            uploads.assign(
+                std::make_move_iterator(m_State->uploads.begin()),
+                std::make_move_iterator(m_State->uploads.begin() + count));
+            m_State->uploads.erase(m_State->uploads.begin(), m_State->uploads.begin() + count);
+        }
+
+        // run outside the lock so workers can keep queueing while we upload
+        for (auto& upload : uploads)
+            upload();
+
+        return static_cast<uint32_t>(uploads.size());
+    }
+
+} // namespace Lotus
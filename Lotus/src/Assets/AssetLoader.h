@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Renderer/Device.h"
+#include "Renderer/Model.h"
+#include "Renderer/Texture.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Lotus {
+
+    // Loads models and textures in the background. File I/O, parsing, mesh processing and image
+    // decoding run on the ThreadPool; the resulting GPU objects are created on the render thread
+    // by ProcessUploads, since buffer and image creation go through the device's single queue.
+    // The returned futures become ready once the upload has been done.
+    class AssetLoader
+    {
+    public:
+        using ModelFuture = std::shared_future<std::shared_ptr<Model>>;
+        using TextureFuture = std::shared_future<std::shared_ptr<Texture>>;
+
+        explicit AssetLoader(Device& device);
+        ~AssetLoader();
+
+        AssetLoader(const AssetLoader&) = delete;
+        AssetLoader& operator=(const AssetLoader&) = delete;
+
+        ModelFuture LoadModelAsync(const std::string& filepath, const Model::ImportSettings& settings = {});
+        TextureFuture LoadTextureAsync(const std::string& filepath);
+
+        // Creates the GPU objects for finished imports, call once per frame from the render thread.
+        // Returns the number of uploads done.
+        uint32_t ProcessUploads(uint32_t maxUploads = UINT32_MAX);
+
+        // Blocks until the future is ready, doing uploads meanwhile
+        template <typename T>
+        void WaitUntilReady(const std::shared_future<T>& future)
+        {
+            while (future.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+                ProcessUploads();
+        }
+
+        // Blocks until the asset is ready and returns it; rethrows load errors
+        template <typename T>
+        std::shared_ptr<T> Wait(const std::shared_future<std::shared_ptr<T>>& future)
+        {
+            WaitUntilReady(future);
+            return future.get();
+        }
+
+        // Requests that have not been uploaded yet
+        uint32_t GetPendingCount() const { return m_State->pendingCount.load(); }
+
+        template <typename T>
+        static bool IsReady(const std::shared_future<std::shared_ptr<T>>& future)
+        {
+            return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+    private:
+        // Shared with the worker jobs so a job finishing after the loader is gone stays harmless
+        struct State
+        {
+            std::mutex mutex;
+            std::vector<std::function<void()>> uploads;
+            std::atomic<uint32_t> pendingCount{ 0 };
+        };
+
+        Device& m_Device;
+        std::shared_ptr<State> m_State;
+    };
+
+} // namespace Lotus
@@ -0,0 +1,270 @@
+#include "lotuspch.h"
+#include "AssetManager.h"
+
+#include "Renderer/SwapChain.h"
+
+#include <cctype>
+#include <filesystem>
+
+namespace Lotus {
+
+    AssetManager::AssetManager(Device& device)
+        : m_Loader{ device }
+    {
+    }
+
+    AssetManager::AssetId AssetManager::LoadModel(const std::string& filepath, const Model::ImportSettings& settings)
+    {
+        // the vertex format is not part of ImportSettings::Hash but gives a different GPU copy
+        const std::string key = "model|" + NormalizePath(filepath)
+            + "|" + std::to_string(settings.Hash())
+            + "|" + std::to_string(static_cast<uint32_t>(settings.vertexFormat));
+
+        const AssetId id = Intern(key, Type::Model, filepath);
+        Entry& entry = m_Entries[id];
+        entry.settings = settings;
+        if (entry.state == State::Unloaded || entry.state == State::Failed)
+            StartLoad(entry);
+        return id;
+    }
+
+    AssetManager::AssetId AssetManager::LoadTexture(const std::string& filepath)
+    {
+        const AssetId id = Intern("texture|" + NormalizePath(filepath), Type::Texture, filepath);
+        Entry& entry = m_Entries[id];
+        if (entry.state == State::Unloaded || entry.state == State::Failed)
+            StartLoad(entry);
+        return id;
+    }
+
+    std::shared_ptr<Model> AssetManager::GetModel(AssetId id)
+    {
+        Entry& entry = m_Entries[id];
+        assert(entry.type == Type::Model && "asset is not a model");
+
+        if (entry.state == State::Unloaded)
+            StartLoad(entry);
+        if (!Resolve(entry))
+            return nullptr;
+
+        entry.lastUsedFrame = m_FrameIndex;
+        return entry.model;
+    }
+
+    std::shared_ptr<Texture> AssetManager::GetTexture(AssetId id)
+    {
+        Entry& entry = m_Entries[id];
+        assert(entry.type == Type::Texture && "asset is not a texture");
+
+        if (entry.state == State::Unloaded)
+            StartLoad(entry);
+        if (!Resolve(entry))
+            return nullptr;
+
+        entry.lastUsedFrame = m_FrameIndex;
+        return entry.texture;
+    }
+
+    std::shared_ptr<Model> AssetManager::WaitModel(AssetId id)
+    {
+        Entry& entry = m_Entries[id];
+        assert(entry.type == Type::Model && "asset is not a model");
+
+        if (entry.state == State::Unloaded)
+            StartLoad(entry);
+        if (entry.state == State::Loading)
+        {
+            const AssetLoader::ModelFuture future = entry.modelFuture;
+            m_Loader.WaitUntilReady(future);
+        }
+        if (!Resolve(entry))
+            throw std::runtime_error("failed to load model " + entry.path);
+
+        entry.lastUsedFrame = m_FrameIndex;
+        return entry.model;
+    }
+
+    std::shared_ptr<Texture> AssetManager::WaitTexture(AssetId id)
+    {
+        Entry& entry = m_Entries[id];
+        assert(entry.type == Type::Texture && "asset is not a texture");
+
+        if (entry.state == State::Unloaded)
+            StartLoad(entry);
+        if (entry.state == State::Loading)
+        {
+            const AssetLoader::TextureFuture future = entry.textureFuture;
+            m_Loader.WaitUntilReady(future);
+        }
+        if (!Resolve(entry))
+            throw std::runtime_error("failed to load texture " + entry.path);
+
+        entry.lastUsedFrame = m_FrameIndex;
+        return entry.texture;
+    }
+
+    void AssetManager::Update()
+    {
+        m_Loader.ProcessUploads();
+        m_FrameIndex++;
+
+        m_HostBytes = 0;
+        m_DeviceBytes = 0;
+        for (Entry& entry : m_Entries)
+        {
+            if (!Resolve(entry))
+                continue;
+
+            if (IsReferenced(entry))
+                entry.lastUsedFrame = m_FrameIndex;
+            m_HostBytes += entry.hostBytes;
+            m_DeviceBytes += entry.deviceBytes;
+        }
+
+        if (m_HostBytes <= m_Budget.hostBytes && m_DeviceBytes <= m_Budget.deviceBytes)
+            return;
+
+        // an asset released this frame can still be read by command buffers in flight
+        std::vector<AssetId> candidates;
+        for (AssetId id = 0; id < m_Entries.size(); id++)
+        {
+            const Entry& entry = m_Entries[id];
+            if (entry.state == State::Resident && !IsReferenced(entry) &&
+                entry.lastUsedFrame + SwapChain::MAX_FRAMES_IN_FLIGHT < m_FrameIndex)
+            {
+                candidates.push_back(id);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [this](AssetId a, AssetId b)
+        {
+            return m_Entries[a].lastUsedFrame < m_Entries[b].lastUsedFrame;
+        });
+
+        for (AssetId id : candidates)
+        {
+            if (m_HostBytes <= m_Budget.hostBytes && m_DeviceBytes <= m_Budget.deviceBytes)
+                break;
+            Evict(m_Entries[id]);
+        }
+    }
+
+    AssetManager::Stats AssetManager::GetStats() const
+    {
+        Stats stats{};
+        stats.assetCount = static_cast<uint32_t>(m_Entries.size());
+        for (const Entry& entry : m_Entries)
+        {
+            if (entry.state == State::Resident)
+                stats.residentCount++;
+            else if (entry.state == State::Loading)
+                stats.loadingCount++;
+        }
+        stats.hostBytes = m_HostBytes;
+        stats.deviceBytes = m_DeviceBytes;
+        stats.dedupCount = m_DedupCount;
+        stats.evictionCount = m_EvictionCount;
+        return stats;
+    }
+
+    AssetManager::AssetId AssetManager::Intern(const std::string& key, Type type, const std::string& filepath)
+    {
+        auto it = m_Ids.find(key);
+        if (it != m_Ids.end())
+        {
+            const State state = m_Entries[it->second].state;
+            if (state == State::Loading || state == State::Resident)
+                m_DedupCount++;
+            return it->second;
+        }
+
+        const AssetId id = static_cast<AssetId>(m_Entries.size());
+        Entry entry{};
+        entry.type = type;
+        entry.path = filepath;
+        m_Entries.push_back(std::move(entry));
+        m_Ids.emplace(key, id);
+        return id;
+    }
+
+    void AssetManager::StartLoad(Entry& entry)
+    {
+        entry.state = State::Loading;
+        if (entry.type == Type::Model)
+            entry.modelFuture = m_Loader.LoadModelAsync(entry.path, entry.settings);
+        else
+            entry.textureFuture = m_Loader.LoadTextureAsync(entry.path);
+    }
+
+    bool AssetManager::Resolve(Entry& entry)
+    {
+        if (entry.state != State::Loading)
+            return entry.state == State::Resident;
+
+        const bool ready = entry.type == Type::Model
+            ? AssetLoader::IsReady(entry.modelFuture)
+            : AssetLoader::IsReady(entry.textureFuture);
+        if (!ready)
+            return false;
+
+        try
+        {
+            if (entry.type == Type::Model)
+            {
+                entry.model = entry.modelFuture.get();
+                entry.hostBytes = entry.model->GetHostSize();
+                entry.deviceBytes = entry.model->GetDeviceSize();
+            }
+            else
+            {
+                entry.texture = entry.textureFuture.get();
+                entry.hostBytes = sizeof(Texture);
+                entry.deviceBytes = entry.texture->GetDeviceSize();
+            }
+            entry.state = State::Resident;
+            entry.lastUsedFrame = m_FrameIndex;
+        }
+        catch (const std::exception& e)
+        {
+            LOTUS_CORE_ERROR("{0}", e.what());
+            entry.state = State::Failed;
+        }
+
+        // the future's shared state holds a reference too, drop it so the use count means something
+        entry.modelFuture = {};
+        entry.textureFuture = {};
+        return entry.state == State::Resident;
+    }
+
+    void AssetManager::Evict(Entry& entry)
+    {
+        LOTUS_CORE_INFO("Evicting {0} ({1} KB host, {2} KB device)", entry.path, entry.hostBytes / 1024, entry.deviceBytes / 1024);
+
+        m_HostBytes -= entry.hostBytes;
+        m_DeviceBytes -= entry.deviceBytes;
+        entry.hostBytes = 0;
+        entry.deviceBytes = 0;
+        entry.model.reset();
+        entry.texture.reset();
+        entry.state = State::Unloaded;
+        m_EvictionCount++;
+    }
+
+    bool AssetManager::IsReferenced(const Entry& entry) const
+    {
+        return entry.type == Type::Model
+            ? entry.model.use_count() > 1
+            : entry.texture.use_count() > 1;
+    }
+
+    std::string AssetManager::NormalizePath(const std::string& filepath)
+    {
+        std::string path = std::filesystem::path(filepath).lexically_normal().generic_string();
+#ifdef LOTUS_PLATFORM_WINDOWS
+        // file names are case-insensitive on Windows, "../assets/models" and "../Assets/Models" are the same file
+        std::transform(path.begin(), path.end(), path.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+        return path;
+    }
+
+} // namespace Lotus
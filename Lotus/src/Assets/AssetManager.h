@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Assets/AssetLoader.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Lotus {
+
+    // Owns every model and texture loaded from disk. Assets are identified by an interned id per
+    // (path, import settings), so loading the same file twice returns the same id and shares one
+    // GPU copy, also while the first request is still in flight.
+    // Assets nobody else holds a shared_ptr to are evicted in LRU order once the budget is exceeded;
+    // their ids stay valid and the next Get call reloads them.
+    class AssetManager
+    {
+    public:
+        using AssetId = uint32_t;
+        static constexpr AssetId INVALID_ASSET_ID = UINT32_MAX;
+
+        struct Budget
+        {
+            uint64_t hostBytes = 256ull << 20;
+            uint64_t deviceBytes = 1ull << 30;
+        };
+
+        struct Stats
+        {
+            uint32_t assetCount = 0;
+            uint32_t residentCount = 0;
+            uint32_t loadingCount = 0;
+            uint64_t hostBytes = 0;
+            uint64_t deviceBytes = 0;
+            uint32_t dedupCount = 0;    // requests served by an existing entry
+            uint32_t evictionCount = 0;
+        };
+
+        explicit AssetManager(Device& device);
+
+        AssetManager(const AssetManager&) = delete;
+        AssetManager& operator=(const AssetManager&) = delete;
+
+        // Starts loading unless the asset is already resident or loading
+        AssetId LoadModel(const std::string& filepath, const Model::ImportSettings& settings = {});
+        AssetId LoadTexture(const std::string& filepath);
+
+        // nullptr while the asset is loading or when loading failed
+        std::shared_ptr<Model> GetModel(AssetId id);
+        std::shared_ptr<Texture> GetTexture(AssetId id);
+
+        // Blocks until the asset is resident, rethrows load errors
+        std::shared_ptr<Model> WaitModel(AssetId id);
+        std::shared_ptr<Texture> WaitTexture(AssetId id);
+
+        bool HasFailed(AssetId id) const { return m_Entries[id].state == State::Failed; }
+        const std::string& GetPath(AssetId id) const { return m_Entries[id].path; }
+
+        // Call once per frame from the render thread: uploads finished loads, refreshes the LRU
+        // order from the reference counts and evicts down to the budget
+        void Update();
+
+        void SetBudget(const Budget& budget) { m_Budget = budget; }
+        const Budget& GetBudget() const { return m_Budget; }
+        Stats GetStats() const;
+
+    private:
+        enum class Type : uint8_t { Model, Texture };
+        enum class State : uint8_t { Unloaded, Loading, Resident, Failed };
+
+        struct Entry
+        {
+            Type type = Type::Model;
+            State state = State::Unloaded;
+            std::string path;
+            Model::ImportSettings settings{};
+
+            // only one of each pair is used, depending on type
+            AssetLoader::ModelFuture modelFuture;
+            AssetLoader::TextureFuture textureFuture;
+            std::shared_ptr<Model> model;
+            std::shared_ptr<Texture> texture;
+
+            uint64_t hostBytes = 0;
+            uint64_t deviceBytes = 0;
+            uint64_t lastUsedFrame = 0;
+        };
+
+        AssetId Intern(const std::string& key, Type type, const std::string& filepath);
+        void StartLoad(Entry& entry);
+        // Moves a finished load into the entry, returns true when it is resident.
+        // The byte totals are only refreshed by Update.
+        bool Resolve(Entry& entry);
+        void Evict(Entry& entry);
+        bool IsReferenced(const Entry& entry) const;
+
+        static std::string NormalizePath(const std::string& filepath);
+
+    private:
+        AssetLoader m_Loader;
+        Budget m_Budget{};
+
+        std::vector<Entry> m_Entries;
+        std::unordered_map<std::string, AssetId> m_Ids;
+
+        uint64_t m_FrameIndex = 0;
+        uint64_t m_HostBytes = 0;
+        uint64_t m_DeviceBytes = 0;
+        uint32_t m_DedupCount = 0;
+        uint32_t m_EvictionCount = 0;
+    };
+
+} // namespace Lotus
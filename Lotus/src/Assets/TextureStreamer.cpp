@@ -0,0 +1,336 @@
+#include "lotuspch.h"
+#include "TextureStreamer.h"
+
+#include "Renderer/Frustum.h"
+#include "Renderer/MipGenerator.h"
+#include "Utils/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace Lotus {
+
+    TextureStreamer::TextureStreamer(Device& device, TextureRegistry& registry)
+        : m_Device{ device }, m_Registry{ registry }
+    {
+    }
+
+    TextureStreamer::TextureId TextureStreamer::Load(const std::string& filepath)
+    {
+        auto it = m_Ids.find(filepath);
+        if (it != m_Ids.end())
+            return it->second;
+
+        const TextureId id = static_cast<TextureId>(m_Entries.size());
+        m_Ids.emplace(filepath, id);
+
+        Entry& entry = m_Entries.emplace_back();
+        entry.path = filepath;
+        entry.textureIndex = m_Registry.Register(nullptr);
+        // streaming needs every level on the CPU side, so mips are always generated on the CPU; when
+        // they aren't cached the tail is filtered first, so it can be uploaded before the rest of the chain exists
+        entry.decode = ThreadPool::Get().Submit([filepath, tailSize = m_Settings.tailSize]()
+        {
+            Decoded decoded;
+            auto image = std::make_shared<Texture::ImageData>();
+            if (!Texture::DecodeTopLevel(filepath, *image, Texture::MipGeneration::Cpu))
+            {
+                if (std::max(image->width, image->height) > tailSize)
+                {
+                    decoded.image = std::make_shared<Texture::ImageData>(MipGenerator::GenerateTail(*image, tailSize));
+                    decoded.chain = ThreadPool::Get().Submit([filepath, image]()
+                    {
+                        Texture::FinishDecode(filepath, *image, Texture::MipGeneration::Cpu);
+                        return image;
+                    });
+                    return decoded;
+                }
+                Texture::FinishDecode(filepath, *image, Texture::MipGeneration::Cpu);
+            }
+            decoded.image = std::move(image);
+            return decoded;
+        });
+        return id;
+    }
+
+    std::shared_ptr<Texture> TextureStreamer::Wait(TextureId id)
+    {
+        Entry& entry = m_Entries[id];
+        if (entry.decode.valid())
+            entry.decode.wait();
+        if (!Resolve(entry))
+            throw std::runtime_error("failed to load texture " + entry.path);
+        return entry.texture;
+    }
+
+    void TextureStreamer::Update(const FrameInfo& frameInfo)
+    {
+        m_FrameIndex++;
+        m_UploadedBytes = 0;
+
+        for (Entry& entry : m_Entries)
+            Resolve(entry);
+
+        RequestLevels(frameInfo);
+        FitBudget();
+        StreamLevels();
+    }
+
+    TextureStreamer::Stats TextureStreamer::GetStats() const
+    {
+        Stats stats{};
+        stats.textureCount = static_cast<uint32_t>(m_Entries.size());
+        stats.uploadedBytes = m_UploadedBytes;
+        stats.droppedLevelCount = m_DroppedLevelCount;
+        for (const Entry& entry : m_Entries)
+        {
+            if (!entry.texture)
+                continue;
+
+            stats.residentCount++;
+            stats.deviceBytes += entry.levelBytes[entry.residentLevel];
+            if (entry.requestedLevel < entry.residentLevel)
+                stats.streamingCount++;
+        }
+        return stats;
+    }
+
+    bool TextureStreamer::Resolve(Entry& entry)
+    {
+        if (entry.texture)
+        {
+            ResolveChain(entry);
+            return true;
+        }
+        if (entry.failed || !entry.decode.valid() || entry.decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+
+        try
+        {
+            Decoded decoded = entry.decode.get();
+            entry.chain = std::move(decoded.chain);
+            entry.hasChain = !entry.chain.valid();
+            SetImage(entry, std::move(decoded.image));
+
+            // the tail starts at the first level that fits in tailSize, or the first one a tail image
+            // holds texels for; an image without a mip chain can only be resident as a whole
+            const uint32_t levelCount = GetLevelCount(entry);
+            entry.tailLevel = 0;
+            while (entry.tailLevel + 1 < levelCount && (entry.image->levels[entry.tailLevel].size == 0 ||
+                std::max(entry.image->levels[entry.tailLevel].width, entry.image->levels[entry.tailLevel].height) > m_Settings.tailSize))
+            {
+                entry.tailLevel++;
+            }
+
+            entry.requestedLevel = entry.tailLevel;
+            entry.targetLevel = entry.tailLevel;
+            entry.lastUsedFrame = m_FrameIndex;
+            SetResidentLevel(entry, entry.tailLevel);
+        }
+        catch (const std::exception& e)
+        {
+            LOTUS_CORE_ERROR("Failed to stream texture {0}: {1}", entry.path, e.what());
+            entry.image.reset();
+            entry.failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    void TextureStreamer::ResolveChain(Entry& entry)
+    {
+        if (!entry.chain.valid() || entry.chain.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+
+        // the resident tail stays, only levels streamed in later come from the chain
+        try
+        {
+            SetImage(entry, entry.chain.get());
+            entry.hasChain = true;
+        }
+        catch (const std::exception& e)
+        {
+            LOTUS_CORE_ERROR("Failed to generate the mips of texture {0}, only its tail stays resident: {1}", entry.path, e.what());
+        }
+    }
+
+    void TextureStreamer::SetImage(Entry& entry, std::shared_ptr<Texture::ImageData> image)
+    {
+        entry.image = std::move(image);
+
+        const uint32_t levelCount = GetLevelCount(entry);
+        entry.levelBytes.assign(levelCount + 1, 0);
+        for (uint32_t level = levelCount; level-- > 0;)
+            entry.levelBytes[level] = entry.levelBytes[level + 1] + entry.image->levels[level].size;
+    }
+
+    void TextureStreamer::RequestLevels(const FrameInfo& frameInfo)
+    {
+        // textures no visible object samples only need their tail
+        for (Entry& entry : m_Entries)
+            entry.requestedLevel = entry.tailLevel;
+
+        const Camera& camera = frameInfo.camera;
+        const Frustum frustum{ camera.GetProjectionMatrix() * camera.GetViewMatrix() };
+        // pixels covered by one world unit at distance 1, see SimpleRenderSystem::SelectLod
+        const float pixelsPerUnit = std::abs(camera.GetProjectionMatrix()[1][1]) * 0.5f * static_cast<float>(frameInfo.extent.height);
+
+        for (const auto& kv : frameInfo.gameObjects)
+        {
+            const GameObject& obj = kv.second;
+            if (obj.model == nullptr || obj.textureId == INVALID_TEXTURE_ID)
+                continue;
+
+            assert(obj.textureId < m_Entries.size() && "game object uses an unknown texture");
+            Entry& entry = m_Entries[obj.textureId];
+            if (!entry.texture || !entry.hasChain)
+                continue;
+
+            // same bounding sphere the render system culls with
+            const glm::mat4 transform = obj.transform.GetTransform();
+            const glm::vec3 scale = glm::abs(obj.transform.scale);
+            const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+            const Model::Bounds& bounds = obj.model->GetBounds();
+            const glm::vec3 center = transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+            const float radius = glm::length(bounds.max - bounds.min) * 0.5f * maxScale;
+            if (maxScale <= 0.0f || !frustum.IntersectsSphere(center, radius))
+                continue;
+
+            entry.lastUsedFrame = m_FrameIndex;
+
+            // texels per pixel at the closest point of the bounds decide the level, like the sampler would
+            const float distance = std::max(glm::length(center - camera.GetPosition()) - radius, 1e-3f);
+            const float texelsPerUnit = obj.model->GetTexCoordDensity() / maxScale *
+                static_cast<float>(std::max(entry.image->width, entry.image->height));
+            if (texelsPerUnit <= 0.0f)
+                continue;
+
+            const float texelsPerPixel = texelsPerUnit * distance / pixelsPerUnit;
+            const float level = std::log2(std::max(texelsPerPixel, 1.0f)) + m_Settings.levelBias;
+            const uint32_t requested = std::min(static_cast<uint32_t>(std::max(level, 0.0f)), entry.tailLevel);
+            entry.requestedLevel = std::min(entry.requestedLevel, requested);
+        }
+    }
+
+    void TextureStreamer::FitBudget()
+    {
+        // visible textures get what they asked for, everything else keeps what it has
+        uint64_t totalBytes = 0;
+        std::vector<TextureId> candidates;
+        for (TextureId id = 0; id < m_Entries.size(); id++)
+        {
+            Entry& entry = m_Entries[id];
+            if (!entry.texture)
+                continue;
+
+            entry.targetLevel = entry.lastUsedFrame == m_FrameIndex ? std::min(entry.residentLevel, entry.requestedLevel) : entry.residentLevel;
+            totalBytes += entry.levelBytes[entry.targetLevel];
+            if (entry.targetLevel < entry.tailLevel)
+                candidates.push_back(id);
+        }
+
+        if (totalBytes <= m_Settings.deviceBudget)
+            return;
+
+        // least recently used first, larger textures first among those used in the same frame
+        std::sort(candidates.begin(), candidates.end(), [this](TextureId a, TextureId b)
+        {
+            const Entry& entryA = m_Entries[a];
+            const Entry& entryB = m_Entries[b];
+            if (entryA.lastUsedFrame != entryB.lastUsedFrame)
+                return entryA.lastUsedFrame < entryB.lastUsedFrame;
+            return entryA.levelBytes[entryA.targetLevel] > entryB.levelBytes[entryB.targetLevel];
+        });
+
+        const auto dropLevel = [&](Entry& entry)
+        {
+            totalBytes -= entry.levelBytes[entry.targetLevel] - entry.levelBytes[entry.targetLevel + 1];
+            entry.targetLevel++;
+        };
+
+        // first drop levels nobody asked for this frame, down to the tail for unused textures
+        for (TextureId id : candidates)
+        {
+            Entry& entry = m_Entries[id];
+            while (totalBytes > m_Settings.deviceBudget && entry.targetLevel < entry.requestedLevel)
+                dropLevel(entry);
+        }
+
+        // the visible set alone is over budget, take one level from each in turn so they all degrade evenly
+        bool dropped = true;
+        while (totalBytes > m_Settings.deviceBudget && dropped)
+        {
+            dropped = false;
+            for (TextureId id : candidates)
+            {
+                Entry& entry = m_Entries[id];
+                if (totalBytes <= m_Settings.deviceBudget || entry.targetLevel >= entry.tailLevel)
+                    continue;
+
+                dropLevel(entry);
+                dropped = true;
+            }
+        }
+    }
+
+    void TextureStreamer::StreamLevels()
+    {
+        // dropping levels only frees memory, so it is never held back
+        std::vector<TextureId> streamIn;
+        for (TextureId id = 0; id < m_Entries.size(); id++)
+        {
+            Entry& entry = m_Entries[id];
+            if (!entry.texture)
+                continue;
+
+            if (entry.targetLevel > entry.residentLevel)
+                SetResidentLevel(entry, entry.targetLevel);
+            else if (entry.targetLevel < entry.residentLevel)
+                streamIn.push_back(id);
+        }
+
+        // visible textures first, then the ones missing the most levels
+        std::sort(streamIn.begin(), streamIn.end(), [this](TextureId a, TextureId b)
+        {
+            const Entry& entryA = m_Entries[a];
+            const Entry& entryB = m_Entries[b];
+            if (entryA.lastUsedFrame != entryB.lastUsedFrame)
+                return entryA.lastUsedFrame > entryB.lastUsedFrame;
+            return entryA.residentLevel - entryA.targetLevel > entryB.residentLevel - entryB.targetLevel;
+        });
+
+        uint64_t streamedBytes = 0;
+        for (TextureId id : streamIn)
+        {
+            Entry& entry = m_Entries[id];
+
+            // when the whole chain doesn't fit into this frame's uploads, step towards it one level at a time;
+            // the first upload of a frame always goes through so huge levels still make progress
+            uint32_t level = entry.targetLevel;
+            while (level + 1 < entry.residentLevel && streamedBytes + entry.levelBytes[level] > m_Settings.uploadBytesPerFrame)
+                level++;
+            if (streamedBytes > 0 && streamedBytes + entry.levelBytes[level] > m_Settings.uploadBytesPerFrame)
+                continue;
+
+            SetResidentLevel(entry, level);
+            streamedBytes += entry.levelBytes[level];
+        }
+    }
+
+    void TextureStreamer::SetResidentLevel(Entry& entry, uint32_t level)
+    {
+        auto texture = std::make_shared<Texture>(m_Device, *entry.image, level);
+
+        if (entry.texture && level > entry.residentLevel)
+            m_DroppedLevelCount += level - entry.residentLevel;
+
+        // the table keeps the old texture alive until no frame in flight reads it
+        m_Registry.Replace(entry.textureIndex, texture);
+        entry.texture = std::move(texture);
+        entry.residentLevel = level;
+        entry.version++;
+        m_UploadedBytes += entry.levelBytes[level];
+    }
+
+} // namespace Lotus
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Renderer/Device.h"
+#include "Renderer/FrameInfo.h"
+#include "Renderer/Texture.h"
+#include "Renderer/TextureRegistry.h"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Lotus {
+
+    // Keeps only the mip levels that are actually visible on the GPU. A texture first becomes
+    // resident with its small tail levels: right after the top level is decoded they are filtered
+    // from it directly and uploaded, the rest of the chain is generated afterwards. Every frame the streamer works out
+    // the finest level each textured object needs from its on-screen texel density and streams
+    // higher levels in over the next frames. When the device budget is exceeded, the top levels
+    // of the least recently used textures are dropped first.
+    //
+    // The full mip chain stays on the CPU side, usually memory-mapped from the texture cache, so
+    // changing the resident levels is a re-upload from the mapping. It recreates the image, so the
+    // Texture object changes; every streamed texture keeps one index in the bindless texture table,
+    // which shows the default texture until the tail is resident.
+    class TextureStreamer
+    {
+    public:
+        using TextureId = uint32_t;
+        static constexpr TextureId INVALID_TEXTURE_ID = UINT32_MAX;
+
+        struct Settings
+        {
+            // texel bytes of every resident level of every streamed texture
+            uint64_t deviceBudget = 256ull << 20;
+            // levels at most this many texels wide are uploaded as soon as a texture is decoded
+            uint32_t tailSize = 128;
+            // bytes re-uploaded per frame when streaming levels in, the rest waits for the next frames
+            uint64_t uploadBytesPerFrame = 32ull << 20;
+            // added to the computed level, positive values stream in less detail
+            float levelBias = 0.0f;
+        };
+
+        struct Stats
+        {
+            uint32_t textureCount = 0;
+            uint32_t residentCount = 0;  // textures with at least their tail on the GPU
+            uint32_t streamingCount = 0; // textures that still miss levels they were asked for
+            uint64_t deviceBytes = 0;
+            uint64_t uploadedBytes = 0;  // during the last Update
+            uint32_t droppedLevelCount = 0;
+        };
+
+        TextureStreamer(Device& device, TextureRegistry& registry);
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+        // Starts decoding unless the file is already streamed, ids are interned per path
+        TextureId Load(const std::string& filepath);
+
+        // The texture holding the resident levels, nullptr until the tail is uploaded or when loading failed
+        std::shared_ptr<Texture> GetTexture(TextureId id) const { return m_Entries[id].texture; }
+        // Blocks until the tail is resident and returns it, throws when loading failed
+        std::shared_ptr<Texture> Wait(TextureId id);
+        // Index in the bindless texture table, valid as soon as Load returned
+        uint32_t GetTextureIndex(TextureId id) const { return m_Entries[id].textureIndex; }
+        // Incremented every time GetTexture returns a new object
+        uint32_t GetVersion(TextureId id) const { return m_Entries[id].version; }
+        // Finest level of the full chain on the GPU, UINT32_MAX while nothing is resident
+        uint32_t GetResidentLevel(TextureId id) const { return m_Entries[id].residentLevel; }
+        bool HasFailed(TextureId id) const { return m_Entries[id].failed; }
+        const std::string& GetPath(TextureId id) const { return m_Entries[id].path; }
+
+        // Call once per frame from the render thread, before TextureRegistry::Update: uploads decoded
+        // tails, picks the levels the visible objects need, fits them into the budget and streams
+        // levels in and out
+        void Update(const FrameInfo& frameInfo);
+
+        void SetSettings(const Settings& settings) { m_Settings = settings; }
+        const Settings& GetSettings() const { return m_Settings; }
+        Stats GetStats() const;
+
+    private:
+        struct Decoded
+        {
+            // the whole chain, or only its tail while chain is still being generated
+            std::shared_ptr<Texture::ImageData> image;
+            std::future<std::shared_ptr<Texture::ImageData>> chain;
+        };
+
+        struct Entry
+        {
+            std::string path;
+            std::future<Decoded> decode;
+            std::future<std::shared_ptr<Texture::ImageData>> chain;
+            // every level of the texture, kept for streaming levels back in; only the tail until chain is ready
+            std::shared_ptr<Texture::ImageData> image;
+            // levelBytes[i] is the size of levels i and up, levelBytes[levelCount] is 0
+            std::vector<uint64_t> levelBytes;
+
+            std::shared_ptr<Texture> texture;
+            uint32_t textureIndex = TextureRegistry::DEFAULT_TEXTURE_INDEX;
+            uint32_t version = 0;
+            uint32_t residentLevel = UINT32_MAX;
+            uint32_t tailLevel = 0;    // coarsest level that is ever the top of the resident chain
+            uint32_t requestedLevel = 0;
+            uint32_t targetLevel = 0;
+            uint64_t lastUsedFrame = 0;
+            bool hasChain = false; // levels above the tail can be streamed in
+            bool failed = false;
+        };
+
+        // Takes the result of a finished decode and uploads the tail, returns true once the entry is resident
+        bool Resolve(Entry& entry);
+        // Swaps in the full chain once it is generated
+        void ResolveChain(Entry& entry);
+        void SetImage(Entry& entry, std::shared_ptr<Texture::ImageData> image);
+        void RequestLevels(const FrameInfo& frameInfo);
+        void FitBudget();
+        void StreamLevels();
+        void SetResidentLevel(Entry& entry, uint32_t level);
+        uint32_t GetLevelCount(const Entry& entry) const { return static_cast<uint32_t>(entry.image->levels.size()); }
+
+    private:
+        Device& m_Device;
+        TextureRegistry& m_Registry;
+        Settings m_Settings{};
+
+        std::vector<Entry> m_Entries;
+        std::unordered_map<std::string, TextureId> m_Ids;
+
+        uint64_t m_FrameIndex = 0;
+        uint64_t m_UploadedBytes = 0;
+        uint32_t m_DroppedLevelCount = 0;
+    };
+
+} // namespace Lotus
@@ -81,6 +81,10 @@ namespace Lotus
 		TransformComponent transform{};
 
 		std::shared_ptr<Model> model{};
+		uint32_t lodIndex = 0; // last LOD drawn, see SimpleRenderSystem::SelectLod
+		uint32_t textureIndex = 0; // index in the bindless texture table, 0 is plain white
+		uint32_t textureId = UINT32_MAX; // TextureStreamer id of the texture the object samples, UINT32_MAX for none
+		bool specular = true; // Blinn-Phong highlights; objects without them get a cheaper fragment shader
 		std::unique_ptr<PointLightComponent> pointLight = nullptr;
 
 	private:
@@ -5,7 +5,9 @@
 #include "Camera/Camera.h"
 #include "Input/KeyboardMovementController.h"
 #include "Input/MouseMovementController.h"
-#include "Renderer/Buffer.h"
+#include "Renderer/GeometryArena.h"
+#include "Renderer/PipelineLibrary.h"
+#include "Renderer/UploadManager.h"
 
 #include "Lotus/Log.h"
 
@@ -14,7 +16,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
-#include "tiny_obj_loader.h"
 #include <Renderer/FrameInfo.h>
 
 namespace Lotus {
@@ -25,9 +26,9 @@ namespace Lotus {
     {
         m_GlobalPool =
             DescriptorPool::Builder(m_Device)
-            .SetMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
-            .AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::MAX_FRAMES_IN_FLIGHT)
-            .AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::MAX_FRAMES_IN_FLIGHT)
+            .SetMaxSets(2)
+            .AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1)
+            .AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1)
             .Build();
 
         LoadGameObjects();
@@ -40,44 +41,49 @@ namespace Lotus {
 
     void Application::Run()
     {
-        std::vector<std::unique_ptr<Buffer>> uboBuffers(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < uboBuffers.size(); i++) {
-            uboBuffers[i] = std::make_unique<Buffer>(
-                m_Device,
-                sizeof(GlobalUbo),
-                1,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-            uboBuffers[i]->Map();
+        // decoded on a worker while the rest of the setup runs, objects show the default texture
+        // until its tail is resident; every textured object counts towards the level it gets streamed in at
+        const TextureStreamer::TextureId vikingTextureId = m_TextureStreamer.Load("../Assets/Textures/viking_room.png");
+        for (auto& kv : m_GameObjects)
+        {
+            if (kv.second.pointLight != nullptr)
+                continue;
+            kv.second.textureId = vikingTextureId;
+            kv.second.textureIndex = m_TextureStreamer.GetTextureIndex(vikingTextureId);
         }
 
+        // the global ubo is allocated from the frame allocator every frame, one set covers all
+        // frames in flight and the dynamic offset picks this frame's copy
         auto globalSetLayout =
             DescriptorSetLayout::Builder(m_Device)
-            .AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+            .AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_ALL_GRAPHICS)
             .Build();
 
-        Texture vikingTexture("../Assets/Textures/viking_room.png", m_Device);
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = vikingTexture.GetImageLayout();
-        imageInfo.imageView = vikingTexture.GetImageView();
-        imageInfo.sampler = vikingTexture.GetSampler();
-        //imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkDescriptorSet globalDescriptorSet;
+        auto bufferInfo = m_FrameAllocator.DescriptorInfo(sizeof(GlobalUbo));
+        DescriptorWriter(*globalSetLayout, *m_GlobalPool)
+            .WriteBuffer(0, &bufferInfo)
+            .Build(globalDescriptorSet);
 
-        std::vector<VkDescriptorSet> globalDescriptorSets(SwapChain::MAX_FRAMES_IN_FLIGHT);
-        for (int i = 0; i < globalDescriptorSets.size(); i++)
-        {
-            auto bufferInfo = uboBuffers[i]->DescriptorInfo();
-            DescriptorWriter(*globalSetLayout, *m_GlobalPool)
-                .WriteBuffer(0, &bufferInfo)
-                .WriteImage(1, &imageInfo)
-                .Build(globalDescriptorSets[i]);
-        }
+        // per-instance data, also in the frame allocator; the render system binds each chunk of up to
+        // MAX_INSTANCES with its own dynamic offset, which decides where the shader's array starts
+        auto instanceSetLayout =
+            DescriptorSetLayout::Builder(m_Device)
+            .AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
+            .Build();
+
+        VkDescriptorSet instanceDescriptorSet;
+        auto instanceBufferInfo = m_FrameAllocator.DescriptorInfo(SimpleRenderSystem::INSTANCE_BUFFER_RANGE);
+        DescriptorWriter(*instanceSetLayout, *m_GlobalPool)
+            .WriteBuffer(0, &instanceBufferInfo)
+            .Build(instanceDescriptorSet);
 
         SimpleRenderSystem simpleRenderSystem{
             m_Device,
             m_Renderer.GetSwapChainRenderPass(),
-            globalSetLayout->GetDescriptorSetLayout()
+            globalSetLayout->GetDescriptorSetLayout(),
+            m_TextureRegistry.GetDescriptorSetLayout(),
+            instanceSetLayout->GetDescriptorSetLayout()
         };
 
         PointLightSystem pointLightSystem{
@@ -85,6 +91,9 @@ namespace Lotus {
 			m_Renderer.GetSwapChainRenderPass(),
 			globalSetLayout->GetDescriptorSetLayout()
 		};
+        // systems compile their pipelines in the background; the first frame waits for them, systems
+        // created later draw with fallbacks or skip draws instead of stalling a frame
+        m_Device.GetPipelineLibrary().WaitIdle();
 
         Camera camera{};
         auto cameraObject = GameObject::CreateGameObject();
@@ -95,11 +104,15 @@ namespace Lotus {
 
         auto currentTime = std::chrono::high_resolution_clock::now();
         float timer = 0;
+        bool firstFrame = true;
         //SimpleRenderSystem LineListRenderSystem{ m_Device, m_Renderer.GetSwapChainRenderPass(), VK_PRIMITIVE_TOPOLOGY_LINE_LIST };
         while (!m_Window.Closed())
         {
             m_Window.Update();
 
+            m_AssetManager.Update();
+            UpdatePendingModels();
+
             auto newTime = std::chrono::high_resolution_clock::now();
             float frameTime = std::chrono::duration<float>(newTime - currentTime).count();
             currentTime = newTime;
@@ -121,22 +134,30 @@ namespace Lotus {
             if (auto commandBuffer = m_Renderer.BeginFrame())
             {
                 int frameIndex = m_Renderer.GetFrameIndex();
+                m_FrameAllocator.BeginFrame(frameIndex);
                 FrameInfo frameInfo{
                     frameIndex,
                     frameTime,
                     commandBuffer,
                     camera,
-                    globalDescriptorSets[frameIndex],
-                    m_GameObjects
+                    globalDescriptorSet,
+                    m_GameObjects,
+                    m_Renderer.GetSwapChainExtent(),
+                    m_TextureRegistry.GetDescriptorSet(frameIndex),
+                    instanceDescriptorSet,
+                    m_FrameAllocator
                 };
+
+                // this frame's texture set is no longer in use once BeginFrame returned
+                m_TextureStreamer.Update(frameInfo);
+                m_TextureRegistry.Update(frameIndex);
                 // Update
                 GlobalUbo ubo{};
                 ubo.projection = camera.GetProjectionMatrix();
                 ubo.view = camera.GetViewMatrix();
                 ubo.inverseView = camera.GetInverseViewMatrix();
                 pointLightSystem.Update(frameInfo, ubo, timer);
-                uboBuffers[frameIndex]->WriteToBuffer(&ubo);
-                uboBuffers[frameIndex]->Flush();
+                frameInfo.globalUboOffset = m_FrameAllocator.Push(ubo, FrameAllocator::Usage::Uniform).GetDynamicOffset();
                 // Render
                 m_Renderer.BeginSwapChainRenderPass(commandBuffer);
 
@@ -146,10 +167,55 @@ namespace Lotus {
 
                 //LineListRenderSystem.RenderGameObjects(frameInfo, m_LineListGameObjects);
                 m_Renderer.EndSwapChainRenderPass(commandBuffer);
+                // everything the systems allocated this frame, in one flush
+                m_FrameAllocator.Flush();
                 m_Renderer.EndFrame();
+
+                // startup benchmark: compare runs with and without pipeline.lcache in the working directory
+                if (firstFrame)
+                {
+                    firstFrame = false;
+                    LOTUS_CORE_INFO("Startup took {0:.2f} ms to the first frame ({1} pipeline cache)",
+                        std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_StartTime).count(),
+                        m_Device.IsPipelineCacheWarm() ? "warm" : "cold");
+                }
             }
         }
         vkDeviceWaitIdle(m_Device.GetDevice());
+        m_Device.GetAllocator().LogStats();
+        const UploadManager::Stats& uploadStats = m_Device.GetUploadManager().GetStats();
+        LOTUS_CORE_INFO("Uploads: {0} stagings of {1:.1f} MiB in {2} batches, {3} stalls on a full staging ring",
+            uploadStats.stagingCount, uploadStats.stagedBytes / (1024.0 * 1024.0), uploadStats.submittedBatches, uploadStats.stallCount);
+        const PipelineLibrary::Stats pipelineStats = m_Device.GetPipelineLibrary().GetStats();
+        LOTUS_CORE_INFO("Pipelines: {0} requests, {1} reused, {2} compiled in {3:.2f} ms, {4} compiled in the background in {5:.2f} ms",
+            pipelineStats.requests, pipelineStats.reused, pipelineStats.compiled, pipelineStats.compileMilliseconds,
+            pipelineStats.compiledAsync, pipelineStats.asyncCompileMilliseconds);
+        const char* streamNames[] = { "vertex", "index" };
+        for (size_t i = 0; i < static_cast<size_t>(GeometryArena::Stream::Count); i++)
+        {
+            const GeometryArena::Stats stats = m_Device.GetGeometryArena().GetStats(static_cast<GeometryArena::Stream>(i));
+            LOTUS_CORE_INFO("Geometry arena {0}: {1} allocations, {2:.1f} of {3:.1f} MiB used, high water {4:.1f} MiB, {5} free ranges, {6} moves of {7:.1f} MiB",
+                streamNames[i], stats.allocationCount, stats.allocatedBytes / (1024.0 * 1024.0), stats.capacity / (1024.0 * 1024.0),
+                stats.highWater / (1024.0 * 1024.0), stats.freeRangeCount, stats.moveCount, stats.movedBytes / (1024.0 * 1024.0));
+        }
+    }
+
+    void Application::UpdatePendingModels()
+    {
+        for (auto it = m_PendingModels.begin(); it != m_PendingModels.end();)
+        {
+            std::shared_ptr<Model> model = m_AssetManager.GetModel(it->second);
+            if (!model && !m_AssetManager.HasFailed(it->second))
+            {
+                ++it;
+                continue;
+            }
+
+            auto object = m_GameObjects.find(it->first);
+            if (object != m_GameObjects.end())
+                object->second.model = std::move(model);
+            it = m_PendingModels.erase(it);
+        }
     }
 
     std::unique_ptr<Model> createXYZ(Device& device, glm::vec3 offset)
@@ -184,36 +250,29 @@ namespace Lotus {
 
     void Application::LoadGameObjects()
     {
-        const std::shared_ptr<Model> vikingRoom =
-            Model::CreateModelFromFile(m_Device, "../Assets/Models/viking_room.obj");
+        // models are imported on worker threads, every object shows up as soon as its model is uploaded
         auto gameObject = GameObject::CreateGameObject();
-        gameObject.model = vikingRoom;
+        m_PendingModels.emplace_back(gameObject.GetId(), m_AssetManager.LoadModel("../Assets/Models/viking_room.obj"));
         gameObject.transform.position = { 2.f, 2.0f, 0.1f };
         gameObject.transform.rotation = glm::vec3{ 0.0f, 0.0f, -135.f };
         m_GameObjects.emplace(gameObject.GetId(), std::move(gameObject));
 
-        const std::shared_ptr<Model> smoothVase =
-            Model::CreateModelFromFile(m_Device, "../Assets/Models/smooth_vase.obj");
         auto gameObject2 = GameObject::CreateGameObject();
-        gameObject2.model = smoothVase;
+        m_PendingModels.emplace_back(gameObject2.GetId(), m_AssetManager.LoadModel("../Assets/Models/smooth_vase.obj"));
         gameObject2.transform.position = { -0.5f, 0.f, 0.0f };
         gameObject2.transform.rotation = glm::vec3{ -90.0f, 0.0f, 0.0f };
         gameObject2.transform.scale = { 2.f, 1.f, 2.f };
         m_GameObjects.emplace(gameObject2.GetId(), std::move(gameObject2));
 
-        const std::shared_ptr<Model> flatVase =
-            Model::CreateModelFromFile(m_Device, "../Assets/Models/flat_vase.obj");
         auto gameObject3 = GameObject::CreateGameObject();
-        gameObject3.model = flatVase;
+        m_PendingModels.emplace_back(gameObject3.GetId(), m_AssetManager.LoadModel("../Assets/Models/flat_vase.obj"));
         gameObject3.transform.position = { 0.5f, 0.f, 0.0f };
         gameObject3.transform.rotation = glm::vec3{ -90.0f, 0.0f, 0.0f };
         gameObject3.transform.scale = { 2.f, 1.f, 2.f };
         m_GameObjects.emplace(gameObject3.GetId(), std::move(gameObject3));
 
-        const std::shared_ptr<Model> quadmodel = 
-            Model::CreateModelFromFile(m_Device, "../assets/models/quad.obj");
         auto quad = GameObject::CreateGameObject();
-        quad.model = quadmodel;
+        m_PendingModels.emplace_back(quad.GetId(), m_AssetManager.LoadModel("../assets/models/quad.obj"));
         quad.transform.position = { 0.f, 0.f, 0.f };
         quad.transform.rotation = glm::vec3{ -90.0f, 0.0f, 0.0f };
         quad.transform.scale = { 3.f, 1.f, 3.f };
@@ -7,7 +7,14 @@
 #include "GameObject/GameObject.h"
 #include "Renderer/Renderer.h"
 #include "Renderer/Descriptors.h"
+#include "Renderer/FrameAllocator.h"
 #include "Renderer/Texture.h"
+#include "Renderer/TextureRegistry.h"
+#include "Assets/AssetManager.h"
+#include "Assets/TextureStreamer.h"
+#include "Systems/SimpleRenderSystem.h"
+
+#include <chrono>
 
 namespace Lotus {
 
@@ -27,14 +34,26 @@ namespace Lotus {
 
     private:
         void LoadGameObjects();
+        // Hands finished model loads to their game objects, objects without a model are not drawn
+        void UpdatePendingModels();
 
     private:
+        // first member, so the startup time includes creating the device and its pipeline cache
+        std::chrono::high_resolution_clock::time_point m_StartTime = std::chrono::high_resolution_clock::now();
+
         Window m_Window{ "Lotus Engine", WIDTH, HEIGHT };
         Device m_Device{ m_Window };
         Renderer m_Renderer{ m_Window, m_Device };
+        // slack for the instance descriptor, whose range can be longer than the frame's last chunk of instances
+        FrameAllocator m_FrameAllocator{ m_Device, FrameAllocator::DEFAULT_FRAME_SIZE, SimpleRenderSystem::INSTANCE_BUFFER_RANGE };
+
+        AssetManager m_AssetManager{ m_Device };
+        TextureRegistry m_TextureRegistry{ m_Device };
+        TextureStreamer m_TextureStreamer{ m_Device, m_TextureRegistry };
 
         std::unique_ptr<DescriptorPool> m_GlobalPool{};
         GameObject::Map m_GameObjects;
+        std::vector<std::pair<GameObject::id_t, AssetManager::AssetId>> m_PendingModels;
         //std::vector<GameObject> m_LineListGameObjects;
     };
 
@@ -2,6 +2,8 @@
 
 #ifdef LOTUS_PLATFORM_WINDOWS
 
+#include "Renderer/BcEncoder.h"
+
 extern Lotus::Application* Lotus::CreateApplication();
 
 int main(int argc, char** argv)
@@ -14,6 +16,29 @@ int main(int argc, char** argv)
 
 	printf("Lotus Engine\n");
 
+	// offline texture conversion, runs without creating a window or device:
+	// <app> --compress-texture <source image> <destination.ktx2> [bc1|bc3|bc5|bc7|bc1_unorm|bc3_unorm|bc7_unorm]
+	if (argc >= 4 && std::string(argv[1]) == "--compress-texture")
+	{
+		const VkFormat format = Lotus::BcEncoder::ParseFormat(argc >= 5 ? argv[4] : "bc7");
+		if (format == VK_FORMAT_UNDEFINED)
+		{
+			LOTUS_CORE_ERROR("Unknown block compression format {0}", argv[4]);
+			return 1;
+		}
+
+		try
+		{
+			Lotus::BcEncoder::CompressFile(argv[2], argv[3], format);
+		}
+		catch (const std::exception& e)
+		{
+			LOTUS_CORE_ERROR("{0}", e.what());
+			return 1;
+		}
+		return 0;
+	}
+
 	auto app = Lotus::CreateApplication();
 	app->Run();
 	delete app;
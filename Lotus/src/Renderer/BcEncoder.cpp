@@ -0,0 +1,576 @@
+#include "lotuspch.h"
+#include "BcEncoder.h"
+#include "MipGenerator.h"
+#include "TextureFile.h"
+#include "Utils/ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace Lotus {
+
+    namespace {
+
+        // block rows per ParallelFor job
+        constexpr uint32_t BLOCK_ROWS_PER_JOB = 4;
+        constexpr uint32_t LEAST_SQUARES_ITERATIONS = 2;
+
+        struct Color
+        {
+            float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        };
+
+        float Clamp(float value, float low, float high)
+        {
+            return std::min(std::max(value, low), high);
+        }
+
+        // Principal axis of the first channelCount channels by power iteration on the covariance matrix
+        void ComputePrincipalAxis(const uint8_t rgba[64], uint32_t channelCount, Color& mean, Color& axis)
+        {
+            mean = {};
+            for (uint32_t i = 0; i < 16; i++)
+                for (uint32_t c = 0; c < channelCount; c++)
+                    mean.v[c] += rgba[i * 4 + c] / 16.0f;
+
+            float covariance[4][4] = {};
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                for (uint32_t a = 0; a < channelCount; a++)
+                {
+                    const float da = rgba[i * 4 + a] - mean.v[a];
+                    for (uint32_t b = 0; b < channelCount; b++)
+                        covariance[a][b] += da * (rgba[i * 4 + b] - mean.v[b]);
+                }
+            }
+
+            axis = {};
+            for (uint32_t c = 0; c < channelCount; c++)
+                axis.v[c] = 1.0f;
+
+            for (uint32_t iteration = 0; iteration < 8; iteration++)
+            {
+                Color next{};
+                float length = 0.0f;
+                for (uint32_t a = 0; a < channelCount; a++)
+                {
+                    for (uint32_t b = 0; b < channelCount; b++)
+                        next.v[a] += covariance[a][b] * axis.v[b];
+                    length = std::max(length, std::abs(next.v[a]));
+                }
+                if (length < 1e-6f)
+                    break;
+                for (uint32_t c = 0; c < channelCount; c++)
+                    axis.v[c] = next.v[c] / length;
+            }
+        }
+
+        // Endpoints at the extremes of the block's projection onto its principal axis
+        void ComputeEndpoints(const uint8_t rgba[64], uint32_t channelCount, Color& e0, Color& e1)
+        {
+            Color mean, axis;
+            ComputePrincipalAxis(rgba, channelCount, mean, axis);
+
+            float minT = 0.0f, maxT = 0.0f;
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                float t = 0.0f;
+                for (uint32_t c = 0; c < channelCount; c++)
+                    t += (rgba[i * 4 + c] - mean.v[c]) * axis.v[c];
+                minT = std::min(minT, t);
+                maxT = std::max(maxT, t);
+            }
+
+            float axisLength2 = 0.0f;
+            for (uint32_t c = 0; c < channelCount; c++)
+                axisLength2 += axis.v[c] * axis.v[c];
+            if (axisLength2 > 0.0f)
+            {
+                minT /= axisLength2;
+                maxT /= axisLength2;
+            }
+
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                e0.v[c] = Clamp(mean.v[c] + axis.v[c] * maxT, 0.0f, 255.0f);
+                e1.v[c] = Clamp(mean.v[c] + axis.v[c] * minT, 0.0f, 255.0f);
+            }
+        }
+
+        // Least squares endpoints for fixed interpolation weights, weight = fraction of e1 in each texel
+        bool SolveEndpoints(const uint8_t rgba[64], uint32_t channelCount, const float weights[16], const bool used[16], Color& e0, Color& e1)
+        {
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            Color ax{}, bx{};
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                if (!used[i])
+                    continue;
+                const float b = weights[i];
+                const float a = 1.0f - b;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (uint32_t c = 0; c < channelCount; c++)
+                {
+                    ax.v[c] += a * rgba[i * 4 + c];
+                    bx.v[c] += b * rgba[i * 4 + c];
+                }
+            }
+
+            const float determinant = aa * bb - ab * ab;
+            if (std::abs(determinant) < 1e-6f)
+                return false;
+
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                e0.v[c] = Clamp((ax.v[c] * bb - bx.v[c] * ab) / determinant, 0.0f, 255.0f);
+                e1.v[c] = Clamp((bx.v[c] * aa - ax.v[c] * ab) / determinant, 0.0f, 255.0f);
+            }
+            return true;
+        }
+
+        uint16_t PackRgb565(const Color& color)
+        {
+            const uint32_t r = static_cast<uint32_t>(color.v[0] * 31.0f / 255.0f + 0.5f);
+            const uint32_t g = static_cast<uint32_t>(color.v[1] * 63.0f / 255.0f + 0.5f);
+            const uint32_t b = static_cast<uint32_t>(color.v[2] * 31.0f / 255.0f + 0.5f);
+            return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+        }
+
+        void UnpackRgb565(uint16_t packed, int32_t rgb[3])
+        {
+            const int32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+        }
+
+        int32_t ColorDistance(const uint8_t* texel, const int32_t* color, uint32_t channelCount)
+        {
+            int32_t distance = 0;
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                const int32_t d = texel[c] - color[c];
+                distance += d * d;
+            }
+            return distance;
+        }
+
+        // Picks the closest palette entry for every texel and returns the total error
+        int32_t SelectIndices(const uint8_t rgba[64], int32_t palette[][4], uint32_t paletteSize, uint32_t channelCount,
+            const bool used[16], uint8_t indices[16])
+        {
+            int32_t total = 0;
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                if (!used[i])
+                {
+                    indices[i] = 3;
+                    continue;
+                }
+
+                int32_t best = INT32_MAX;
+                for (uint32_t p = 0; p < paletteSize; p++)
+                {
+                    const int32_t distance = ColorDistance(rgba + i * 4, palette[p], channelCount);
+                    if (distance < best)
+                    {
+                        best = distance;
+                        indices[i] = static_cast<uint8_t>(p);
+                    }
+                }
+                total += best;
+            }
+            return total;
+        }
+
+        // Appends bits to a block LSB first
+        class BitWriter
+        {
+        public:
+            explicit BitWriter(uint8_t* block, size_t size) : m_Block(block) { std::memset(block, 0, size); }
+
+            void Write(uint32_t value, uint32_t bitCount)
+            {
+                for (uint32_t i = 0; i < bitCount; i++, m_Position++)
+                {
+                    if (value & (1u << i))
+                        m_Block[m_Position >> 3] |= static_cast<uint8_t>(1u << (m_Position & 7));
+                }
+            }
+
+        private:
+            uint8_t* m_Block;
+            uint32_t m_Position = 0;
+        };
+
+        // Copies a 4x4 block out of the image, repeating the last row / column past the edges
+        void FetchBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t rgba[64])
+        {
+            for (uint32_t y = 0; y < 4; y++)
+            {
+                const uint32_t sy = std::min(blockY * 4 + y, height - 1);
+                for (uint32_t x = 0; x < 4; x++)
+                {
+                    const uint32_t sx = std::min(blockX * 4 + x, width - 1);
+                    std::memcpy(rgba + (y * 4 + x) * 4, pixels + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+                }
+            }
+        }
+
+    }
+
+    bool BcEncoder::IsSupportedFormat(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    VkFormat BcEncoder::ParseFormat(const std::string& name)
+    {
+        static const std::unordered_map<std::string, VkFormat> formats = {
+            { "bc1", VK_FORMAT_BC1_RGBA_SRGB_BLOCK },
+            { "bc1_unorm", VK_FORMAT_BC1_RGBA_UNORM_BLOCK },
+            { "bc3", VK_FORMAT_BC3_SRGB_BLOCK },
+            { "bc3_unorm", VK_FORMAT_BC3_UNORM_BLOCK },
+            { "bc5", VK_FORMAT_BC5_UNORM_BLOCK },
+            { "bc7", VK_FORMAT_BC7_SRGB_BLOCK },
+            { "bc7_unorm", VK_FORMAT_BC7_UNORM_BLOCK },
+        };
+
+        auto it = formats.find(name);
+        return it != formats.end() ? it->second : VK_FORMAT_UNDEFINED;
+    }
+
+    void BcEncoder::EncodeBc1Block(const uint8_t rgba[64], bool allowTransparent, uint8_t block[8])
+    {
+        // texels with alpha below one half become the transparent entry of the three color mode
+        bool used[16];
+        bool transparent = false;
+        uint32_t usedCount = 0;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            used[i] = !allowTransparent || rgba[i * 4 + 3] >= 128;
+            transparent |= !used[i];
+            usedCount += used[i];
+        }
+
+        if (usedCount == 0)
+        {
+            // fully transparent: c0 <= c1 with every index pointing at the transparent entry
+            const uint8_t transparentBlock[8] = { 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF };
+            std::memcpy(block, transparentBlock, 8);
+            return;
+        }
+
+        uint8_t opaque[64];
+        std::memcpy(opaque, rgba, 64);
+        if (transparent)
+        {
+            // keep the transparent texels out of the endpoint fit
+            uint32_t firstUsed = 0;
+            while (!used[firstUsed])
+                firstUsed++;
+            for (uint32_t i = 0; i < 16; i++)
+                if (!used[i])
+                    std::memcpy(opaque + i * 4, rgba + firstUsed * 4, 4);
+        }
+
+        Color e0, e1;
+        ComputeEndpoints(opaque, 3, e0, e1);
+
+        // four color mode interpolates at thirds, three color mode at the midpoint
+        const uint32_t paletteSize = transparent ? 3 : 4;
+        const float paletteWeights[4] = { 0.0f, 1.0f, transparent ? 0.5f : 1.0f / 3.0f, 2.0f / 3.0f };
+
+        uint16_t c0 = 0, c1 = 0;
+        uint8_t indices[16] = {};
+        for (uint32_t iteration = 0; iteration <= LEAST_SQUARES_ITERATIONS; iteration++)
+        {
+            c0 = PackRgb565(e0);
+            c1 = PackRgb565(e1);
+            // the endpoint order selects the mode
+            if ((!transparent && c0 < c1) || (transparent && c0 > c1))
+            {
+                std::swap(c0, c1);
+                std::swap(e0, e1);
+            }
+
+            int32_t palette[4][4] = {};
+            UnpackRgb565(c0, palette[0]);
+            UnpackRgb565(c1, palette[1]);
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                if (transparent)
+                {
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                }
+                else
+                {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+            }
+            SelectIndices(opaque, palette, c0 == c1 ? 1 : paletteSize, 3, used, indices);
+
+            if (iteration == LEAST_SQUARES_ITERATIONS || c0 == c1)
+                break;
+
+            float weights[16];
+            for (uint32_t i = 0; i < 16; i++)
+                weights[i] = paletteWeights[indices[i]];
+            if (!SolveEndpoints(opaque, 3, weights, used, e0, e1))
+                break;
+        }
+
+        if (!transparent && c0 == c1)
+        {
+            // solid block; c0 == c1 would read as three color mode, which is still fine for index 0
+            for (uint32_t i = 0; i < 16; i++)
+                indices[i] = 0;
+        }
+
+        BitWriter writer(block, 8);
+        writer.Write(c0, 16);
+        writer.Write(c1, 16);
+        for (uint32_t i = 0; i < 16; i++)
+            writer.Write(indices[i], 2);
+    }
+
+    void BcEncoder::EncodeBc4Block(const uint8_t rgba[64], uint32_t channel, uint8_t block[8])
+    {
+        uint8_t low = 255, high = 0;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            low = std::min(low, rgba[i * 4 + channel]);
+            high = std::max(high, rgba[i * 4 + channel]);
+        }
+
+        // a0 > a1 selects the eight value mode: a0, a1 and six interpolants
+        int32_t palette[8];
+        palette[0] = high;
+        palette[1] = low;
+        for (uint32_t i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * high + i * low) / 7;
+
+        BitWriter writer(block, 8);
+        writer.Write(high, 8);
+        writer.Write(low, 8);
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            uint32_t bestIndex = 0;
+            int32_t best = INT32_MAX;
+            for (uint32_t p = 0; p < (high == low ? 1u : 8u); p++)
+            {
+                const int32_t distance = std::abs(rgba[i * 4 + channel] - palette[p]);
+                if (distance < best)
+                {
+                    best = distance;
+                    bestIndex = p;
+                }
+            }
+            writer.Write(bestIndex, 3);
+        }
+    }
+
+    void BcEncoder::EncodeBc7Block(const uint8_t rgba[64], uint8_t block[16])
+    {
+        // mode 6: one subset, RGBA endpoints with 7 bits plus a p-bit each, 4-bit indices
+        static constexpr int32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        bool used[16];
+        for (uint32_t i = 0; i < 16; i++)
+            used[i] = true;
+
+        Color e0, e1;
+        ComputeEndpoints(rgba, 4, e0, e1);
+
+        int32_t bestError = INT32_MAX;
+        uint32_t bestEndpoints[2][4] = {};
+        uint32_t bestPBits[2] = {};
+        uint8_t bestIndices[16] = {};
+
+        for (uint32_t iteration = 0; iteration <= LEAST_SQUARES_ITERATIONS; iteration++)
+        {
+            uint8_t iterationIndices[16] = {};
+            int32_t iterationError = INT32_MAX;
+
+            // try every p-bit combination, each one shifts the reachable endpoint values by one
+            for (uint32_t pBits = 0; pBits < 4; pBits++)
+            {
+                const uint32_t p[2] = { pBits & 1, pBits >> 1 };
+                uint32_t endpoints[2][4];
+                int32_t expanded[2][4];
+                for (uint32_t e = 0; e < 2; e++)
+                {
+                    const Color& color = e == 0 ? e0 : e1;
+                    for (uint32_t c = 0; c < 4; c++)
+                    {
+                        const float q = std::round((color.v[c] - p[e]) / 2.0f);
+                        endpoints[e][c] = static_cast<uint32_t>(Clamp(q, 0.0f, 127.0f));
+                        expanded[e][c] = static_cast<int32_t>((endpoints[e][c] << 1) | p[e]);
+                    }
+                }
+
+                int32_t palette[16][4];
+                for (uint32_t i = 0; i < 16; i++)
+                    for (uint32_t c = 0; c < 4; c++)
+                        palette[i][c] = ((64 - weights[i]) * expanded[0][c] + weights[i] * expanded[1][c] + 32) >> 6;
+
+                uint8_t indices[16];
+                const int32_t error = SelectIndices(rgba, palette, 16, 4, used, indices);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    std::memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+                    bestPBits[0] = p[0];
+                    bestPBits[1] = p[1];
+                    std::memcpy(bestIndices, indices, sizeof(indices));
+                }
+                if (error < iterationError)
+                {
+                    iterationError = error;
+                    std::memcpy(iterationIndices, indices, sizeof(indices));
+                }
+            }
+
+            if (iteration == LEAST_SQUARES_ITERATIONS || bestError == 0)
+                break;
+
+            float fitWeights[16];
+            for (uint32_t i = 0; i < 16; i++)
+                fitWeights[i] = weights[iterationIndices[i]] / 64.0f;
+            if (!SolveEndpoints(rgba, 4, fitWeights, used, e0, e1))
+                break;
+        }
+
+        // the anchor index is stored with its top bit implied zero
+        if (bestIndices[0] & 8)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+                std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+            std::swap(bestPBits[0], bestPBits[1]);
+            for (uint32_t i = 0; i < 16; i++)
+                bestIndices[i] = static_cast<uint8_t>(15 - bestIndices[i]);
+        }
+
+        BitWriter writer(block, 16);
+        writer.Write(1u << 6, 7);
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            writer.Write(bestEndpoints[0][c], 7);
+            writer.Write(bestEndpoints[1][c], 7);
+        }
+        writer.Write(bestPBits[0], 1);
+        writer.Write(bestPBits[1], 1);
+        writer.Write(bestIndices[0], 3);
+        for (uint32_t i = 1; i < 16; i++)
+            writer.Write(bestIndices[i], 4);
+    }
+
+    void BcEncoder::Compress(const Texture::ImageData& source, VkFormat format, Texture::ImageData& result)
+    {
+        assert((source.format == VK_FORMAT_R8G8B8A8_SRGB || source.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+            "BC compression expects an RGBA8 image");
+        if (!IsSupportedFormat(format))
+            throw std::runtime_error("unsupported block compression format");
+
+        const uint32_t blockSize = TextureFile::GetBlockByteSize(format);
+
+        result.width = source.width;
+        result.height = source.height;
+        result.format = format;
+        result.generateMipsOnGpu = false;
+        result.levels.clear();
+
+        size_t offset = 0;
+        for (const Texture::MipLevel& level : source.levels)
+        {
+            const size_t size = TextureFile::GetLevelSize(format, level.width, level.height);
+            result.levels.push_back({ level.width, level.height, offset, size });
+            offset += size;
+        }
+        result.pixels.resize(offset);
+
+        for (size_t levelIndex = 0; levelIndex < source.levels.size(); levelIndex++)
+        {
+            const Texture::MipLevel& level = source.levels[levelIndex];
+            const uint8_t* pixels = source.GetPixels() + level.offset;
+            uint8_t* output = result.pixels.data() + result.levels[levelIndex].offset;
+
+            const uint32_t blocksX = (level.width + 3) / 4;
+            const uint32_t blocksY = (level.height + 3) / 4;
+            const uint32_t jobCount = (blocksY + BLOCK_ROWS_PER_JOB - 1) / BLOCK_ROWS_PER_JOB;
+
+            ThreadPool::Get().ParallelFor(jobCount, [&](uint32_t job)
+            {
+                uint8_t rgba[64];
+                const uint32_t lastRow = std::min(blocksY, (job + 1) * BLOCK_ROWS_PER_JOB);
+                for (uint32_t by = job * BLOCK_ROWS_PER_JOB; by < lastRow; by++)
+                {
+                    for (uint32_t bx = 0; bx < blocksX; bx++)
+                    {
+                        FetchBlock(pixels, level.width, level.height, bx, by, rgba);
+                        uint8_t* block = output + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+
+                        switch (format)
+                        {
+                        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                            EncodeBc1Block(rgba, true, block);
+                            break;
+                        case VK_FORMAT_BC3_UNORM_BLOCK:
+                        case VK_FORMAT_BC3_SRGB_BLOCK:
+                            EncodeBc4Block(rgba, 3, block);
+                            EncodeBc1Block(rgba, false, block + 8);
+                            break;
+                        case VK_FORMAT_BC5_UNORM_BLOCK:
+                            EncodeBc4Block(rgba, 0, block);
+                            EncodeBc4Block(rgba, 1, block + 8);
+                            break;
+                        default:
+                            EncodeBc7Block(rgba, block);
+                            break;
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    void BcEncoder::CompressFile(const std::string& sourcePath, const std::string& destinationPath, VkFormat format)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        Texture::ImageData image;
+        Texture::Decode(sourcePath, image, Texture::MipGeneration::None);
+
+        // color formats are filtered in linear space, two channel data such as normals as-is
+        const bool srgb = format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+        image.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        MipGenerator::Generate(image);
+
+        Texture::ImageData compressed;
+        Compress(image, format, compressed);
+        TextureFile::WriteKtx2(destinationPath, compressed);
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        LOTUS_CORE_INFO("Compressed {0} to {1}: {2} levels, {3} KB -> {4} KB in {5:.2f} ms",
+            sourcePath, destinationPath, compressed.levels.size(),
+            image.pixels.size() / 1024, compressed.pixels.size() / 1024,
+            std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Lotus {
+
+	// Offline block compressor for RGBA8 images. Supported targets are BC1 (RGB, 1-bit alpha),
+	// BC3 (RGBA), BC5 (two channel, for normal maps) and BC7 (RGBA, mode 6 only).
+	// Endpoints come from the principal axis of each 4x4 block and are refined with a least squares fit;
+	// blocks are encoded in parallel on the ThreadPool. Meant for asset conversion, not for use at load time.
+	class BcEncoder
+	{
+	public:
+		static bool IsSupportedFormat(VkFormat format);
+		// "bc1", "bc3", "bc7" (sRGB), "bc1_unorm", "bc3_unorm", "bc7_unorm" and "bc5"; VK_FORMAT_UNDEFINED otherwise
+		static VkFormat ParseFormat(const std::string& name);
+
+		// Compresses every level of an RGBA8 image; result gets the same level extents in the target format
+		static void Compress(const Texture::ImageData& source, VkFormat format, Texture::ImageData& result);
+
+		// Decodes a PNG/JPG/..., generates its mip chain, compresses it and writes it as KTX2
+		static void CompressFile(const std::string& sourcePath, const std::string& destinationPath, VkFormat format);
+
+		static void EncodeBc1Block(const uint8_t rgba[64], bool allowTransparent, uint8_t block[8]);
+		static void EncodeBc4Block(const uint8_t rgba[64], uint32_t channel, uint8_t block[8]);
+		static void EncodeBc7Block(const uint8_t rgba[64], uint8_t block[16]);
+	};
+
+}
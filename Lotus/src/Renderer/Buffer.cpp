@@ -56,12 +56,14 @@ namespace Lotus
     {
         Unmap();
         vkDestroyBuffer(m_Device.GetDevice(), m_Buffer, nullptr);
-        vkFreeMemory(m_Device.GetDevice(), m_Memory, nullptr);
+        m_Device.FreeMemory(m_Memory);
     }
 
     /**
      * Map a memory range of this buffer. If successful, mapped points to the specified buffer range.
      *
+     * @note Host visible memory is mapped persistently by the allocator, so this only hands out a pointer
+     *
      * @param size (Optional) Size of the memory range to map. Pass VK_WHOLE_SIZE to map the complete
      * buffer range.
      * @param offset (Optional) Byte offset from beginning
@@ -70,22 +72,23 @@ namespace Lotus
      */
     VkResult Buffer::Map(VkDeviceSize size, VkDeviceSize offset)
     {
-        assert(m_Buffer && m_Memory && "Called map on buffer before create");
-        return vkMapMemory(m_Device.GetDevice(), m_Memory, offset, size, 0, &m_Mapped);
+        assert(m_Buffer && m_Memory.IsValid() && "Called map on buffer before create");
+        if (m_Memory.mapped == nullptr)
+        {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+        m_Mapped = static_cast<char*>(m_Memory.mapped) + offset;
+        return VK_SUCCESS;
     }
 
     /**
      * Unmap a mapped memory range
      *
-     * @note Does not return a result as vkUnmapMemory can't fail
+     * @note The memory itself stays mapped until it is freed
      */
     void Buffer::Unmap()
     {
-        if (m_Mapped)
-        {
-            vkUnmapMemory(m_Device.GetDevice(), m_Memory);
-            m_Mapped = nullptr;
-        }
+        m_Mapped = nullptr;
     }
 
     /**
@@ -126,12 +129,7 @@ namespace Lotus
      */
     VkResult Buffer::Flush(VkDeviceSize size, VkDeviceSize offset)
     {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = m_Memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkFlushMappedMemoryRanges(m_Device.GetDevice(), 1, &mappedRange);
+        return m_Device.GetAllocator().Flush(m_Memory, size, offset);
     }
 
     /**
@@ -147,12 +145,7 @@ namespace Lotus
      */
     VkResult Buffer::Invalidate(VkDeviceSize size, VkDeviceSize offset)
     {
-        VkMappedMemoryRange mappedRange = {};
-        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        mappedRange.memory = m_Memory;
-        mappedRange.offset = offset;
-        mappedRange.size = size;
-        return vkInvalidateMappedMemoryRanges(m_Device.GetDevice(), 1, &mappedRange);
+        return m_Device.GetAllocator().Invalidate(m_Memory, size, offset);
     }
 
     /**
@@ -48,7 +48,7 @@ namespace Lotus
         Device& m_Device;
         void* m_Mapped = nullptr;
         VkBuffer m_Buffer = VK_NULL_HANDLE;
-        VkDeviceMemory m_Memory = VK_NULL_HANDLE;
+        MemoryAllocation m_Memory;
 
         VkDeviceSize m_BufferSize;
         uint32_t m_InstanceCount;
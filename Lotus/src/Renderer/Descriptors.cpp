@@ -15,7 +15,8 @@ namespace Lotus
         uint32_t binding,
         VkDescriptorType descriptorType,
         VkShaderStageFlags stageFlags,
-        uint32_t count)
+        uint32_t count,
+        VkDescriptorBindingFlags flags)
     {
         assert(m_Bindings.count(binding) == 0 && "Binding already in use");
         VkDescriptorSetLayoutBinding layoutBinding{};
@@ -24,24 +25,31 @@ namespace Lotus
         layoutBinding.descriptorCount = count;
         layoutBinding.stageFlags = stageFlags;
         m_Bindings[binding] = layoutBinding;
+        m_BindingFlags[binding] = flags;
         return *this;
     }
 
     std::unique_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::Build() const
     {
-        return std::make_unique<DescriptorSetLayout>(m_Device, m_Bindings);
+        return std::make_unique<DescriptorSetLayout>(m_Device, m_Bindings, m_BindingFlags);
     }
 
     // *************** Descriptor Set Layout *********************
 
     DescriptorSetLayout::DescriptorSetLayout(
-        Device& lveDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings)
+        Device& lveDevice, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+        const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags)
         : m_Device{ lveDevice }, m_Bindings{ bindings }
     {
         std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+        std::vector<VkDescriptorBindingFlags> setLayoutBindingFlags{};
+        VkDescriptorBindingFlags allFlags = 0;
         for (auto& kv : bindings)
         {
             setLayoutBindings.push_back(kv.second);
+            auto flags = bindingFlags.find(kv.first);
+            setLayoutBindingFlags.push_back(flags != bindingFlags.end() ? flags->second : 0);
+            allFlags |= setLayoutBindingFlags.back();
         }
 
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
@@ -49,6 +57,20 @@ namespace Lotus
         descriptorSetLayoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
         descriptorSetLayoutInfo.pBindings = setLayoutBindings.data();
 
+        // binding flags are only chained in when a binding uses descriptor indexing
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(setLayoutBindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = setLayoutBindingFlags.data();
+        if (allFlags != 0)
+        {
+            descriptorSetLayoutInfo.pNext = &bindingFlagsInfo;
+        }
+        if (allFlags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT)
+        {
+            descriptorSetLayoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        }
+
         if (vkCreateDescriptorSetLayout(
             lveDevice.GetDevice(),
             &descriptorSetLayoutInfo,
@@ -178,20 +200,22 @@ namespace Lotus
     }
 
     DescriptorWriter& DescriptorWriter::WriteImage(
-        uint32_t binding, VkDescriptorImageInfo* imageInfo)
+        uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t arrayElement)
     {
         assert(m_SetLayout.m_Bindings.count(binding) == 1 && "Layout does not contain specified binding");
 
         auto& bindingDescription = m_SetLayout.m_Bindings[binding];
 
+        // arrays are written one element at a time
         assert(
-            bindingDescription.descriptorCount == 1 &&
-            "Binding single descriptor info, but binding expects multiple");
+            arrayElement < bindingDescription.descriptorCount &&
+            "Array element is outside of the binding");
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.descriptorType = bindingDescription.descriptorType;
         write.dstBinding = binding;
+        write.dstArrayElement = arrayElement;
         write.pImageInfo = imageInfo;
         write.descriptorCount = 1;
 
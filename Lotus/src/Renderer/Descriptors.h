@@ -18,20 +18,25 @@ namespace Lotus
         public:
             Builder(Device& device) : m_Device{ device } {}
 
+            // flags are descriptor indexing binding flags, a layout with an UPDATE_AFTER_BIND binding
+            // has to be allocated from a pool created with VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT
             Builder& AddBinding(
                 uint32_t binding,
                 VkDescriptorType descriptorType,
                 VkShaderStageFlags stageFlags,
-                uint32_t count = 1);
+                uint32_t count = 1,
+                VkDescriptorBindingFlags flags = 0);
             std::unique_ptr<DescriptorSetLayout> Build() const;
 
         private:
             Device& m_Device;
             std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> m_Bindings{};
+            std::unordered_map<uint32_t, VkDescriptorBindingFlags> m_BindingFlags{};
         };
 
         DescriptorSetLayout(
-            Device& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings);
+            Device& device, std::unordered_map<uint32_t, VkDescriptorSetLayoutBinding> bindings,
+            const std::unordered_map<uint32_t, VkDescriptorBindingFlags>& bindingFlags = {});
         ~DescriptorSetLayout();
         DescriptorSetLayout(const DescriptorSetLayout&) = delete;
         DescriptorSetLayout& operator=(const DescriptorSetLayout&) = delete;
@@ -95,7 +100,7 @@ namespace Lotus
         DescriptorWriter(DescriptorSetLayout& setLayout, DescriptorPool& pool);
 
         DescriptorWriter& WriteBuffer(uint32_t binding, VkDescriptorBufferInfo* bufferInfo);
-        DescriptorWriter& WriteImage(uint32_t binding, VkDescriptorImageInfo* imageInfo);
+        DescriptorWriter& WriteImage(uint32_t binding, VkDescriptorImageInfo* imageInfo, uint32_t arrayElement = 0);
 
         bool Build(VkDescriptorSet& set);
         void Overwrite(VkDescriptorSet& set);
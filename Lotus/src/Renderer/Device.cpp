@@ -1,5 +1,14 @@
 #include "lotuspch.h"
 #include "Device.h"
+#include "GeometryArena.h"
+#include "PipelineLibrary.h"
+#include "UploadManager.h"
+#include "Utils/Utils.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 
 namespace Lotus
 {
@@ -57,10 +66,27 @@ namespace Lotus
         PickPhysicalDevice();
         CreateLogicalDevice();
         CreateCommandPool();
+        CreatePipelineCache();
+        m_Allocator = std::make_unique<MemoryAllocator>(m_PhysicalDevice, m_Device);
+        m_UploadManager = std::make_unique<UploadManager>(*this);
+        m_GeometryArena = std::make_unique<GeometryArena>(*this);
+        m_PipelineLibrary = std::make_unique<PipelineLibrary>(*this);
     }
 
     Device::~Device()
     {
+        m_PipelineLibrary.reset();
+        m_GeometryArena.reset();
+        m_UploadManager.reset();
+
+        for (auto& kv : m_Samplers)
+            vkDestroySampler(m_Device, kv.second, nullptr);
+
+        SavePipelineCache();
+        vkDestroyPipelineCache(m_Device, m_PipelineCache, nullptr);
+
+        m_Allocator.reset();
+
         vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
         vkDestroyDevice(m_Device, nullptr);
 
@@ -86,7 +112,7 @@ namespace Lotus
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2; // descriptor indexing is core from 1.2
 
         VkInstanceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -158,6 +184,11 @@ namespace Lotus
             return 0;
         }
 
+        // or without Vulkan 1.2 for the bindless texture table
+        if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+            return 0;
+        }
+
         return score;
 
     }
@@ -189,7 +220,9 @@ namespace Lotus
         QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+        m_GraphicsFamily = indices.graphicsFamily;
+        m_TransferFamily = indices.transferFamilyHasValue ? indices.transferFamily : indices.graphicsFamily;
+        std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily, m_TransferFamily };
 
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -202,8 +235,34 @@ namespace Lotus
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures = {};
-        deviceFeatures.samplerAnisotropy = VK_TRUE;
+        VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+        supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures = {};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &supportedFeatures12;
+        vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &supportedFeatures);
+
+        // the bindless texture table, see TextureRegistry
+        if (!supportedFeatures12.runtimeDescriptorArray || !supportedFeatures12.descriptorBindingPartiallyBound ||
+            !supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind || !supportedFeatures12.shaderSampledImageArrayNonUniformIndexing)
+        {
+            throw std::runtime_error("GPU does not support descriptor indexing!");
+        }
+
+        VkPhysicalDeviceVulkan12Features deviceFeatures12 = {};
+        deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        deviceFeatures12.descriptorIndexing = VK_TRUE;
+        deviceFeatures12.runtimeDescriptorArray = VK_TRUE;
+        deviceFeatures12.descriptorBindingPartiallyBound = VK_TRUE;
+        deviceFeatures12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        deviceFeatures12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+        VkPhysicalDeviceFeatures2 deviceFeatures = {};
+        deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures.pNext = &deviceFeatures12;
+        deviceFeatures.features.samplerAnisotropy = VK_TRUE;
+        // BC1-BC7 textures, see TextureFile
+        deviceFeatures.features.textureCompressionBC = supportedFeatures.features.textureCompressionBC;
 
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -211,7 +270,9 @@ namespace Lotus
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        // features are chained through pNext so the 1.2 ones can be enabled too
+        createInfo.pNext = &deviceFeatures;
+        createInfo.pEnabledFeatures = nullptr;
         createInfo.enabledExtensionCount = static_cast<uint32_t>(m_DeviceExtensions.size());
         createInfo.ppEnabledExtensionNames = m_DeviceExtensions.data();
 
@@ -234,6 +295,12 @@ namespace Lotus
 
         vkGetDeviceQueue(m_Device, indices.graphicsFamily, 0, &m_GraphicsQueue);
         vkGetDeviceQueue(m_Device, indices.presentFamily, 0, &m_PresentQueue);
+        vkGetDeviceQueue(m_Device, m_TransferFamily, 0, &m_TransferQueue);
+
+        if (HasDedicatedTransferQueue())
+            LOTUS_CORE_INFO("Uploading on queue family {0}, rendering on {1}", m_TransferFamily, m_GraphicsFamily);
+        else
+            LOTUS_CORE_INFO("No separate transfer queue family, uploading on the graphics queue");
     }
 
     void Device::CreateCommandPool()
@@ -427,6 +494,30 @@ namespace Lotus
             i++;
         }
 
+        // the DMA engine's family has transfer but neither graphics nor compute, an async compute family
+        // is the next best thing; either only qualifies when it can copy images of any size, which a
+        // coarser minImageTransferGranularity rules out for the small mip levels
+        uint32_t bestScore = 0;
+        for (uint32_t family = 0; family < queueFamilyCount; family++)
+        {
+            const VkQueueFamilyProperties& properties = queueFamilies[family];
+            const VkExtent3D& granularity = properties.minImageTransferGranularity;
+            if (properties.queueCount == 0 || !(properties.queueFlags & VK_QUEUE_TRANSFER_BIT) ||
+                (properties.queueFlags & VK_QUEUE_GRAPHICS_BIT) ||
+                granularity.width != 1 || granularity.height != 1 || granularity.depth != 1)
+            {
+                continue;
+            }
+
+            const uint32_t score = (properties.queueFlags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+            if (score > bestScore)
+            {
+                bestScore = score;
+                indices.transferFamily = family;
+                indices.transferFamilyHasValue = true;
+            }
+        }
+
         return indices;
     }
 
@@ -501,7 +592,7 @@ namespace Lotus
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer& buffer,
-        VkDeviceMemory& bufferMemory)
+        MemoryAllocation& bufferMemory)
     {
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -514,20 +605,12 @@ namespace Lotus
             throw std::runtime_error("failed to create vertex buffer!");
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(m_Device, buffer, &memRequirements);
+        bufferMemory = m_Allocator->AllocateForBuffer(buffer, properties);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
+        if (vkBindBufferMemory(m_Device, buffer, bufferMemory.memory, bufferMemory.offset) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to allocate vertex buffer memory!");
+            throw std::runtime_error("failed to bind vertex buffer memory!");
         }
-
-        vkBindBufferMemory(m_Device, buffer, bufferMemory, 0);
     }
 
     VkCommandBuffer Device::BeginSingleTimeCommands()
@@ -657,29 +740,167 @@ namespace Lotus
         const VkImageCreateInfo& imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory)
+        MemoryAllocation& imageMemory)
     {
         if (vkCreateImage(m_Device, &imageInfo, nullptr, &image) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create image!");
         }
 
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(m_Device, image, &memRequirements);
+        imageMemory = m_Allocator->AllocateForImage(image, imageInfo.tiling, properties);
+
+        if (vkBindImageMemory(m_Device, image, imageMemory.memory, imageMemory.offset) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to bind image memory!");
+        }
+    }
+
+    VkSampler Device::GetSampler(const VkSamplerCreateInfo& samplerInfo)
+    {
+        assert(samplerInfo.pNext == nullptr && "chained sampler create infos can't be shared");
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+        // every member after pNext is a 32-bit value, so the bytes up to the last one have no padding
+        const char* first = reinterpret_cast<const char*>(&samplerInfo.flags);
+        const char* last = reinterpret_cast<const char*>(&samplerInfo.unnormalizedCoordinates) + sizeof(samplerInfo.unnormalizedCoordinates);
+        std::string key(first, last);
 
-        if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+        auto it = m_Samplers.find(key);
+        if (it != m_Samplers.end())
+            return it->second;
+
+        VkSampler sampler;
+        if (vkCreateSampler(m_Device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
         {
-            throw std::runtime_error("failed to allocate image memory!");
+            throw std::runtime_error("failed to create texture sampler!");
         }
+        m_Samplers.emplace(std::move(key), sampler);
+        return sampler;
+    }
 
-        if (vkBindImageMemory(m_Device, image, imageMemory, 0) != VK_SUCCESS)
+    namespace
+    {
+        // wraps the driver's data so a truncated or corrupted file is caught before the driver sees it
+        struct PipelineCacheFileHeader
         {
-            throw std::runtime_error("failed to bind image memory!");
+            uint32_t magic;
+            uint32_t version;
+            uint64_t dataSize;
+            uint64_t dataHash;
+        };
+
+        constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x4F53504C; // "LPSO"
+        constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+    }
+
+    void Device::CreatePipelineCache()
+    {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        std::vector<char> data;
+        {
+            std::ifstream file{ PIPELINE_CACHE_PATH, std::ios::binary | std::ios::ate };
+            if (file.is_open())
+            {
+                const std::streamsize fileSize = file.tellg();
+                PipelineCacheFileHeader header{};
+                file.seekg(0);
+                if (fileSize >= static_cast<std::streamsize>(sizeof(header)) &&
+                    file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+                    header.magic == PIPELINE_CACHE_MAGIC && header.version == PIPELINE_CACHE_VERSION &&
+                    header.dataSize == static_cast<uint64_t>(fileSize) - sizeof(header))
+                {
+                    data.resize(static_cast<size_t>(header.dataSize));
+                    if (!file.read(data.data(), static_cast<std::streamsize>(data.size())) ||
+                        HashBytes(data.data(), data.size()) != header.dataHash)
+                    {
+                        data.clear();
+                    }
+                }
+            }
+        }
+
+        m_PipelineCacheWarm = !data.empty() && IsPipelineCacheCompatible(data);
+        if (!data.empty() && !m_PipelineCacheWarm)
+            LOTUS_CORE_WARN("Discarding pipeline cache {0}, it was written by another device or driver", PIPELINE_CACHE_PATH);
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = m_PipelineCacheWarm ? data.size() : 0;
+        cacheInfo.pInitialData = m_PipelineCacheWarm ? data.data() : nullptr;
+
+        if (vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_PipelineCache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+
+        const auto endTime = std::chrono::high_resolution_clock::now();
+        if (m_PipelineCacheWarm)
+        {
+            LOTUS_CORE_INFO("Loaded pipeline cache {0} ({1} KB) in {2:.2f} ms", PIPELINE_CACHE_PATH, data.size() / 1024,
+                std::chrono::duration<float, std::milli>(endTime - startTime).count());
+        }
+        else
+            LOTUS_CORE_INFO("Starting with an empty pipeline cache, pipelines are compiled from scratch");
+    }
+
+    bool Device::IsPipelineCacheCompatible(const std::vector<char>& data) const
+    {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (data.size() < sizeof(header))
+            return false;
+        memcpy(&header, data.data(), sizeof(header));
+
+        return header.headerSize >= sizeof(header) &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    void Device::SavePipelineCache()
+    {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+            return;
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(m_Device, m_PipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+            return;
+        data.resize(dataSize);
+
+        PipelineCacheFileHeader header{};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.version = PIPELINE_CACHE_VERSION;
+        header.dataSize = data.size();
+        header.dataHash = HashBytes(data.data(), data.size());
+
+        // write to a temporary file and rename it, so a crash never leaves a half-written cache behind
+        const std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+        {
+            std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open())
+            {
+                LOTUS_CORE_WARN("Failed to write pipeline cache {0}", PIPELINE_CACHE_PATH);
+                return;
+            }
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file.good())
+            {
+                LOTUS_CORE_WARN("Failed to write pipeline cache {0}", PIPELINE_CACHE_PATH);
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, PIPELINE_CACHE_PATH, error);
+        if (error)
+        {
+            LOTUS_CORE_WARN("Failed to write pipeline cache {0}: {1}", PIPELINE_CACHE_PATH, error.message());
+            std::filesystem::remove(tempPath, error);
+            return;
         }
+        LOTUS_CORE_INFO("Saved pipeline cache {0} ({1} KB)", PIPELINE_CACHE_PATH, data.size() / 1024);
     }
 }
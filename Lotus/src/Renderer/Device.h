@@ -1,12 +1,20 @@
 #pragma once
 
 #include "Window/Window.h"
+#include "MemoryAllocator.h"
 
 // std lib headers
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace Lotus
 {
+    class UploadManager;
+    class GeometryArena;
+    class PipelineLibrary;
+
     struct SwapChainSupportDetails
     {
         VkSurfaceCapabilitiesKHR capabilities;
@@ -18,8 +26,11 @@ namespace Lotus
     {
         uint32_t graphicsFamily;
         uint32_t presentFamily;
+        // a family for uploads without graphics, only found when the device has one
+        uint32_t transferFamily;
         bool graphicsFamilyHasValue = false;
         bool presentFamilyHasValue = false;
+        bool transferFamilyHasValue = false;
         bool IsComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
     };
 
@@ -47,6 +58,11 @@ namespace Lotus
         VkSurfaceKHR Surface() const { return m_Surface; }
         VkQueue GraphicsQueue() const { return m_GraphicsQueue; }
         VkQueue PresentQueue() const { return m_PresentQueue; }
+        // The graphics queue when the device has no separate transfer family
+        VkQueue TransferQueue() const { return m_TransferQueue; }
+        uint32_t GraphicsQueueFamily() const { return m_GraphicsFamily; }
+        uint32_t TransferQueueFamily() const { return m_TransferFamily; }
+        bool HasDedicatedTransferQueue() const { return m_TransferFamily != m_GraphicsFamily; }
 
         SwapChainSupportDetails GetSwapChainSupport() { return QuerySwapChainSupport(m_PhysicalDevice); }
         uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -55,12 +71,13 @@ namespace Lotus
             const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
         // Buffer Helper Functions
+        // Memory comes from the device's MemoryAllocator, release it with FreeMemory after destroying the buffer
         void CreateBuffer(
             VkDeviceSize size,
             VkBufferUsageFlags usage,
             VkMemoryPropertyFlags properties,
             VkBuffer& buffer,
-            VkDeviceMemory& bufferMemory);
+            MemoryAllocation& bufferMemory);
         VkCommandBuffer BeginSingleTimeCommands();
         void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
         void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
@@ -73,7 +90,27 @@ namespace Lotus
             const VkImageCreateInfo& imageInfo,
             VkMemoryPropertyFlags properties,
             VkImage& image,
-            VkDeviceMemory& imageMemory);
+            MemoryAllocation& imageMemory);
+        void FreeMemory(MemoryAllocation& allocation) { m_Allocator->Free(allocation); }
+        MemoryAllocator& GetAllocator() { return *m_Allocator; }
+        // Batched staging uploads, see UploadManager
+        UploadManager& GetUploadManager() { return *m_UploadManager; }
+        // Shared vertex and index buffers every Model lives in, see GeometryArena
+        GeometryArena& GetGeometryArena() { return *m_GeometryArena; }
+        // Every pipeline and shader module, see PipelineLibrary
+        PipelineLibrary& GetPipelineLibrary() { return *m_PipelineLibrary; }
+
+        // Samplers are shared: one is created per distinct create info and lives as long as the device.
+        // samplerInfo.pNext must be null.
+        VkSampler GetSampler(const VkSamplerCreateInfo& samplerInfo);
+
+        // Shared by every pipeline. Loaded from PIPELINE_CACHE_PATH when the file was written by the same
+        // driver on the same device, and saved back when the device is destroyed.
+        VkPipelineCache GetPipelineCache() const { return m_PipelineCache; }
+        // False when the cache started out empty, every pipeline is then compiled from scratch
+        bool IsPipelineCacheWarm() const { return m_PipelineCacheWarm; }
+
+        static constexpr const char* PIPELINE_CACHE_PATH = "pipeline.lcache";
 
         VkPhysicalDeviceProperties properties;
 
@@ -86,6 +123,10 @@ namespace Lotus
         VkPhysicalDevice FindSuitableDevice(const std::vector<VkPhysicalDevice>& devices);
         void CreateLogicalDevice();
         void CreateCommandPool();
+        void CreatePipelineCache();
+        void SavePipelineCache();
+        // Rejects data another driver, device or a truncated write left behind
+        bool IsPipelineCacheCompatible(const std::vector<char>& data) const;
 
         // helper functions
         //bool IsDeviceSuitable(VkPhysicalDevice device);
@@ -107,6 +148,19 @@ namespace Lotus
         VkSurfaceKHR m_Surface;
         VkQueue m_GraphicsQueue;
         VkQueue m_PresentQueue;
+        VkQueue m_TransferQueue;
+        uint32_t m_GraphicsFamily = 0;
+        uint32_t m_TransferFamily = 0;
+
+        std::unique_ptr<MemoryAllocator> m_Allocator;
+        std::unique_ptr<UploadManager> m_UploadManager;
+        std::unique_ptr<GeometryArena> m_GeometryArena;
+        std::unique_ptr<PipelineLibrary> m_PipelineLibrary;
+
+        std::unordered_map<std::string, VkSampler> m_Samplers; // keyed on the create info bytes after pNext
+
+        VkPipelineCache m_PipelineCache = VK_NULL_HANDLE;
+        bool m_PipelineCacheWarm = false;
 
         const std::vector<const char*> m_ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
         const std::vector<const char*> m_DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
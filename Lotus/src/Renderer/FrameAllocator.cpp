@@ -0,0 +1,76 @@
+#include "lotuspch.h"
+#include "FrameAllocator.h"
+
+#include "Device.h"
+#include "SwapChain.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Lotus {
+
+    FrameAllocator::FrameAllocator(Device& device, VkDeviceSize frameSize, VkDeviceSize maxDescriptorRange)
+        : m_Device{ device }
+    {
+        const VkPhysicalDeviceLimits& limits = m_Device.properties.limits;
+        m_Alignments[static_cast<size_t>(Usage::Uniform)] = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 16);
+        m_Alignments[static_cast<size_t>(Usage::Storage)] = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 16);
+        m_Alignments[static_cast<size_t>(Usage::Vertex)] = 16;
+
+        // regions start aligned for every usage, so offsets within a region only need the allocation's alignment
+        const VkDeviceSize regionAlignment = std::max(m_Alignments[0], std::max(m_Alignments[1], limits.nonCoherentAtomSize));
+        m_FrameSize = (frameSize + regionAlignment - 1) / regionAlignment * regionAlignment;
+        m_Stats.frameSize = m_FrameSize;
+
+        m_Device.CreateBuffer(
+            m_FrameSize * SwapChain::MAX_FRAMES_IN_FLIGHT + maxDescriptorRange,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            m_Buffer,
+            m_Memory);
+    }
+
+    FrameAllocator::~FrameAllocator()
+    {
+        vkDestroyBuffer(m_Device.GetDevice(), m_Buffer, nullptr);
+        m_Device.FreeMemory(m_Memory);
+    }
+
+    void FrameAllocator::BeginFrame(int frameIndex)
+    {
+        assert(frameIndex >= 0 && frameIndex < SwapChain::MAX_FRAMES_IN_FLIGHT && "frame index out of range");
+
+        m_Stats.peakBytes = std::max(m_Stats.peakBytes, m_Head - m_FrameBegin);
+        m_FrameBegin = static_cast<VkDeviceSize>(frameIndex) * m_FrameSize;
+        m_Head = m_FrameBegin;
+        m_FlushedUpTo = m_FrameBegin;
+    }
+
+    FrameAllocator::Allocation FrameAllocator::Allocate(VkDeviceSize size, Usage usage)
+    {
+        const VkDeviceSize alignment = m_Alignments[static_cast<size_t>(usage)];
+        const VkDeviceSize offset = (m_Head + alignment - 1) / alignment * alignment;
+        if (offset + size > m_FrameBegin + m_FrameSize)
+        {
+            throw std::runtime_error("frame allocator out of space!");
+        }
+        m_Head = offset + size;
+
+        Allocation allocation{};
+        allocation.data = static_cast<char*>(m_Memory.mapped) + offset;
+        allocation.buffer = m_Buffer;
+        allocation.offset = offset;
+        return allocation;
+    }
+
+    void FrameAllocator::Flush()
+    {
+        if (m_Head == m_FlushedUpTo)
+            return;
+
+        m_Device.GetAllocator().Flush(m_Memory, m_Head - m_FlushedUpTo, m_FlushedUpTo);
+        m_Stats.flushedBytes += m_Head - m_FlushedUpTo;
+        m_FlushedUpTo = m_Head;
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace Lotus {
+
+	class Device;
+
+	// Bump allocator for data written by the CPU once per frame: uniforms, storage and transient
+	// vertices. One persistently mapped buffer holds a region per frame in flight; BeginFrame
+	// rewinds the region of a frame whose fence has signalled, and allocations are aligned for the
+	// descriptor type they are read through. Descriptors point at the buffer once, with the *_DYNAMIC
+	// types, and every bind passes GetDynamicOffset instead of getting a set per frame.
+	// Flush only writes back what was allocated since the last flush, nothing on coherent memory.
+	// maxDescriptorRange is the largest range such a descriptor uses; the buffer is that much longer than
+	// its regions, so an allocation's offset plus the range never runs past its end even when the
+	// allocation itself is smaller.
+	class FrameAllocator
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 4ull << 20;
+
+		enum class Usage : uint8_t
+		{
+			Uniform, // minUniformBufferOffsetAlignment
+			Storage, // minStorageBufferOffsetAlignment
+			Vertex
+		};
+
+		struct Allocation
+		{
+			void* data = nullptr;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0; // from the start of buffer
+
+			uint32_t GetDynamicOffset() const { return static_cast<uint32_t>(offset); }
+		};
+
+		struct Stats
+		{
+			VkDeviceSize frameSize = 0;
+			VkDeviceSize peakBytes = 0; // most used by a single frame, alignment padding included
+			uint64_t flushedBytes = 0;
+		};
+
+		FrameAllocator(Device& device, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE, VkDeviceSize maxDescriptorRange = 0);
+		~FrameAllocator();
+
+		FrameAllocator(const FrameAllocator&) = delete;
+		FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+		// Rewinds the frame's region, call once the frame's previous submission has completed
+		void BeginFrame(int frameIndex);
+
+		// Valid until the same frame index begins again; throws when the frame's region is full
+		Allocation Allocate(VkDeviceSize size, Usage usage);
+		template<typename T>
+		Allocation Push(const T& value, Usage usage)
+		{
+			const Allocation allocation = Allocate(sizeof(T), usage);
+			memcpy(allocation.data, &value, sizeof(T));
+			return allocation;
+		}
+
+		// Makes everything allocated since the last flush visible to the device, call before submitting
+		void Flush();
+
+		// For descriptors of the *_DYNAMIC types: the dynamic offset selects the data. A range past
+		// maxDescriptorRange is only valid when every allocation read through it is at least that large
+		VkDescriptorBufferInfo DescriptorInfo(VkDeviceSize range) const { return { m_Buffer, 0, range }; }
+		VkBuffer GetBuffer() const { return m_Buffer; }
+		const Stats& GetStats() const { return m_Stats; }
+
+	private:
+		Device& m_Device;
+		VkBuffer m_Buffer = VK_NULL_HANDLE;
+		MemoryAllocation m_Memory;
+		VkDeviceSize m_FrameSize;
+		VkDeviceSize m_Alignments[3]{}; // indexed by Usage
+
+		VkDeviceSize m_FrameBegin = 0;
+		VkDeviceSize m_Head = 0;
+		VkDeviceSize m_FlushedUpTo = 0;
+
+		Stats m_Stats{};
+	};
+
+}
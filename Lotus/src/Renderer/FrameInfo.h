@@ -2,6 +2,7 @@
 
 #include "Camera/Camera.h"
 #include "GameObject/GameObject.h"
+#include "Renderer/FrameAllocator.h"
 #include <vulkan/vulkan.h>
 
 namespace Lotus
@@ -31,5 +32,11 @@ namespace Lotus
         Camera& camera;
         VkDescriptorSet globalDescriptorSet;
         GameObject::Map& gameObjects;
+        VkExtent2D extent;
+        VkDescriptorSet textureDescriptorSet; // bindless texture table, see TextureRegistry
+        VkDescriptorSet instanceDescriptorSet; // dynamic storage buffer over the frame allocator, for per-instance data
+        FrameAllocator& frameAllocator; // transient per-frame data, already rewound for this frame
+        uint32_t globalUboOffset = 0; // dynamic offset of the GlobalUbo, pass it when binding globalDescriptorSet
+        uint32_t pointLightCount = 0; // lights in the GlobalUbo, set by PointLightSystem::Update
     };
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "lotuspch.h"
+#include "Frustum.h"
+
+namespace Lotus
+{
+    Frustum::Frustum(const glm::mat4& viewProjection)
+    {
+        // Gribb and Hartmann plane extraction, with the [0, 1] clip depth range Vulkan uses
+        const glm::mat4 m = glm::transpose(viewProjection);
+        m_Planes[0] = m[3] + m[0]; // left
+        m_Planes[1] = m[3] - m[0]; // right
+        m_Planes[2] = m[3] + m[1]; // bottom
+        m_Planes[3] = m[3] - m[1]; // top
+        m_Planes[4] = m[2];        // near
+        m_Planes[5] = m[3] - m[2]; // far
+
+        for (glm::vec4& plane : m_Planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (const glm::vec4& plane : m_Planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+}
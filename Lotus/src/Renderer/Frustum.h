@@ -0,0 +1,22 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace Lotus {
+
+	// View frustum as six inward-facing planes (xyz = normal, w = distance), used for culling
+	class Frustum
+	{
+	public:
+		Frustum() = default;
+		explicit Frustum(const glm::mat4& viewProjection);
+
+		bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+	private:
+		glm::vec4 m_Planes[6]{};
+	};
+
+}
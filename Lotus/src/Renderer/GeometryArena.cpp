@@ -0,0 +1,260 @@
+#include "lotuspch.h"
+#include "GeometryArena.h"
+
+#include "Device.h"
+#include "SwapChain.h"
+
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+namespace Lotus {
+
+    GeometryArena::GeometryArena(Device& device, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+        : m_Device{ device }
+    {
+        const VkDeviceSize capacities[] = { vertexCapacity, indexCapacity };
+        const VkBufferUsageFlags usages[] = { VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_BUFFER_USAGE_INDEX_BUFFER_BIT };
+        for (size_t i = 0; i < static_cast<size_t>(Stream::Count); i++)
+        {
+            StreamData& stream = m_Streams[i];
+            stream.capacity = capacities[i];
+            // compaction copies within the buffer, so it is a transfer source as well
+            m_Device.CreateBuffer(
+                stream.capacity,
+                usages[i] | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                stream.buffer,
+                stream.memory);
+            stream.freeRanges.emplace(0, stream.capacity);
+        }
+    }
+
+    GeometryArena::~GeometryArena()
+    {
+        // uploads and moves may still be writing the buffers
+        m_Device.GetUploadManager().WaitIdle();
+
+        for (StreamData& stream : m_Streams)
+        {
+            vkDestroyBuffer(m_Device.GetDevice(), stream.buffer, nullptr);
+            m_Device.FreeMemory(stream.memory);
+        }
+    }
+
+    GeometryArena::Handle GeometryArena::Allocate(Stream stream, uint32_t elementSize, uint32_t elementCount)
+    {
+        assert(elementSize > 0 && elementCount > 0 && "geometry allocation must not be empty");
+
+        StreamData& data = m_Streams[static_cast<size_t>(stream)];
+        const VkDeviceSize size = static_cast<VkDeviceSize>(elementSize) * elementCount;
+        VkDeviceSize offset = 0;
+        if (!TakeRange(data, size, elementSize, data.capacity, offset))
+        {
+            throw std::runtime_error("failed to allocate geometry arena space!");
+        }
+
+        Handle handle;
+        if (!m_FreeHandles.empty())
+        {
+            handle = m_FreeHandles.back();
+            m_FreeHandles.pop_back();
+        }
+        else
+        {
+            handle = static_cast<Handle>(m_Allocations.size());
+            m_Allocations.emplace_back();
+        }
+
+        Allocation& allocation = m_Allocations[handle];
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.elementSize = elementSize;
+        allocation.firstElement = static_cast<uint32_t>(offset / elementSize);
+        allocation.stream = stream;
+        allocation.uploadId = 0;
+
+        data.live.emplace(offset, handle);
+        data.allocatedBytes += size;
+        return handle;
+    }
+
+    void GeometryArena::Free(Handle handle)
+    {
+        assert(handle < m_Allocations.size() && "invalid geometry handle");
+
+        const Allocation& allocation = m_Allocations[handle];
+        StreamData& data = m_Streams[static_cast<size_t>(allocation.stream)];
+        data.live.erase(allocation.offset);
+        data.allocatedBytes -= allocation.size;
+        m_PendingFrees.push_back({ allocation.stream, allocation.offset, allocation.size, m_Frame });
+        m_FreeHandles.push_back(handle);
+    }
+
+    void GeometryArena::Write(Handle handle, const UploadManager::StagingAllocation& staging)
+    {
+        Allocation& allocation = m_Allocations[handle];
+        UploadManager& uploads = m_Device.GetUploadManager();
+        uploads.CopyToBuffer(staging, GetBuffer(allocation.stream), allocation.size, allocation.offset);
+        allocation.uploadId = uploads.GetPendingId();
+    }
+
+    void GeometryArena::Upload(Handle handle, const void* data)
+    {
+        const VkDeviceSize size = m_Allocations[handle].size;
+        const UploadManager::StagingAllocation staging = m_Device.GetUploadManager().Stage(size);
+        memcpy(staging.data, data, size);
+        Write(handle, staging);
+    }
+
+    void GeometryArena::BindVertexBuffer(VkCommandBuffer commandBuffer) const
+    {
+        const VkBuffer buffers[] = { GetBuffer(Stream::Vertex) };
+        constexpr VkDeviceSize offsets[] = { 0 };
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    }
+
+    void GeometryArena::BindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType) const
+    {
+        vkCmdBindIndexBuffer(commandBuffer, GetBuffer(Stream::Index), 0, indexType);
+    }
+
+    void GeometryArena::NextFrame()
+    {
+        m_Frame++;
+
+        // the frame that last read these ranges has completed
+        while (!m_PendingFrees.empty() && m_PendingFrees.front().frame + SwapChain::MAX_FRAMES_IN_FLIGHT <= m_Frame)
+        {
+            const PendingFree& pending = m_PendingFrees.front();
+            ReturnRange(m_Streams[static_cast<size_t>(pending.stream)], pending.offset, pending.size);
+            m_PendingFrees.pop_front();
+        }
+
+        bool barrierNeeded = false;
+        for (size_t i = 0; i < static_cast<size_t>(Stream::Count); i++)
+            Compact(static_cast<Stream>(i), COMPACTION_BUDGET, barrierNeeded);
+
+        if (barrierNeeded)
+        {
+            // the moves run on the graphics queue, which owns the live ranges; besides the draws, later
+            // copies read moved ranges or overwrite the ranges they came from, so they wait too
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            vkCmdPipelineBarrier(m_Device.GetUploadManager().GetGraphicsCommandBuffer(),
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    void GeometryArena::Compact(Stream stream, VkDeviceSize budget, bool& barrierNeeded)
+    {
+        StreamData& data = m_Streams[static_cast<size_t>(stream)];
+        UploadManager& uploads = m_Device.GetUploadManager();
+
+        // Moving the highest allocation into the lowest hole that fits keeps every allocation
+        // below the high water mark and the free space above it in one piece. The old range is
+        // freed like an unloaded mesh, so frames already recorded keep reading valid data.
+        VkDeviceSize moved = 0;
+        while (!data.live.empty())
+        {
+            const auto top = std::prev(data.live.end());
+            const Handle handle = top->second;
+            Allocation& allocation = m_Allocations[handle];
+            if (moved > 0 && moved + allocation.size > budget)
+                break;
+            if (!uploads.IsComplete(allocation.uploadId))
+                break;
+
+            VkDeviceSize offset = 0;
+            if (!TakeRange(data, allocation.size, allocation.elementSize, allocation.offset, offset))
+                break;
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = allocation.offset;
+            copyRegion.dstOffset = offset;
+            copyRegion.size = allocation.size;
+            vkCmdCopyBuffer(uploads.GetGraphicsCommandBuffer(), data.buffer, data.buffer, 1, &copyRegion);
+            barrierNeeded = true;
+
+            m_PendingFrees.push_back({ stream, allocation.offset, allocation.size, m_Frame });
+            data.live.erase(top);
+            data.live.emplace(offset, handle);
+            allocation.offset = offset;
+            allocation.firstElement = static_cast<uint32_t>(offset / allocation.elementSize);
+
+            moved += allocation.size;
+            data.movedBytes += allocation.size;
+            data.moveCount++;
+        }
+    }
+
+    bool GeometryArena::TakeRange(StreamData& stream, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize limit, VkDeviceSize& offset)
+    {
+        for (auto it = stream.freeRanges.begin(); it != stream.freeRanges.end(); ++it)
+        {
+            // vertex strides need not be powers of two
+            const VkDeviceSize rangeOffset = it->first;
+            const VkDeviceSize rangeEnd = it->first + it->second;
+            const VkDeviceSize start = (rangeOffset + alignment - 1) / alignment * alignment;
+            if (start + size > rangeEnd)
+                continue;
+            // ranges are ordered by offset, every later fit ends higher still
+            if (start + size > limit)
+                return false;
+
+            stream.freeRanges.erase(it);
+            if (start > rangeOffset)
+                stream.freeRanges.emplace(rangeOffset, start - rangeOffset);
+            if (start + size < rangeEnd)
+                stream.freeRanges.emplace(start + size, rangeEnd - start - size);
+            offset = start;
+            return true;
+        }
+        return false;
+    }
+
+    void GeometryArena::ReturnRange(StreamData& stream, VkDeviceSize offset, VkDeviceSize size)
+    {
+        auto next = stream.freeRanges.lower_bound(offset);
+        if (next != stream.freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = stream.freeRanges.erase(next);
+        }
+
+        if (next != stream.freeRanges.begin())
+        {
+            const auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+        stream.freeRanges.emplace_hint(next, offset, size);
+    }
+
+    GeometryArena::Stats GeometryArena::GetStats(Stream stream) const
+    {
+        const StreamData& data = m_Streams[static_cast<size_t>(stream)];
+
+        Stats stats{};
+        stats.capacity = data.capacity;
+        stats.allocatedBytes = data.allocatedBytes;
+        if (!data.live.empty())
+        {
+            const auto top = std::prev(data.live.end());
+            stats.highWater = top->first + m_Allocations[top->second].size;
+        }
+        stats.allocationCount = static_cast<uint32_t>(data.live.size());
+        stats.freeRangeCount = static_cast<uint32_t>(data.freeRanges.size());
+        stats.movedBytes = data.movedBytes;
+        stats.moveCount = data.moveCount;
+        return stats;
+    }
+
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace Lotus {
+
+	class Device;
+
+	// One device local vertex buffer and one index buffer shared by every Model, so a frame binds
+	// geometry once and then only issues draws, and a single indirect draw could cover every mesh.
+	// A mesh is a range of elements in each buffer: draws use its first element as vertexOffset or
+	// firstIndex. Every vertex format and both index types share the buffers, ranges are aligned to
+	// their element size so the offsets stay whole elements.
+	//
+	// Free ranges are kept ordered by offset and merge with their neighbours. A range freed while
+	// frames in flight may still read it only returns to the free list MAX_FRAMES_IN_FLIGHT frames
+	// later. To keep the free space in one piece as meshes are unloaded, NextFrame moves the highest
+	// allocations down into holes a few megabytes at a time; handles stay valid across moves, so
+	// look up the offsets while recording. Not thread safe, use it from the render thread.
+	class GeometryArena
+	{
+	public:
+		using Handle = uint32_t;
+		static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+		static constexpr VkDeviceSize DEFAULT_VERTEX_CAPACITY = 256ull << 20;
+		static constexpr VkDeviceSize DEFAULT_INDEX_CAPACITY = 128ull << 20;
+		// bytes moved by compaction per frame; a single larger allocation is still moved on its own
+		static constexpr VkDeviceSize COMPACTION_BUDGET = 8ull << 20;
+
+		enum class Stream : uint8_t
+		{
+			Vertex,
+			Index,
+			Count
+		};
+
+		struct Stats
+		{
+			VkDeviceSize capacity = 0;
+			VkDeviceSize allocatedBytes = 0; // live allocations, alignment padding excluded
+			VkDeviceSize highWater = 0;      // end of the highest allocation
+			uint32_t allocationCount = 0;
+			uint32_t freeRangeCount = 0;     // ranges below the high water mark are holes
+			uint64_t movedBytes = 0;         // copied by compaction so far
+			uint64_t moveCount = 0;
+		};
+
+		GeometryArena(Device& device, VkDeviceSize vertexCapacity = DEFAULT_VERTEX_CAPACITY,
+			VkDeviceSize indexCapacity = DEFAULT_INDEX_CAPACITY);
+		~GeometryArena();
+
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		// Reserves elementCount elements of elementSize bytes, throws when the stream is full
+		Handle Allocate(Stream stream, uint32_t elementSize, uint32_t elementCount);
+		// The range stays readable by frames already recorded, see NextFrame
+		void Free(Handle handle);
+
+		// Records the copy of staged data into the whole allocation
+		void Write(Handle handle, const UploadManager::StagingAllocation& staging);
+		// Stages the data and records the copy
+		void Upload(Handle handle, const void* data);
+
+		// vertexOffset or firstIndex of the allocation; changes when compaction moves it
+		uint32_t GetFirstElement(Handle handle) const { return m_Allocations[handle].firstElement; }
+		VkDeviceSize GetSize(Handle handle) const { return m_Allocations[handle].size; }
+
+		void BindVertexBuffer(VkCommandBuffer commandBuffer) const;
+		void BindIndexBuffer(VkCommandBuffer commandBuffer, VkIndexType indexType) const;
+		VkBuffer GetBuffer(Stream stream) const { return m_Streams[static_cast<size_t>(stream)].buffer; }
+
+		// Call once a frame after waiting for the frame MAX_FRAMES_IN_FLIGHT back: reuses the ranges
+		// that frame was the last to read and records this frame's compaction into the upload batch
+		void NextFrame();
+
+		Stats GetStats(Stream stream) const;
+
+	private:
+		struct Allocation
+		{
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+			uint32_t elementSize = 0;
+			uint32_t firstElement = 0;
+			Stream stream = Stream::Vertex;
+			// compaction leaves the allocation alone until the upload writing it has completed
+			UploadManager::UploadId uploadId = 0;
+		};
+
+		struct StreamData
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			MemoryAllocation memory;
+			VkDeviceSize capacity = 0;
+			std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+			std::map<VkDeviceSize, Handle> live;             // offset -> handle
+			VkDeviceSize allocatedBytes = 0;
+			uint64_t movedBytes = 0;
+			uint64_t moveCount = 0;
+		};
+
+		struct PendingFree
+		{
+			Stream stream;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			uint64_t frame; // frame the range was last readable in
+		};
+
+		// First fit at or below limit, returns false when nothing fits
+		static bool TakeRange(StreamData& stream, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize limit, VkDeviceSize& offset);
+		static void ReturnRange(StreamData& stream, VkDeviceSize offset, VkDeviceSize size);
+		void Compact(Stream stream, VkDeviceSize budget, bool& barrierNeeded);
+
+	private:
+		Device& m_Device;
+		StreamData m_Streams[static_cast<size_t>(Stream::Count)];
+
+		std::vector<Allocation> m_Allocations; // indexed by handle
+		std::vector<Handle> m_FreeHandles;
+		std::deque<PendingFree> m_PendingFrees;
+		uint64_t m_Frame = 0;
+	};
+
+}
@@ -0,0 +1,669 @@
+#include "lotuspch.h"
+#include "MemoryAllocator.h"
+
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Lotus {
+
+    namespace
+    {
+        // heaps up to this size get blocks of an eighth of the heap, larger ones LARGE_BLOCK_SIZE
+        constexpr VkDeviceSize SMALL_HEAP_SIZE = 1ull << 30;
+        constexpr VkDeviceSize LARGE_BLOCK_SIZE = 256ull << 20;
+
+        inline uint32_t CountTrailingZeros(uint32_t mask)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<uint32_t>(index);
+#else
+            return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+        }
+
+        inline uint32_t CountTrailingZeros64(uint64_t mask)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward64(&index, mask);
+            return static_cast<uint32_t>(index);
+#else
+            return static_cast<uint32_t>(__builtin_ctzll(mask));
+#endif
+        }
+
+        inline uint32_t FindLastSet64(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanReverse64(&index, value);
+            return static_cast<uint32_t>(index);
+#else
+            return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+        }
+
+        inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        // bufferImageGranularity is a power of two
+        inline bool OnSamePage(VkDeviceSize a, VkDeviceSize b, VkDeviceSize pageSize)
+        {
+            return (a & ~(pageSize - 1)) == (b & ~(pageSize - 1));
+        }
+    }
+
+    // One vkAllocateMemory block split by a TLSF allocator. Every range of the block, used or free,
+    // is a node in a list ordered by offset; free nodes are also in the list of their size class.
+    // The first level of size classes is the power of two, the second splits it into SL_COUNT linear
+    // steps, and a bitmap per level tells which lists are non-empty. Adjacent free nodes are always merged.
+    class MemoryBlock
+    {
+    public:
+        enum class Use : uint8_t
+        {
+            Free,
+            Linear,
+            Optimal
+        };
+
+        MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void* mapped)
+            : m_Memory{ memory }, m_Size{ size }, m_Mapped{ mapped }
+        {
+            for (auto& heads : m_FreeHeads)
+                heads.fill(INVALID_NODE);
+
+            const uint32_t node = NewNode();
+            m_Nodes[node].size = size;
+            InsertFree(node);
+        }
+
+        // Finds a free range for size bytes at the given alignment. Ranges used by the other kind of
+        // resource are kept off the same granularity page.
+        bool Allocate(VkDeviceSize size, VkDeviceSize alignment, Use use, VkDeviceSize granularity,
+            VkDeviceSize& offset, uint32_t& node)
+        {
+            uint32_t fl, sl;
+            Mapping(size, fl, sl);
+
+            // the list the size maps to may hold ranges that are too small, the lists above it only
+            // fail when alignment or granularity padding doesn't fit
+            while (FindFreeList(fl, sl))
+            {
+                for (uint32_t index = m_FreeHeads[fl][sl]; index != INVALID_NODE; index = m_Nodes[index].nextFree)
+                {
+                    if (Fits(index, size, alignment, use, granularity, offset))
+                    {
+                        Take(index, offset, size, use);
+                        node = index;
+                        return true;
+                    }
+                }
+
+                if (++sl == SL_COUNT)
+                {
+                    sl = 0;
+                    if (++fl == FL_COUNT)
+                        break;
+                }
+            }
+            return false;
+        }
+
+        void Free(uint32_t node)
+        {
+            assert(m_Nodes[node].use != Use::Free && "memory freed twice");
+
+            m_AllocationCount--;
+            m_AllocatedBytes -= m_Nodes[node].size;
+            m_Nodes[node].use = Use::Free;
+
+            const uint32_t prev = m_Nodes[node].prevPhysical;
+            if (prev != INVALID_NODE && m_Nodes[prev].use == Use::Free)
+            {
+                RemoveFree(prev);
+                m_Nodes[node].offset = m_Nodes[prev].offset;
+                m_Nodes[node].size += m_Nodes[prev].size;
+                LinkPhysical(m_Nodes[prev].prevPhysical, node);
+                ReleaseNode(prev);
+            }
+
+            const uint32_t next = m_Nodes[node].nextPhysical;
+            if (next != INVALID_NODE && m_Nodes[next].use == Use::Free)
+            {
+                RemoveFree(next);
+                m_Nodes[node].size += m_Nodes[next].size;
+                LinkPhysical(node, m_Nodes[next].nextPhysical);
+                ReleaseNode(next);
+            }
+
+            InsertFree(node);
+        }
+
+        VkDeviceMemory GetMemory() const { return m_Memory; }
+        VkDeviceSize GetSize() const { return m_Size; }
+        void* GetMapped() const { return m_Mapped; }
+        uint32_t GetAllocationCount() const { return m_AllocationCount; }
+        VkDeviceSize GetAllocatedBytes() const { return m_AllocatedBytes; }
+        bool IsEmpty() const { return m_AllocationCount == 0; }
+
+    private:
+        static constexpr uint32_t SL_BITS = 4;
+        static constexpr uint32_t SL_COUNT = 1u << SL_BITS;
+        static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+        static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+        struct Node
+        {
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            uint32_t prevPhysical = INVALID_NODE;
+            uint32_t nextPhysical = INVALID_NODE;
+            uint32_t prevFree = INVALID_NODE;
+            uint32_t nextFree = INVALID_NODE;
+            Use use = Use::Free;
+        };
+
+        // Sizes below SL_COUNT map to the first level one to one, larger ones to the power of two
+        // and the SL_BITS bits below its top bit
+        static void Mapping(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+        {
+            if (size < SL_COUNT)
+            {
+                fl = 0;
+                sl = static_cast<uint32_t>(size);
+                return;
+            }
+
+            const uint32_t log2 = FindLastSet64(size);
+            fl = log2 - SL_BITS + 1;
+            sl = static_cast<uint32_t>(size >> (log2 - SL_BITS)) ^ SL_COUNT;
+        }
+
+        // Moves (fl, sl) to the first non-empty list at or above it
+        bool FindFreeList(uint32_t& fl, uint32_t& sl) const
+        {
+            uint32_t slMap = m_SlBitmaps[fl] & (~0u << sl);
+            if (slMap == 0)
+            {
+                const uint64_t flMap = fl + 1 < FL_COUNT ? m_FlBitmap & (~0ull << (fl + 1)) : 0;
+                if (flMap == 0)
+                    return false;
+
+                fl = CountTrailingZeros64(flMap);
+                slMap = m_SlBitmaps[fl];
+            }
+            sl = CountTrailingZeros(slMap);
+            return true;
+        }
+
+        bool Fits(uint32_t index, VkDeviceSize size, VkDeviceSize alignment, Use use, VkDeviceSize granularity,
+            VkDeviceSize& offset) const
+        {
+            const Node& node = m_Nodes[index];
+            VkDeviceSize begin = AlignUp(node.offset, alignment);
+
+            // the neighbours of a free node are always in use, since free nodes are merged
+            if (granularity > 1 && node.prevPhysical != INVALID_NODE)
+            {
+                const Node& prev = m_Nodes[node.prevPhysical];
+                if (prev.use != use && OnSamePage(prev.offset + prev.size - 1, begin, granularity))
+                    begin = AlignUp(begin, granularity);
+            }
+
+            const VkDeviceSize end = begin + size;
+            if (end > node.offset + node.size)
+                return false;
+
+            if (granularity > 1 && node.nextPhysical != INVALID_NODE)
+            {
+                const Node& next = m_Nodes[node.nextPhysical];
+                if (next.use != use && OnSamePage(end - 1, next.offset, granularity))
+                    return false;
+            }
+
+            offset = begin;
+            return true;
+        }
+
+        // Marks [offset, offset + size) of the free node as used, padding on either side stays free
+        void Take(uint32_t index, VkDeviceSize offset, VkDeviceSize size, Use use)
+        {
+            RemoveFree(index);
+
+            const VkDeviceSize nodeBegin = m_Nodes[index].offset;
+            const VkDeviceSize nodeEnd = nodeBegin + m_Nodes[index].size;
+            const VkDeviceSize end = offset + size;
+
+            if (offset > nodeBegin)
+            {
+                const uint32_t padding = NewNode();
+                m_Nodes[padding].offset = nodeBegin;
+                m_Nodes[padding].size = offset - nodeBegin;
+                LinkPhysical(m_Nodes[index].prevPhysical, padding);
+                LinkPhysical(padding, index);
+                InsertFree(padding);
+            }
+
+            if (end < nodeEnd)
+            {
+                const uint32_t rest = NewNode();
+                m_Nodes[rest].offset = end;
+                m_Nodes[rest].size = nodeEnd - end;
+                LinkPhysical(rest, m_Nodes[index].nextPhysical);
+                LinkPhysical(index, rest);
+                InsertFree(rest);
+            }
+
+            m_Nodes[index].offset = offset;
+            m_Nodes[index].size = size;
+            m_Nodes[index].use = use;
+            m_AllocationCount++;
+            m_AllocatedBytes += size;
+        }
+
+        void InsertFree(uint32_t index)
+        {
+            uint32_t fl, sl;
+            Mapping(m_Nodes[index].size, fl, sl);
+
+            const uint32_t head = m_FreeHeads[fl][sl];
+            m_Nodes[index].prevFree = INVALID_NODE;
+            m_Nodes[index].nextFree = head;
+            if (head != INVALID_NODE)
+                m_Nodes[head].prevFree = index;
+            m_FreeHeads[fl][sl] = index;
+
+            m_SlBitmaps[fl] |= 1u << sl;
+            m_FlBitmap |= 1ull << fl;
+        }
+
+        void RemoveFree(uint32_t index)
+        {
+            uint32_t fl, sl;
+            Mapping(m_Nodes[index].size, fl, sl);
+
+            const Node& node = m_Nodes[index];
+            if (node.prevFree != INVALID_NODE)
+                m_Nodes[node.prevFree].nextFree = node.nextFree;
+            else
+                m_FreeHeads[fl][sl] = node.nextFree;
+            if (node.nextFree != INVALID_NODE)
+                m_Nodes[node.nextFree].prevFree = node.prevFree;
+
+            if (m_FreeHeads[fl][sl] == INVALID_NODE)
+            {
+                m_SlBitmaps[fl] &= ~(1u << sl);
+                if (m_SlBitmaps[fl] == 0)
+                    m_FlBitmap &= ~(1ull << fl);
+            }
+        }
+
+        void LinkPhysical(uint32_t prev, uint32_t next)
+        {
+            if (prev != INVALID_NODE)
+                m_Nodes[prev].nextPhysical = next;
+            if (next != INVALID_NODE)
+                m_Nodes[next].prevPhysical = prev;
+        }
+
+        uint32_t NewNode()
+        {
+            if (!m_UnusedNodes.empty())
+            {
+                const uint32_t index = m_UnusedNodes.back();
+                m_UnusedNodes.pop_back();
+                m_Nodes[index] = Node{};
+                return index;
+            }
+            m_Nodes.emplace_back();
+            return static_cast<uint32_t>(m_Nodes.size() - 1);
+        }
+
+        void ReleaseNode(uint32_t index) { m_UnusedNodes.push_back(index); }
+
+    private:
+        VkDeviceMemory m_Memory;
+        VkDeviceSize m_Size;
+        void* m_Mapped;
+
+        std::vector<Node> m_Nodes;
+        std::vector<uint32_t> m_UnusedNodes;
+        uint64_t m_FlBitmap = 0;
+        std::array<uint32_t, FL_COUNT> m_SlBitmaps{};
+        std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> m_FreeHeads;
+
+        uint32_t m_AllocationCount = 0;
+        VkDeviceSize m_AllocatedBytes = 0;
+    };
+
+    MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device)
+        : m_Device{ device }
+    {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_MemoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_BufferImageGranularity = properties.limits.bufferImageGranularity;
+        m_NonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+    }
+
+    MemoryAllocator::~MemoryAllocator()
+    {
+        for (uint32_t memoryType = 0; memoryType < m_MemoryProperties.memoryTypeCount; memoryType++)
+        {
+            for (const auto& block : m_Blocks[memoryType])
+            {
+                if (!block->IsEmpty())
+                {
+                    LOTUS_CORE_WARN("{0} device memory allocations of memory type {1} were not freed",
+                        block->GetAllocationCount(), memoryType);
+                }
+                if (block->GetMapped())
+                    vkUnmapMemory(m_Device, block->GetMemory());
+                vkFreeMemory(m_Device, block->GetMemory(), nullptr);
+            }
+
+            if (m_DedicatedCount[memoryType] > 0)
+            {
+                LOTUS_CORE_WARN("{0} dedicated device memory allocations of memory type {1} were not freed",
+                    m_DedicatedCount[memoryType], memoryType);
+            }
+        }
+    }
+
+    MemoryAllocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+
+        VkBufferMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        info.buffer = buffer;
+        vkGetBufferMemoryRequirements2(m_Device, &info, &requirements);
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        return Allocate(requirements.memoryRequirements, dedicated, properties, ResourceKind::Linear, buffer, VK_NULL_HANDLE);
+    }
+
+    MemoryAllocation MemoryAllocator::AllocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties)
+    {
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+        VkMemoryRequirements2 requirements{};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2 info{};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        info.image = image;
+        vkGetImageMemoryRequirements2(m_Device, &info, &requirements);
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        const ResourceKind kind = tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+        return Allocate(requirements.memoryRequirements, dedicated, properties, kind, VK_NULL_HANDLE, image);
+    }
+
+    void MemoryAllocator::Free(MemoryAllocation& allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (allocation.IsDedicated())
+        {
+            if (allocation.mapped)
+                vkUnmapMemory(m_Device, allocation.memory);
+            vkFreeMemory(m_Device, allocation.memory, nullptr);
+            m_DedicatedCount[allocation.memoryType]--;
+            m_DedicatedBytes[allocation.memoryType] -= allocation.size;
+        }
+        else
+        {
+            MemoryBlock* block = allocation.block;
+            block->Free(allocation.node);
+
+            // one empty block per memory type is kept around, so a staging buffer that is created
+            // and destroyed for every upload doesn't allocate a block each time
+            auto& blocks = m_Blocks[allocation.memoryType];
+            if (block->IsEmpty() && std::any_of(blocks.begin(), blocks.end(), [block](const auto& other)
+                { return other.get() != block && other->IsEmpty(); }))
+            {
+                if (block->GetMapped())
+                    vkUnmapMemory(m_Device, block->GetMemory());
+                vkFreeMemory(m_Device, block->GetMemory(), nullptr);
+                blocks.erase(std::find_if(blocks.begin(), blocks.end(), [block](const auto& other) { return other.get() == block; }));
+            }
+        }
+
+        allocation = {};
+    }
+
+    VkResult MemoryAllocator::Flush(const MemoryAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+    {
+        if (IsHostCoherent(allocation.memoryType))
+            return VK_SUCCESS;
+
+        const VkMappedMemoryRange range = GetMappedRange(allocation, size, offset);
+        return vkFlushMappedMemoryRanges(m_Device, 1, &range);
+    }
+
+    VkResult MemoryAllocator::Invalidate(const MemoryAllocation& allocation, VkDeviceSize size, VkDeviceSize offset)
+    {
+        if (IsHostCoherent(allocation.memoryType))
+            return VK_SUCCESS;
+
+        const VkMappedMemoryRange range = GetMappedRange(allocation, size, offset);
+        return vkInvalidateMappedMemoryRanges(m_Device, 1, &range);
+    }
+
+    std::vector<MemoryAllocator::HeapStats> MemoryAllocator::GetHeapStats() const
+    {
+        std::vector<HeapStats> stats(m_MemoryProperties.memoryHeapCount);
+        for (uint32_t heap = 0; heap < m_MemoryProperties.memoryHeapCount; heap++)
+        {
+            stats[heap].heapSize = m_MemoryProperties.memoryHeaps[heap].size;
+            stats[heap].flags = m_MemoryProperties.memoryHeaps[heap].flags;
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (uint32_t memoryType = 0; memoryType < m_MemoryProperties.memoryTypeCount; memoryType++)
+        {
+            HeapStats& heapStats = stats[m_MemoryProperties.memoryTypes[memoryType].heapIndex];
+            for (const auto& block : m_Blocks[memoryType])
+            {
+                heapStats.blockCount++;
+                heapStats.blockBytes += block->GetSize();
+                heapStats.allocationCount += block->GetAllocationCount();
+                heapStats.allocatedBytes += block->GetAllocatedBytes();
+            }
+            heapStats.dedicatedCount += m_DedicatedCount[memoryType];
+            heapStats.dedicatedBytes += m_DedicatedBytes[memoryType];
+        }
+        return stats;
+    }
+
+    void MemoryAllocator::LogStats() const
+    {
+        constexpr double MiB = 1024.0 * 1024.0;
+
+        const std::vector<HeapStats> stats = GetHeapStats();
+        for (uint32_t heap = 0; heap < stats.size(); heap++)
+        {
+            const HeapStats& heapStats = stats[heap];
+            LOTUS_CORE_INFO("Memory heap {0} ({1:.0f} MiB{2}): {3} allocations using {4:.1f} of {5:.1f} MiB in {6} blocks, {7} dedicated using {8:.1f} MiB",
+                heap, heapStats.heapSize / MiB, (heapStats.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? ", device local" : "",
+                heapStats.allocationCount, heapStats.allocatedBytes / MiB, heapStats.blockBytes / MiB, heapStats.blockCount,
+                heapStats.dedicatedCount, heapStats.dedicatedBytes / MiB);
+        }
+    }
+
+    MemoryAllocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, bool dedicated,
+        VkMemoryPropertyFlags properties, ResourceKind kind, VkBuffer buffer, VkImage image)
+    {
+        const uint32_t memoryType = FindMemoryType(requirements.memoryTypeBits, properties);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        // anything over half a block would mostly waste the rest of it
+        if (!dedicated && requirements.size <= GetBlockSize(memoryType) / 2)
+        {
+            // flushes are widened to whole atoms, which must not reach into a neighbour's range
+            VkDeviceSize alignment = requirements.alignment;
+            if (!IsHostCoherent(memoryType))
+                alignment = std::max(alignment, m_NonCoherentAtomSize);
+
+            MemoryAllocation allocation;
+            if (AllocateFromBlocks(memoryType, requirements.size, alignment, kind, allocation))
+                return allocation;
+        }
+
+        return AllocateDedicated(memoryType, requirements.size, buffer, image);
+    }
+
+    bool MemoryAllocator::AllocateFromBlocks(uint32_t memoryType, VkDeviceSize size, VkDeviceSize alignment,
+        ResourceKind kind, MemoryAllocation& allocation)
+    {
+        const MemoryBlock::Use use = kind == ResourceKind::Linear ? MemoryBlock::Use::Linear : MemoryBlock::Use::Optimal;
+        auto& blocks = m_Blocks[memoryType];
+
+        const auto allocateFrom = [&](MemoryBlock& block)
+        {
+            if (!block.Allocate(size, alignment, use, m_BufferImageGranularity, allocation.offset, allocation.node))
+                return false;
+
+            allocation.memory = block.GetMemory();
+            allocation.size = size;
+            allocation.memoryType = memoryType;
+            allocation.block = &block;
+            if (block.GetMapped())
+                allocation.mapped = static_cast<char*>(block.GetMapped()) + allocation.offset;
+            return true;
+        };
+
+        for (const auto& block : blocks)
+        {
+            if (allocateFrom(*block))
+                return true;
+        }
+
+        // a new block, smaller ones are tried when the heap is too full for a whole one
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        for (VkDeviceSize blockSize = GetBlockSize(memoryType); blockSize >= size * 2; blockSize /= 2)
+        {
+            allocInfo.allocationSize = blockSize;
+            if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory) == VK_SUCCESS)
+                break;
+            memory = VK_NULL_HANDLE;
+        }
+        if (memory == VK_NULL_HANDLE)
+            return false;
+
+        void* mapped = nullptr;
+        if (m_MemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            if (vkMapMemory(m_Device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+            {
+                vkFreeMemory(m_Device, memory, nullptr);
+                throw std::runtime_error("failed to map device memory block!");
+            }
+        }
+
+        blocks.push_back(std::make_unique<MemoryBlock>(memory, allocInfo.allocationSize, mapped));
+        return allocateFrom(*blocks.back());
+    }
+
+    MemoryAllocation MemoryAllocator::AllocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image)
+    {
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
+        dedicatedInfo.image = image;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = &dedicatedInfo;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        MemoryAllocation allocation;
+        if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+
+        if (m_MemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            if (vkMapMemory(m_Device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped) != VK_SUCCESS)
+            {
+                vkFreeMemory(m_Device, allocation.memory, nullptr);
+                throw std::runtime_error("failed to map device memory!");
+            }
+        }
+
+        allocation.size = size;
+        allocation.memoryType = memoryType;
+        m_DedicatedCount[memoryType]++;
+        m_DedicatedBytes[memoryType] += size;
+        return allocation;
+    }
+
+    uint32_t MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+    {
+        for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; i++)
+        {
+            if ((typeFilter & (1 << i)) &&
+                (m_MemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkDeviceSize MemoryAllocator::GetBlockSize(uint32_t memoryType) const
+    {
+        const VkDeviceSize heapSize = m_MemoryProperties.memoryHeaps[m_MemoryProperties.memoryTypes[memoryType].heapIndex].size;
+        return heapSize <= SMALL_HEAP_SIZE ? heapSize / 8 : LARGE_BLOCK_SIZE;
+    }
+
+    bool MemoryAllocator::IsHostCoherent(uint32_t memoryType) const
+    {
+        return (m_MemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    VkMappedMemoryRange MemoryAllocator::GetMappedRange(const MemoryAllocation& allocation, VkDeviceSize size, VkDeviceSize offset) const
+    {
+        assert(allocation.mapped && "memory is not host visible");
+
+        const VkDeviceSize memorySize = allocation.IsDedicated() ? allocation.size : allocation.block->GetSize();
+        const VkDeviceSize begin = (allocation.offset + offset) / m_NonCoherentAtomSize * m_NonCoherentAtomSize;
+        const VkDeviceSize end = AlignUp(size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : allocation.offset + offset + size,
+            m_NonCoherentAtomSize);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.memory;
+        range.offset = begin;
+        // the last atom may reach past the end of the memory, which only VK_WHOLE_SIZE allows
+        range.size = end >= memorySize ? VK_WHOLE_SIZE : end - begin;
+        return range;
+    }
+
+}
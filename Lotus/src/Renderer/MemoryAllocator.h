@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Lotus {
+
+	class MemoryBlock;
+
+	// A range of device memory handed out by the MemoryAllocator. Resources are bound at
+	// (memory, offset); memory is shared with other allocations unless the allocation is dedicated.
+	struct MemoryAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryType = UINT32_MAX;
+		// Host visible memory stays mapped for its whole lifetime, this points at offset
+		void* mapped = nullptr;
+
+		MemoryBlock* block = nullptr; // null for dedicated allocations
+		uint32_t node = 0;
+
+		bool IsValid() const { return memory != VK_NULL_HANDLE; }
+		bool IsDedicated() const { return block == nullptr; }
+	};
+
+	// Sub-allocates device memory so a resource doesn't cost a vkAllocateMemory call, which is slow
+	// and limited by maxMemoryAllocationCount. Large blocks are reserved per memory type and split
+	// with a two-level segregated fit (TLSF) allocator: free ranges are kept in lists bucketed by
+	// size, so finding and freeing a range is constant time regardless of how fragmented a block is.
+	//
+	// Buffers and optimally tiled images only share a bufferImageGranularity page when the device
+	// allows it. Resources that are large compared to a block, or that the driver would rather have
+	// on their own, get a dedicated allocation. Thread safe.
+	class MemoryAllocator
+	{
+	public:
+		struct HeapStats
+		{
+			VkDeviceSize heapSize = 0;
+			VkMemoryHeapFlags flags = 0;
+			uint32_t blockCount = 0;
+			VkDeviceSize blockBytes = 0;     // reserved in blocks, used or not
+			uint32_t allocationCount = 0;    // sub-allocations in blocks
+			VkDeviceSize allocatedBytes = 0; // used in blocks, alignment padding included
+			uint32_t dedicatedCount = 0;
+			VkDeviceSize dedicatedBytes = 0;
+		};
+
+		MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+		~MemoryAllocator();
+
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		// The memory is not bound, bind the resource at (allocation.memory, allocation.offset)
+		MemoryAllocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+		MemoryAllocation AllocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties);
+		// Resets the allocation, the resource bound to it must have been destroyed already
+		void Free(MemoryAllocation& allocation);
+
+		// Offset and size are relative to the allocation and are widened to nonCoherentAtomSize.
+		// Nothing is done for host coherent memory.
+		VkResult Flush(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+		VkResult Invalidate(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
+
+		// One entry per memory heap
+		std::vector<HeapStats> GetHeapStats() const;
+		void LogStats() const;
+
+	private:
+		enum class ResourceKind : uint8_t
+		{
+			Linear,  // buffers and linearly tiled images
+			Optimal  // optimally tiled images
+		};
+
+		MemoryAllocation Allocate(const VkMemoryRequirements& requirements, bool dedicated, VkMemoryPropertyFlags properties,
+			ResourceKind kind, VkBuffer buffer, VkImage image);
+		bool AllocateFromBlocks(uint32_t memoryType, VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind,
+			MemoryAllocation& allocation);
+		MemoryAllocation AllocateDedicated(uint32_t memoryType, VkDeviceSize size, VkBuffer buffer, VkImage image);
+		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		VkDeviceSize GetBlockSize(uint32_t memoryType) const;
+		bool IsHostCoherent(uint32_t memoryType) const;
+		VkMappedMemoryRange GetMappedRange(const MemoryAllocation& allocation, VkDeviceSize size, VkDeviceSize offset) const;
+
+	private:
+		VkDevice m_Device;
+		VkPhysicalDeviceMemoryProperties m_MemoryProperties{};
+		VkDeviceSize m_BufferImageGranularity = 1;
+		VkDeviceSize m_NonCoherentAtomSize = 1;
+
+		mutable std::mutex m_Mutex;
+		std::array<std::vector<std::unique_ptr<MemoryBlock>>, VK_MAX_MEMORY_TYPES> m_Blocks;
+		std::array<uint32_t, VK_MAX_MEMORY_TYPES> m_DedicatedCount{};
+		std::array<VkDeviceSize, VK_MAX_MEMORY_TYPES> m_DedicatedBytes{};
+	};
+
+}
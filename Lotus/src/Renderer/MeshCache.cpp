@@ -0,0 +1,181 @@
+#include "lotuspch.h"
+#include "MeshCache.h"
+#include "Utils/Utils.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace Lotus
+{
+    namespace
+    {
+        // vertex data is 16-byte aligned inside the file so the mapping can be read in place
+        constexpr uint64_t DATA_ALIGNMENT = 16;
+
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    std::string MeshCache::GetCachePath(const std::string& sourcePath, uint64_t settingsHash)
+    {
+        char settings[17];
+        std::snprintf(settings, sizeof(settings), "%016llx", static_cast<unsigned long long>(settingsHash));
+        return sourcePath + "." + settings + ".lmesh";
+    }
+
+    uint64_t MeshCache::HashSourceFile(const std::string& sourcePath)
+    {
+        MappedFile source;
+        if (!source.Open(sourcePath))
+            throw std::runtime_error("failed to open mesh source: " + sourcePath);
+        return HashBytes(source.GetData(), source.GetSize());
+    }
+
+    uint64_t MeshCache::GetLayoutHash()
+    {
+        // any change to the Vertex struct or the file format invalidates existing entries
+        const uint64_t layout[] = {
+            VERSION,
+            sizeof(Model::Vertex),
+            offsetof(Model::Vertex, position),
+            offsetof(Model::Vertex, color),
+            offsetof(Model::Vertex, normal),
+            offsetof(Model::Vertex, texCoord),
+            sizeof(Model::Lod),
+            sizeof(Model::Meshlet),
+            sizeof(Header)
+        };
+        return HashBytes(layout, sizeof(layout));
+    }
+
+    bool MeshCache::Load(const std::string& cachePath, uint64_t sourceHash, Entry& entry)
+    {
+        // only keep the mapping open on success, the entry may be rewritten right after a miss
+        MappedFile file;
+        if (!file.Open(cachePath))
+            return false;
+
+        const uint8_t* bytes = file.GetData();
+        const size_t size = file.GetSize();
+        if (size < sizeof(Header))
+            return false;
+
+        Header header;
+        std::memcpy(&header, bytes, sizeof(Header));
+        if (header.magic != MAGIC || header.version != VERSION || header.layoutHash != GetLayoutHash())
+        {
+            LOTUS_CORE_INFO("Mesh cache {0} is outdated, rebuilding", cachePath);
+            return false;
+        }
+        if (header.sourceHash != sourceHash)
+        {
+            LOTUS_CORE_INFO("Mesh cache {0} does not match its source, rebuilding", cachePath);
+            return false;
+        }
+
+        const uint64_t vertexBytes = static_cast<uint64_t>(header.vertexCount) * sizeof(Model::Vertex);
+        const uint64_t indexBytes = static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t);
+        const uint64_t lodBytes = static_cast<uint64_t>(header.lodCount) * sizeof(Model::Lod);
+        const uint64_t meshletBytes = static_cast<uint64_t>(header.meshletCount) * sizeof(Model::Meshlet);
+        if (header.vertexOffset % DATA_ALIGNMENT != 0 || header.vertexOffset + vertexBytes > size ||
+            header.indexOffset % sizeof(uint32_t) != 0 || header.indexOffset + indexBytes > size ||
+            header.lodOffset % alignof(Model::Lod) != 0 || header.lodOffset + lodBytes > size ||
+            header.meshletOffset % alignof(Model::Meshlet) != 0 || header.meshletOffset + meshletBytes > size)
+        {
+            LOTUS_CORE_WARN("Mesh cache {0} is truncated or corrupt, rebuilding", cachePath);
+            return false;
+        }
+
+        entry.data.vertices = reinterpret_cast<const Model::Vertex*>(bytes + header.vertexOffset);
+        entry.data.vertexCount = header.vertexCount;
+        entry.data.indices = reinterpret_cast<const uint32_t*>(bytes + header.indexOffset);
+        entry.data.indexCount = header.indexCount;
+        entry.data.bounds = header.bounds;
+        entry.data.lods = reinterpret_cast<const Model::Lod*>(bytes + header.lodOffset);
+        entry.data.lodCount = header.lodCount;
+        entry.data.meshlets = reinterpret_cast<const Model::Meshlet*>(bytes + header.meshletOffset);
+        entry.data.meshletCount = header.meshletCount;
+
+        bool rangesValid = true;
+        for (uint32_t i = 0; i < header.indexCount; i++)
+            rangesValid &= entry.data.indices[i] < header.vertexCount;
+        for (uint32_t i = 0; i < header.lodCount; i++)
+            rangesValid &= static_cast<uint64_t>(entry.data.lods[i].firstIndex) + entry.data.lods[i].indexCount <= header.indexCount;
+        for (uint32_t i = 0; i < header.meshletCount; i++)
+            rangesValid &= static_cast<uint64_t>(entry.data.meshlets[i].firstIndex) + entry.data.meshlets[i].indexCount <= header.indexCount;
+        if (!rangesValid)
+        {
+            LOTUS_CORE_WARN("Mesh cache {0} is truncated or corrupt, rebuilding", cachePath);
+            return false;
+        }
+        entry.file = std::move(file);
+        return true;
+    }
+
+    void MeshCache::Write(const std::string& cachePath, uint64_t sourceHash, const Model::MeshData& data)
+    {
+        Header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.layoutHash = GetLayoutHash();
+        header.sourceHash = sourceHash;
+        header.vertexCount = data.vertexCount;
+        header.indexCount = data.indexCount;
+        header.vertexOffset = AlignUp(sizeof(Header), DATA_ALIGNMENT);
+        header.indexOffset = AlignUp(header.vertexOffset + static_cast<uint64_t>(data.vertexCount) * sizeof(Model::Vertex), DATA_ALIGNMENT);
+        header.lodCount = data.lodCount;
+        header.lodOffset = AlignUp(header.indexOffset + static_cast<uint64_t>(data.indexCount) * sizeof(uint32_t), DATA_ALIGNMENT);
+        header.meshletCount = data.meshletCount;
+        header.meshletOffset = AlignUp(header.lodOffset + static_cast<uint64_t>(data.lodCount) * sizeof(Model::Lod), DATA_ALIGNMENT);
+        header.bounds = data.bounds;
+
+        // write to a temporary file and rename it, so a crash never leaves a half-written entry behind;
+        // the name is per thread because two imports of the same file and settings can still overlap
+        // when they do not go through the AssetManager
+        const std::string tempPath = cachePath + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+        bool written = false;
+        {
+            std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open())
+            {
+                LOTUS_CORE_WARN("Failed to write mesh cache {0}", cachePath);
+                return;
+            }
+
+            const char padding[DATA_ALIGNMENT] = {};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            file.write(padding, header.vertexOffset - sizeof(Header));
+            file.write(reinterpret_cast<const char*>(data.vertices), static_cast<std::streamsize>(data.vertexCount) * sizeof(Model::Vertex));
+            file.write(padding, header.indexOffset - header.vertexOffset - data.vertexCount * sizeof(Model::Vertex));
+            file.write(reinterpret_cast<const char*>(data.indices), static_cast<std::streamsize>(data.indexCount) * sizeof(uint32_t));
+            file.write(padding, header.lodOffset - header.indexOffset - data.indexCount * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(data.lods), static_cast<std::streamsize>(data.lodCount) * sizeof(Model::Lod));
+            file.write(padding, header.meshletOffset - header.lodOffset - data.lodCount * sizeof(Model::Lod));
+            file.write(reinterpret_cast<const char*>(data.meshlets), static_cast<std::streamsize>(data.meshletCount) * sizeof(Model::Meshlet));
+
+            file.close();
+            written = file.good();
+        }
+
+        // the stream is closed first, so the partial file can be removed on every platform
+        std::error_code error;
+        if (!written)
+        {
+            LOTUS_CORE_WARN("Failed to write mesh cache {0}", cachePath);
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+
+        std::filesystem::rename(tempPath, cachePath, error);
+        if (error)
+        {
+            LOTUS_CORE_WARN("Failed to write mesh cache {0}: {1}", cachePath, error.message());
+            std::filesystem::remove(tempPath, error);
+        }
+    }
+}
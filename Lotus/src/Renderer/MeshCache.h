@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Model.h"
+#include "Utils/MappedFile.h"
+
+namespace Lotus {
+
+	// Binary cache (.lmesh) of imported meshes. Holds the already deduplicated vertex and index
+	// arrays plus the LOD and meshlet tables so later runs can memory-map them and copy them straight into the staging buffers.
+	//
+	// An entry is only used when its header matches the current format version, the current
+	// Model::Vertex layout and the hash of the source file contents and import settings;
+	// anything else is rebuilt. Loading also checks every index and LOD or meshlet range against
+	// the arrays they refer to, so a corrupt entry is rebuilt instead of read out of bounds.
+	class MeshCache
+	{
+	public:
+		static constexpr uint32_t MAGIC = 0x48534D4C; // "LMSH"
+		static constexpr uint32_t VERSION = 3;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t layoutHash;
+			uint64_t sourceHash;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint64_t vertexOffset;
+			uint64_t indexOffset;
+			uint32_t lodCount;
+			uint64_t lodOffset;
+			uint32_t meshletCount;
+			uint64_t meshletOffset;
+			Model::Bounds bounds;
+		};
+
+		// A loaded entry; data points into the mapped file and is valid while the entry lives
+		struct Entry
+		{
+			MappedFile file;
+			Model::MeshData data{};
+		};
+
+		// <source>.<settings hash>.lmesh, so every set of import settings gets its own entry
+		static std::string GetCachePath(const std::string& sourcePath, uint64_t settingsHash);
+		static uint64_t HashSourceFile(const std::string& sourcePath);
+
+		static bool Load(const std::string& cachePath, uint64_t sourceHash, Entry& entry);
+		static void Write(const std::string& cachePath, uint64_t sourceHash, const Model::MeshData& data);
+
+	private:
+		static uint64_t GetLayoutHash();
+	};
+
+}
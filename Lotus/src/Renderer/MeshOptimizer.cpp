@@ -0,0 +1,292 @@
+#include "lotuspch.h"
+#include "MeshOptimizer.h"
+
+namespace Lotus
+{
+    namespace
+    {
+        // FIFO cache simulation; returns the number of misses for one triangle
+        uint32_t UpdateCache(const uint32_t* triangle, uint32_t cacheSize, std::vector<uint32_t>& timestamps, uint32_t& timestamp)
+        {
+            uint32_t misses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t vertex = triangle[k];
+                if (timestamp - timestamps[vertex] > cacheSize)
+                {
+                    timestamps[vertex] = timestamp++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        struct Adjacency
+        {
+            std::vector<uint32_t> offsets;   // first entry of every vertex in triangles
+            std::vector<uint32_t> triangles; // triangles using each vertex, grouped per vertex
+            std::vector<uint32_t> liveCount; // not yet emitted triangles per vertex
+        };
+
+        void BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount, Adjacency& adjacency)
+        {
+            adjacency.liveCount.assign(vertexCount, 0);
+            for (const uint32_t index : indices)
+                adjacency.liveCount[index]++;
+
+            adjacency.offsets.resize(vertexCount + 1);
+            uint32_t offset = 0;
+            for (size_t v = 0; v < vertexCount; v++)
+            {
+                adjacency.offsets[v] = offset;
+                offset += adjacency.liveCount[v];
+            }
+            adjacency.offsets[vertexCount] = offset;
+
+            adjacency.triangles.resize(indices.size());
+            std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    MeshOptimizer::CacheStatistics MeshOptimizer::AnalyzeVertexCache(
+        const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+    {
+        CacheStatistics statistics{};
+        if (indexCount < 3 || vertexCount == 0)
+            return statistics;
+
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t timestamp = cacheSize + 1;
+        size_t misses = 0;
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+            misses += UpdateCache(indices + i, cacheSize, timestamps, timestamp);
+
+        statistics.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+        statistics.atvr = static_cast<float>(misses) / static_cast<float>(vertexCount);
+        return statistics;
+    }
+
+    std::vector<uint32_t> MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        std::vector<uint32_t> hardClusters;
+        if (triangleCount == 0)
+            return hardClusters;
+
+        Adjacency adjacency;
+        BuildAdjacency(indices, vertexCount, adjacency);
+
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        std::vector<uint32_t> deadEnds;
+        std::vector<uint32_t> candidates;
+        std::vector<bool> emitted(triangleCount, false);
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+
+        uint32_t timestamp = cacheSize + 1;
+        uint32_t cursor = 0; // next vertex to try when the dead-end stack runs dry
+        int64_t fanningVertex = 0;
+        bool clusterStart = true;
+
+        while (fanningVertex >= 0)
+        {
+            candidates.clear();
+
+            // emit every remaining triangle around the fanning vertex
+            const uint32_t v = static_cast<uint32_t>(fanningVertex);
+            for (uint32_t i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; i++)
+            {
+                const uint32_t triangle = adjacency.triangles[i];
+                if (emitted[triangle])
+                    continue;
+
+                if (clusterStart)
+                {
+                    hardClusters.push_back(static_cast<uint32_t>(result.size() / 3));
+                    clusterStart = false;
+                }
+
+                for (int k = 0; k < 3; k++)
+                {
+                    const uint32_t vertex = indices[triangle * 3 + k];
+                    result.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    adjacency.liveCount[vertex]--;
+                    if (timestamp - timestamps[vertex] > cacheSize)
+                        timestamps[vertex] = timestamp++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // pick the candidate that is most likely still in the cache once its fan is emitted
+            int64_t next = -1;
+            int64_t bestPriority = -1;
+            for (const uint32_t candidate : candidates)
+            {
+                if (adjacency.liveCount[candidate] == 0)
+                    continue;
+
+                int64_t priority = 0;
+                if (timestamp - timestamps[candidate] + 2 * adjacency.liveCount[candidate] <= cacheSize)
+                    priority = timestamp - timestamps[candidate];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    next = candidate;
+                }
+            }
+
+            if (next < 0)
+            {
+                // dead end: fall back to recently used vertices, then to any vertex with live triangles
+                while (!deadEnds.empty() && next < 0)
+                {
+                    const uint32_t vertex = deadEnds.back();
+                    deadEnds.pop_back();
+                    if (adjacency.liveCount[vertex] > 0)
+                        next = vertex;
+                }
+
+                while (next < 0 && cursor < vertexCount)
+                {
+                    if (adjacency.liveCount[cursor] > 0)
+                    {
+                        next = cursor;
+                        // jumping to an unrelated vertex starts a new disjoint patch of the mesh
+                        clusterStart = true;
+                    }
+                    cursor++;
+                }
+            }
+
+            fanningVertex = next;
+        }
+
+        indices.swap(result);
+        return hardClusters;
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(
+        std::vector<uint32_t>& indices, const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& hardClusters,
+        float threshold, uint32_t cacheSize)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || hardClusters.empty())
+            return;
+
+        // split the hard clusters further wherever the running ACMR drops below threshold * total ACMR
+        std::vector<uint32_t> timestamps(vertices.size(), 0);
+        uint32_t timestamp = cacheSize + 1;
+        std::vector<uint32_t> clusters;
+        for (size_t c = 0; c < hardClusters.size(); c++)
+        {
+            const uint32_t begin = hardClusters[c];
+            const uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+            timestamp += cacheSize + 1; // flush
+            size_t misses = 0;
+            for (uint32_t t = begin; t < end; t++)
+                misses += UpdateCache(&indices[t * 3], cacheSize, timestamps, timestamp);
+            const float clusterAcmr = static_cast<float>(misses) / static_cast<float>(end - begin);
+
+            clusters.push_back(begin);
+            timestamp += cacheSize + 1; // flush
+            misses = 0;
+            uint32_t start = begin;
+            for (uint32_t t = begin; t < end; t++)
+            {
+                misses += UpdateCache(&indices[t * 3], cacheSize, timestamps, timestamp);
+                const float runningAcmr = static_cast<float>(misses) / static_cast<float>(t - start + 1);
+                if (t + 1 < end && runningAcmr <= clusterAcmr * threshold && t + 1 - start >= 8)
+                {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    timestamp += cacheSize + 1; // a new cluster can't rely on its predecessor's cache
+                }
+            }
+        }
+
+        // view-independent sort: clusters facing away from the mesh center are likely to occlude the rest
+        glm::vec3 meshCentroid{ 0.f };
+        for (const auto& vertex : vertices)
+            meshCentroid += vertex.position;
+        meshCentroid /= static_cast<float>(vertices.size());
+
+        struct ClusterOrder
+        {
+            uint32_t begin;
+            uint32_t end;
+            float sortKey;
+        };
+
+        std::vector<ClusterOrder> order;
+        order.reserve(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            const uint32_t begin = clusters[c];
+            const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+            glm::vec3 centroid{ 0.f };
+            glm::vec3 normal{ 0.f };
+            float area = 0.f;
+            for (uint32_t t = begin; t < end; t++)
+            {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+                const glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+                const float triangleArea = glm::length(n);
+
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+                normal += n;
+                area += triangleArea;
+            }
+
+            float sortKey = 0.f;
+            if (area > 0.f)
+            {
+                centroid /= area;
+                const float normalLength = glm::length(normal);
+                if (normalLength > 0.f)
+                    sortKey = glm::dot(centroid - meshCentroid, normal / normalLength);
+            }
+            order.push_back({ begin, end, sortKey });
+        }
+
+        std::stable_sort(order.begin(), order.end(),
+            [](const ClusterOrder& a, const ClusterOrder& b) { return a.sortKey > b.sortKey; });
+
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (const ClusterOrder& cluster : order)
+            result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+
+        indices.swap(result);
+    }
+
+    void MeshOptimizer::OptimizeVertexFetch(std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        constexpr uint32_t unused = 0xFFFFFFFF;
+        std::vector<uint32_t> remap(vertices.size(), unused);
+        std::vector<Model::Vertex> result;
+        result.reserve(vertices.size());
+
+        for (uint32_t& index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = static_cast<uint32_t>(result.size());
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+
+        // vertices no longer referenced by any triangle are dropped
+        vertices.swap(result);
+    }
+}
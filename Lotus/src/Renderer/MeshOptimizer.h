@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Model.h"
+
+namespace Lotus {
+
+	// Triangle and vertex reordering passes run on imported meshes, following Sander, Nehab and
+	// Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007):
+	//  1. Tipsify orders triangles for the post-transform vertex cache
+	//  2. the result is split into clusters which are sorted front-to-back in a view-independent
+	//     way, so early-Z rejects more fragments
+	//  3. vertices are remapped into the order the index buffer fetches them
+	class MeshOptimizer
+	{
+	public:
+		static constexpr uint32_t DEFAULT_CACHE_SIZE = 16;
+
+		struct CacheStatistics
+		{
+			float acmr = 0.0f; // average cache miss ratio: transformed vertices per triangle (0.5 - 3)
+			float atvr = 0.0f; // average transform to vertex ratio: transformed vertices per vertex (>= 1)
+		};
+
+		static CacheStatistics AnalyzeVertexCache(
+			const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+		// Returns the start triangle of every cluster the order can be cut into without hurting the cache
+		static std::vector<uint32_t> OptimizeVertexCache(
+			std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+		// threshold is the ACMR increase (e.g. 1.05 = 5%) accepted to get smaller clusters
+		static void OptimizeOverdraw(
+			std::vector<uint32_t>& indices, const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& hardClusters,
+			float threshold = 1.05f, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+		static void OptimizeVertexFetch(std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices);
+	};
+
+}
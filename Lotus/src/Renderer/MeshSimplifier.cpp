@@ -0,0 +1,372 @@
+#include "lotuspch.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Lotus
+{
+    namespace
+    {
+        // border edges are weighted up so silhouettes of open meshes survive
+        constexpr float BORDER_WEIGHT = 10.0f;
+
+        enum class VertexKind : uint8_t
+        {
+            Manifold, // collapses onto any neighbour
+            Border,   // on an open edge, only slides along it
+            Seam,     // one of two wedges of an attribute seam, only slides along the seam
+            Locked    // never collapses
+        };
+
+        // Symmetric 4x4 plane quadric, evaluates to the weighted sum of squared plane distances
+        struct Quadric
+        {
+            float a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+            float ab = 0, ac = 0, ad = 0;
+            float bc = 0, bd = 0, cd = 0;
+            float weight = 0;
+
+            void AddPlane(const glm::vec3& normal, float distance, float planeWeight)
+            {
+                const float a = normal.x, b = normal.y, c = normal.z, d = distance;
+                a2 += a * a * planeWeight; b2 += b * b * planeWeight; c2 += c * c * planeWeight; d2 += d * d * planeWeight;
+                ab += a * b * planeWeight; ac += a * c * planeWeight; ad += a * d * planeWeight;
+                bc += b * c * planeWeight; bd += b * d * planeWeight; cd += c * d * planeWeight;
+                weight += planeWeight;
+            }
+
+            void Add(const Quadric& other)
+            {
+                a2 += other.a2; b2 += other.b2; c2 += other.c2; d2 += other.d2;
+                ab += other.ab; ac += other.ac; ad += other.ad;
+                bc += other.bc; bd += other.bd; cd += other.cd;
+                weight += other.weight;
+            }
+
+            // mean squared distance of p to the accumulated planes
+            float Evaluate(const glm::vec3& p) const
+            {
+                const float x = p.x, y = p.y, z = p.z;
+                const float sum =
+                    a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+                    2.0f * (ab * x * y + ac * x * z + bc * y * z) +
+                    2.0f * (ad * x + bd * y + cd * z);
+                return weight > 0.0f ? std::max(sum, 0.0f) / weight : 0.0f;
+            }
+        };
+
+        // Compressed adjacency lists, one list of neighbours per key
+        struct Adjacency
+        {
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> items;
+
+            template <typename Fn>
+            void Build(size_t keyCount, size_t itemCount, const Fn& forEachPair)
+            {
+                offsets.assign(keyCount + 1, 0);
+                forEachPair([&](uint32_t key, uint32_t) { offsets[key + 1]++; });
+                for (size_t i = 0; i < keyCount; i++)
+                    offsets[i + 1] += offsets[i];
+
+                items.resize(itemCount);
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                forEachPair([&](uint32_t key, uint32_t item) { items[fill[key]++] = item; });
+            }
+
+            bool Contains(uint32_t key, uint32_t item) const
+            {
+                for (uint32_t i = offsets[key]; i < offsets[key + 1]; i++)
+                {
+                    if (items[i] == item)
+                        return true;
+                }
+                return false;
+            }
+        };
+
+        struct Collapse
+        {
+            uint32_t source;
+            uint32_t target;
+            float cost;
+        };
+    }
+
+    float MeshSimplifier::Simplify(const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& indices,
+        size_t targetIndexCount, float maxError, std::vector<uint32_t>& result)
+    {
+        result = indices;
+        const size_t vertexCount = vertices.size();
+        if (indices.size() <= targetIndexCount || vertexCount == 0)
+            return 0.0f;
+
+        // vertices with bitwise equal positions are wedges of one position; wedge[] links them in a ring
+        std::vector<uint32_t> position(vertexCount);
+        std::vector<uint32_t> wedge(vertexCount);
+        std::vector<uint32_t> wedgeCount(vertexCount, 0);
+        {
+            std::vector<uint32_t> order(vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++)
+                order[i] = i;
+
+            const auto less = [&](uint32_t a, uint32_t b)
+            {
+                const glm::vec3& pa = vertices[a].position;
+                const glm::vec3& pb = vertices[b].position;
+                if (pa.x != pb.x) return pa.x < pb.x;
+                if (pa.y != pb.y) return pa.y < pb.y;
+                if (pa.z != pb.z) return pa.z < pb.z;
+                return a < b;
+            };
+            std::sort(order.begin(), order.end(), less);
+
+            for (size_t begin = 0; begin < vertexCount;)
+            {
+                size_t end = begin + 1;
+                while (end < vertexCount && vertices[order[end]].position == vertices[order[begin]].position)
+                    end++;
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    position[order[i]] = order[begin];
+                    wedge[order[i]] = order[i + 1 < end ? i + 1 : begin];
+                }
+                wedgeCount[order[begin]] = static_cast<uint32_t>(end - begin);
+                begin = end;
+            }
+        }
+
+        const size_t triangleCount = indices.size() / 3;
+        const auto forEachHalfEdge = [&](const auto& fn)
+        {
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                for (int k = 0; k < 3; k++)
+                    fn(indices[t * 3 + k], indices[t * 3 + (k + 1) % 3]);
+            }
+        };
+
+        Adjacency vertexEdges;
+        vertexEdges.Build(vertexCount, indices.size(), forEachHalfEdge);
+
+        Adjacency positionEdges;
+        positionEdges.Build(vertexCount, indices.size(), [&](const auto& fn)
+        {
+            forEachHalfEdge([&](uint32_t a, uint32_t b) { fn(position[a], position[b]); });
+        });
+
+        // an edge without its opposite half-edge is on an open border
+        std::vector<bool> border(vertexCount, false);
+        forEachHalfEdge([&](uint32_t a, uint32_t b)
+        {
+            if (!positionEdges.Contains(position[b], position[a]))
+                border[position[a]] = border[position[b]] = true;
+        });
+
+        std::vector<VertexKind> kind(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            const uint32_t p = position[v];
+            const uint32_t wedges = wedgeCount[p];
+            if (wedges > 2 || (wedges == 2 && border[p]))
+                kind[v] = VertexKind::Locked;
+            else if (wedges == 2)
+                kind[v] = VertexKind::Seam;
+            else if (border[p])
+                kind[v] = VertexKind::Border;
+            else
+                kind[v] = VertexKind::Manifold;
+        }
+
+        // flat shaded and hard-edged meshes are all seams: nothing can collapse, don't build the quadrics
+        if (std::all_of(kind.begin(), kind.end(), [](VertexKind k) { return k == VertexKind::Locked; }))
+            return 0.0f;
+
+        // quadrics live on positions so all wedges share one error
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const uint32_t i0 = indices[t * 3 + 0], i1 = indices[t * 3 + 1], i2 = indices[t * 3 + 2];
+            const glm::vec3& p0 = vertices[i0].position;
+            const glm::vec3& p1 = vertices[i1].position;
+            const glm::vec3& p2 = vertices[i2].position;
+
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float doubleArea = glm::length(normal);
+            if (doubleArea == 0.0f)
+                continue;
+            normal /= doubleArea;
+
+            Quadric quadric{};
+            quadric.AddPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5f);
+            quadrics[position[i0]].Add(quadric);
+            quadrics[position[i1]].Add(quadric);
+            quadrics[position[i2]].Add(quadric);
+
+            // planes perpendicular to border edges keep open boundaries in place
+            const uint32_t corners[3] = { i0, i1, i2 };
+            for (int k = 0; k < 3; k++)
+            {
+                const uint32_t a = corners[k], b = corners[(k + 1) % 3];
+                if (positionEdges.Contains(position[b], position[a]))
+                    continue;
+
+                const glm::vec3 edge = vertices[b].position - vertices[a].position;
+                const float edgeLength = glm::length(edge);
+                if (edgeLength == 0.0f)
+                    continue;
+
+                const glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                Quadric edgeQuadric{};
+                edgeQuadric.AddPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a].position), edgeLength * edgeLength * BORDER_WEIGHT);
+                quadrics[position[a]].Add(edgeQuadric);
+                quadrics[position[b]].Add(edgeQuadric);
+            }
+        }
+
+        const auto hasEdge = [&](uint32_t a, uint32_t b) { return vertexEdges.Contains(a, b) || vertexEdges.Contains(b, a); };
+
+        const auto canCollapse = [&](uint32_t source, uint32_t target)
+        {
+            if (position[source] == position[target])
+                return false;
+
+            switch (kind[source])
+            {
+            case VertexKind::Manifold:
+                return true;
+            case VertexKind::Border:
+                return (kind[target] == VertexKind::Border || kind[target] == VertexKind::Locked) &&
+                    (!positionEdges.Contains(position[target], position[source]) || !positionEdges.Contains(position[source], position[target]));
+            case VertexKind::Seam:
+                // the other wedge has to follow along the matching edge on the other side of the seam
+                return kind[target] == VertexKind::Seam && hasEdge(wedge[source], wedge[target]);
+            default:
+                return false;
+            }
+        };
+
+        const float maxCost = maxError * maxError;
+        float resultCost = 0.0f;
+
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<bool> locked(vertexCount);
+        std::vector<Collapse> collapses;
+        Adjacency triangles;
+
+        while (result.size() > targetIndexCount)
+        {
+            const size_t currentTriangleCount = result.size() / 3;
+            triangles.Build(vertexCount, result.size(), [&](const auto& fn)
+            {
+                for (size_t t = 0; t < currentTriangleCount; t++)
+                {
+                    for (int k = 0; k < 3; k++)
+                        fn(position[result[t * 3 + k]], static_cast<uint32_t>(t));
+                }
+            });
+
+            collapses.clear();
+            for (size_t t = 0; t < currentTriangleCount; t++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    const uint32_t a = result[t * 3 + k], b = result[t * 3 + (k + 1) % 3];
+                    for (const auto& [source, target] : { std::make_pair(a, b), std::make_pair(b, a) })
+                    {
+                        if (!canCollapse(source, target))
+                            continue;
+
+                        Quadric quadric = quadrics[position[source]];
+                        quadric.Add(quadrics[position[target]]);
+                        const float cost = quadric.Evaluate(vertices[target].position);
+                        if (cost <= maxCost)
+                            collapses.push_back({ source, target, cost });
+                    }
+                }
+            }
+            if (collapses.empty())
+                break;
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+            for (uint32_t v = 0; v < vertexCount; v++)
+                remap[v] = v;
+            std::fill(locked.begin(), locked.end(), false);
+
+            // a manifold collapse removes about two triangles
+            const size_t collapseBudget = std::max<size_t>((result.size() - targetIndexCount) / 6, 1);
+            size_t collapseCount = 0;
+            for (const Collapse& collapse : collapses)
+            {
+                if (collapseCount >= collapseBudget)
+                    break;
+
+                const uint32_t sourcePosition = position[collapse.source];
+                const uint32_t targetPosition = position[collapse.target];
+                if (locked[sourcePosition] || locked[targetPosition])
+                    continue;
+
+                // reject collapses that flip or badly rotate any remaining triangle around the source
+                bool flips = false;
+                const glm::vec3& newPosition = vertices[collapse.target].position;
+                for (uint32_t i = triangles.offsets[sourcePosition]; i < triangles.offsets[sourcePosition + 1] && !flips; i++)
+                {
+                    const uint32_t* triangle = &result[triangles.items[i] * 3];
+                    glm::vec3 corners[3];
+                    bool removed = false;
+                    for (int k = 0; k < 3; k++)
+                    {
+                        corners[k] = vertices[triangle[k]].position;
+                        removed |= position[triangle[k]] == targetPosition;
+                    }
+                    if (removed)
+                        continue;
+
+                    const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (position[triangle[k]] == sourcePosition)
+                            corners[k] = newPosition;
+                    }
+                    const glm::vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+                }
+                if (flips)
+                    continue;
+
+                remap[collapse.source] = collapse.target;
+                if (kind[collapse.source] == VertexKind::Seam)
+                    remap[wedge[collapse.source]] = wedge[collapse.target];
+                quadrics[targetPosition].Add(quadrics[sourcePosition]);
+                resultCost = std::max(resultCost, collapse.cost);
+                collapseCount++;
+
+                // the one-ring of the source changed shape, its flip checks would be stale this pass
+                for (uint32_t i = triangles.offsets[sourcePosition]; i < triangles.offsets[sourcePosition + 1]; i++)
+                {
+                    for (int k = 0; k < 3; k++)
+                        locked[position[result[triangles.items[i] * 3 + k]]] = true;
+                }
+            }
+            if (collapseCount == 0)
+                break;
+
+            size_t write = 0;
+            for (size_t t = 0; t < currentTriangleCount; t++)
+            {
+                const uint32_t i0 = remap[result[t * 3 + 0]], i1 = remap[result[t * 3 + 1]], i2 = remap[result[t * 3 + 2]];
+                if (position[i0] == position[i1] || position[i1] == position[i2] || position[i2] == position[i0])
+                    continue;
+                result[write++] = i0;
+                result[write++] = i1;
+                result[write++] = i2;
+            }
+            result.resize(write);
+        }
+
+        return std::sqrt(resultCost);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Model.h"
+
+namespace Lotus {
+
+	// Quadric error metric edge-collapse simplification (Garland and Heckbert 1997) used to build
+	// LOD chains. Vertices are never moved or created: every collapse snaps one vertex onto a
+	// neighbour, so all LODs index the same vertex buffer.
+	//
+	// Attribute seams (several vertices sharing a position) are only collapsed along the seam, with
+	// all wedges moving together, and open borders only slide along themselves; vertices where
+	// neither is possible are locked.
+	//
+	// Limitation: a position with more than two wedges (a corner of a hard edge, or any vertex of a
+	// flat shaded mesh such as cube.obj or flat_vase.obj) is locked, so meshes made of such vertices
+	// come back unsimplified. Callers must check the result got meaningfully smaller; GenerateLods
+	// drops such levels, and these meshes only get LOD 0.
+	class MeshSimplifier
+	{
+	public:
+		// Writes a simplified copy of indices with at most targetIndexCount indices, or as close as
+		// collapses with an error below maxError allow; a copy of indices when nothing can collapse.
+		// Returns the error of the result as a model-space distance.
+		static float Simplify(const std::vector<Model::Vertex>& vertices, const std::vector<uint32_t>& indices,
+			size_t targetIndexCount, float maxError, std::vector<uint32_t>& result);
+	};
+
+}
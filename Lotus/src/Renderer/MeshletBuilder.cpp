@@ -0,0 +1,113 @@
+#include "lotuspch.h"
+#include "MeshletBuilder.h"
+
+#include <cmath>
+
+namespace Lotus
+{
+    void MeshletBuilder::Build(const std::vector<Model::Vertex>& vertices, const uint32_t* indices, size_t indexCount,
+        std::vector<Model::Meshlet>& meshlets)
+    {
+        meshlets.clear();
+        if (indexCount == 0)
+            return;
+
+        // the meshlet that last referenced each vertex, so membership is a single compare
+        constexpr uint32_t none = 0xFFFFFFFF;
+        std::vector<uint32_t> owner(vertices.size(), none);
+
+        Model::Meshlet current{};
+        uint32_t vertexCount = 0;
+        uint32_t id = 0;
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const uint32_t a = indices[i + 0], b = indices[i + 1], c = indices[i + 2];
+            const uint32_t newVertices =
+                (owner[a] != id ? 1 : 0) +
+                (owner[b] != id && b != a ? 1 : 0) +
+                (owner[c] != id && c != a && c != b ? 1 : 0);
+
+            if (vertexCount + newVertices > MAX_VERTICES || current.indexCount / 3 + 1 > MAX_TRIANGLES)
+            {
+                ComputeBounds(vertices, indices, current);
+                meshlets.push_back(current);
+
+                current = {};
+                current.firstIndex = static_cast<uint32_t>(i);
+                vertexCount = 0;
+                id++;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                if (owner[indices[i + k]] != id)
+                {
+                    owner[indices[i + k]] = id;
+                    vertexCount++;
+                }
+            }
+            current.indexCount += 3;
+        }
+
+        ComputeBounds(vertices, indices, current);
+        meshlets.push_back(current);
+    }
+
+    void MeshletBuilder::ComputeBounds(const std::vector<Model::Vertex>& vertices, const uint32_t* indices, Model::Meshlet& meshlet)
+    {
+        const uint32_t* begin = indices + meshlet.firstIndex;
+        const uint32_t* end = begin + meshlet.indexCount;
+
+        // sphere around the box center; a little looser than a minimal sphere but cheap and stable
+        glm::vec3 min = vertices[*begin].position;
+        glm::vec3 max = min;
+        for (const uint32_t* index = begin; index != end; index++)
+        {
+            min = glm::min(min, vertices[*index].position);
+            max = glm::max(max, vertices[*index].position);
+        }
+        meshlet.center = (min + max) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (const uint32_t* index = begin; index != end; index++)
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[*index].position - meshlet.center));
+
+        // normal cone: average face normal and the widest angle any face makes with it
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.indexCount / 3);
+        glm::vec3 axis{ 0.0f };
+        for (const uint32_t* triangle = begin; triangle != end; triangle += 3)
+        {
+            const glm::vec3& p0 = vertices[triangle[0]].position;
+            const glm::vec3& p1 = vertices[triangle[1]].position;
+            const glm::vec3& p2 = vertices[triangle[2]].position;
+            const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            const float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+
+        // a cutoff of 1 never culls
+        meshlet.coneAxis = glm::vec3{ 0.0f, 0.0f, 1.0f };
+        meshlet.coneCutoff = 1.0f;
+
+        const float axisLength = glm::length(axis);
+        if (normals.empty() || axisLength < 1e-6f)
+            return;
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (const glm::vec3& normal : normals)
+            minDot = std::min(minDot, glm::dot(axis, normal));
+
+        // faces spread over more than a hemisphere, some of them always face the camera
+        if (minDot <= 0.0f)
+            return;
+
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot); // sin of the cone half-angle
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Model.h"
+
+namespace Lotus {
+
+	// Splits an index buffer into meshlets: runs of consecutive triangles that reference at most
+	// MAX_VERTICES unique vertices and hold at most MAX_TRIANGLES triangles (the usual mesh shader
+	// limits). Triangles are taken in buffer order, so the vertex cache and overdraw ordering of the
+	// mesh is kept and every meshlet is a plain index range.
+	//
+	// Each meshlet gets a bounding sphere and a normal cone so whole clusters can be culled when
+	// they are outside the frustum or all of their triangles face away from the camera.
+	class MeshletBuilder
+	{
+	public:
+		static constexpr uint32_t MAX_VERTICES = 64;
+		static constexpr uint32_t MAX_TRIANGLES = 124;
+
+		static void Build(const std::vector<Model::Vertex>& vertices, const uint32_t* indices, size_t indexCount,
+			std::vector<Model::Meshlet>& meshlets);
+
+	private:
+		static void ComputeBounds(const std::vector<Model::Vertex>& vertices, const uint32_t* indices, Model::Meshlet& meshlet);
+	};
+
+}
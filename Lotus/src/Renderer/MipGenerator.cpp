@@ -0,0 +1,269 @@
+#include "lotuspch.h"
+#include "MipGenerator.h"
+#include "Utils/ThreadPool.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define LOTUS_MIPS_SSE2 1
+	#include <emmintrin.h>
+#endif
+
+namespace Lotus {
+
+    namespace {
+
+        // rows per ParallelFor job, small levels are done on the calling thread
+        constexpr uint32_t ROWS_PER_JOB = 32;
+
+        struct ConversionTables
+        {
+            float toLinear[256];
+            // indexed by linear * 65535, fine enough that every sRGB step near black is reachable
+            uint8_t toSrgb[65536];
+
+            ConversionTables()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    const float c = i / 255.0f;
+                    toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                }
+                for (uint32_t i = 0; i < 65536; i++)
+                {
+                    const float l = i / 65535.0f;
+                    const float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                    toSrgb[i] = static_cast<uint8_t>(std::min(255.0f, c * 255.0f + 0.5f));
+                }
+            }
+        };
+
+        const ConversionTables& GetTables()
+        {
+            static const ConversionTables tables;
+            return tables;
+        }
+
+        // ParallelFor over row blocks when the level is big enough to be worth it
+        void ForEachRowBlock(uint32_t rows, const std::function<void(uint32_t, uint32_t)>& fn)
+        {
+            const uint32_t blocks = (rows + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+            if (blocks <= 1)
+            {
+                fn(0, rows);
+                return;
+            }
+
+            ThreadPool::Get().ParallelFor(blocks, [&](uint32_t block)
+            {
+                const uint32_t first = block * ROWS_PER_JOB;
+                fn(first, std::min(rows, first + ROWS_PER_JOB));
+            });
+        }
+
+        void Decode(const uint8_t* src, float* dst, size_t firstTexel, size_t lastTexel, bool srgb)
+        {
+            const ConversionTables& tables = GetTables();
+            for (size_t i = firstTexel; i < lastTexel; i++)
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                    dst[i * 4 + c] = srgb ? tables.toLinear[src[i * 4 + c]] : src[i * 4 + c] / 255.0f;
+                dst[i * 4 + 3] = src[i * 4 + 3] / 255.0f;
+            }
+        }
+
+        // 2x2 box filter of src into dst; odd edges reuse the last row / column
+        void Downsample(const float* src, uint32_t srcWidth, uint32_t srcHeight,
+            float* dst, uint32_t dstWidth, uint32_t firstRow, uint32_t lastRow)
+        {
+            for (uint32_t y = firstRow; y < lastRow; y++)
+            {
+                const float* row0 = src + static_cast<size_t>(std::min(y * 2, srcHeight - 1)) * srcWidth * 4;
+                const float* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+                float* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+                for (uint32_t x = 0; x < dstWidth; x++)
+                {
+                    const uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+                    const uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+#ifdef LOTUS_MIPS_SSE2
+                    const __m128 sum = _mm_add_ps(
+                        _mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                        _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+                    _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+                    for (uint32_t c = 0; c < 4; c++)
+                        out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+                }
+            }
+        }
+
+        void Encode(const float* src, uint8_t* dst, size_t firstTexel, size_t lastTexel, bool srgb)
+        {
+            const ConversionTables& tables = GetTables();
+            for (size_t i = firstTexel; i < lastTexel; i++)
+            {
+#ifdef LOTUS_MIPS_SSE2
+                // scale to table / byte range and round all four channels at once
+                const __m128 scale = srgb
+                    ? _mm_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f)
+                    : _mm_set1_ps(255.0f);
+                const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i * 4), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+                alignas(16) int32_t q[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(q), _mm_cvtps_epi32(_mm_mul_ps(clamped, scale)));
+#else
+                int32_t q[4];
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    const float v = std::min(std::max(src[i * 4 + c], 0.0f), 1.0f);
+                    q[c] = static_cast<int32_t>(v * (srgb && c < 3 ? 65535.0f : 255.0f) + 0.5f);
+                }
+#endif
+                for (uint32_t c = 0; c < 3; c++)
+                    dst[i * 4 + c] = srgb ? tables.toSrgb[q[c]] : static_cast<uint8_t>(q[c]);
+                dst[i * 4 + 3] = static_cast<uint8_t>(q[3]);
+            }
+        }
+
+    }
+
+    uint32_t MipGenerator::GetMipLevelCount(uint32_t width, uint32_t height)
+    {
+        uint32_t levels = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+            levels++;
+        return levels;
+    }
+
+    void MipGenerator::Generate(Texture::ImageData& image)
+    {
+        assert((image.format == VK_FORMAT_R8G8B8A8_SRGB || image.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+            "CPU mip generation only supports RGBA8 images");
+        assert(!image.levels.empty() && "image has no top level");
+        assert(!image.mappedFile && "detach the image from its file before adding levels");
+
+        const bool srgb = image.format == VK_FORMAT_R8G8B8A8_SRGB;
+        const uint32_t levelCount = GetMipLevelCount(image.width, image.height);
+        const Texture::MipLevel top = image.levels.back();
+        if (image.levels.size() >= levelCount)
+            return;
+
+        // lay out the remaining levels and grow the pixel storage once
+        const size_t firstLevel = image.levels.size();
+        size_t offset = top.offset + top.size;
+        uint32_t width = top.width, height = top.height;
+        for (size_t level = firstLevel; level < levelCount; level++)
+        {
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+            const size_t size = static_cast<size_t>(width) * height * 4;
+            image.levels.push_back({ width, height, offset, size });
+            offset += size;
+        }
+        image.pixels.resize(offset);
+
+        std::vector<float> source(static_cast<size_t>(top.width) * top.height * 4);
+        std::vector<float> target;
+        ForEachRowBlock(top.height, [&](uint32_t firstRow, uint32_t lastRow)
+        {
+            Decode(image.pixels.data() + top.offset, source.data(),
+                static_cast<size_t>(firstRow) * top.width, static_cast<size_t>(lastRow) * top.width, srgb);
+        });
+
+        uint32_t srcWidth = top.width, srcHeight = top.height;
+        for (size_t level = firstLevel; level < image.levels.size(); level++)
+        {
+            const Texture::MipLevel& mip = image.levels[level];
+            target.resize(static_cast<size_t>(mip.width) * mip.height * 4);
+            ForEachRowBlock(mip.height, [&](uint32_t firstRow, uint32_t lastRow)
+            {
+                Downsample(source.data(), srcWidth, srcHeight, target.data(), mip.width, firstRow, lastRow);
+                Encode(target.data(), image.pixels.data() + mip.offset,
+                    static_cast<size_t>(firstRow) * mip.width, static_cast<size_t>(lastRow) * mip.width, srgb);
+            });
+
+            std::swap(source, target);
+            srcWidth = mip.width;
+            srcHeight = mip.height;
+        }
+    }
+
+    Texture::ImageData MipGenerator::GenerateTail(const Texture::ImageData& image, uint32_t maxSize)
+    {
+        assert((image.format == VK_FORMAT_R8G8B8A8_SRGB || image.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+            "CPU mip generation only supports RGBA8 images");
+        assert(image.levels.size() == 1 && "image already has its mips");
+
+        const bool srgb = image.format == VK_FORMAT_R8G8B8A8_SRGB;
+        const Texture::MipLevel& top = image.levels[0];
+
+        Texture::ImageData tail;
+        tail.width = image.width;
+        tail.height = image.height;
+        tail.format = image.format;
+        tail.levels.push_back({ top.width, top.height, 0, 0 });
+
+        uint32_t shift = 0;
+        while (shift + 1 < GetMipLevelCount(top.width, top.height) && std::max(tail.levels.back().width, tail.levels.back().height) > maxSize)
+        {
+            shift++;
+            tail.levels.push_back({ std::max(1u, top.width >> shift), std::max(1u, top.height >> shift), 0, 0 });
+        }
+
+        Texture::MipLevel& first = tail.levels.back();
+        first.size = static_cast<size_t>(first.width) * first.height * 4;
+        tail.pixels.resize(first.size);
+
+        // once a side is down to one texel the chain keeps averaging the same rows or columns,
+        // so that side's block stops at the largest power of two that fits
+        const auto blockSize = [shift](uint32_t size)
+        {
+            uint32_t block = 1;
+            while (block < (1u << shift) && block * 2 <= size)
+                block *= 2;
+            return block;
+        };
+        const uint32_t blockWidth = blockSize(top.width);
+        const uint32_t blockHeight = blockSize(top.height);
+        const float weight = 1.0f / (static_cast<float>(blockWidth) * blockHeight);
+        const uint8_t* src = image.GetPixels() + top.offset;
+
+        // every row of the tail's top level sums a whole block of source rows, enough work for a job of its own
+        ThreadPool::Get().ParallelFor(first.height, [&](uint32_t y)
+        {
+            const ConversionTables& tables = GetTables();
+            std::vector<float> sums(static_cast<size_t>(first.width) * 4, 0.0f);
+            for (uint32_t row = y * blockHeight; row < (y + 1) * blockHeight; row++)
+            {
+                const uint8_t* in = src + static_cast<size_t>(row) * top.width * 4;
+                for (uint32_t x = 0; x < first.width * blockWidth; x++)
+                {
+                    float* sum = sums.data() + (x / blockWidth) * 4;
+                    for (uint32_t c = 0; c < 3; c++)
+                        sum[c] += srgb ? tables.toLinear[in[x * 4 + c]] : in[x * 4 + c] / 255.0f;
+                    sum[3] += in[x * 4 + 3] / 255.0f;
+                }
+            }
+
+            for (float& sum : sums)
+                sum *= weight;
+            Encode(sums.data(), tail.pixels.data() + static_cast<size_t>(y) * first.width * 4, 0, first.width, srgb);
+        });
+
+        // the rest of the tail is small, filter it from its top level like any other chain
+        Texture::ImageData rest;
+        rest.width = first.width;
+        rest.height = first.height;
+        rest.format = tail.format;
+        rest.pixels = std::move(tail.pixels);
+        rest.levels = { { first.width, first.height, 0, first.size } };
+        Generate(rest);
+
+        tail.pixels = std::move(rest.pixels);
+        first.offset = 0;
+        tail.levels.insert(tail.levels.end(), rest.levels.begin() + 1, rest.levels.end());
+        return tail;
+    }
+
+}
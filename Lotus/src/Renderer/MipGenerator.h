@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <cstdint>
+
+namespace Lotus {
+
+	// CPU mip chain generation for RGBA8 images. Every level is a 2x2 box filter of the previous one,
+	// computed in linear space for sRGB formats so dark and bright texels are weighted correctly;
+	// the chain is filtered at float precision and only quantized once per written level.
+	class MipGenerator
+	{
+	public:
+		static uint32_t GetMipLevelCount(uint32_t width, uint32_t height);
+
+		// Appends every level below the existing top level to image.pixels and image.levels;
+		// the image must own its pixels, see ImageData::DetachFromFile
+		static void Generate(Texture::ImageData& image);
+
+		// Only the levels at most maxSize texels wide, computed with one box filter over the top level
+		// instead of going through every level in between. The result has the whole chain's levels, the
+		// ones above the tail with their size set to 0 and no texels. Matches Generate for power of two
+		// sizes and comes close otherwise
+		static Texture::ImageData GenerateTail(const Texture::ImageData& image, uint32_t maxSize);
+	};
+
+}
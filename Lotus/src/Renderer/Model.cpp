@@ -1,128 +1,328 @@
 #include "lotuspch.h"
 
 #include "Model.h"
+#include "MeshCache.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include "UploadManager.h"
+#include "VertexQuantizer.h"
+#include "VertexWelder.h"
 #include "Utils/Utils.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <iostream>
-#include <unordered_map>
 
-namespace std
+namespace Lotus
 {
-    template<>
-    struct hash<Lotus::Model::Vertex>
+    Model::Model(Device& device, const Builder& builder, VertexFormat format)
+        : Model(device, builder.GetMeshData(), format)
     {
-        size_t operator()(const Lotus::Model::Vertex& vertex) const
-        {
-            size_t seed = 0;
-            Lotus::hash_combine(seed, vertex.position.x, vertex.position.y, vertex.position.z,
-                vertex.color.r, vertex.color.g, vertex.color.b,
-                vertex.normal.x, vertex.normal.y, vertex.normal.z,
-                vertex.texCoord.x, vertex.texCoord.y);
-            return seed;
-        }
-    };
-}
+    }
 
-namespace Lotus
-{
-    Model::Model(Device& device, const Builder& builder)
-        : m_Device{ device }
+    Model::Model(Device& device, const MeshData& data, VertexFormat format)
+        : m_Device{ device }, m_Bounds{ data.bounds }, m_VertexFormat{ format },
+        m_Meshlets{ data.meshlets, data.meshlets + data.meshletCount },
+        m_TexCoordDensity{ ComputeTexCoordDensity(data) }
     {
-        CreateVertexBuffers(builder.vertices);
-        CreateIndexBuffers(builder.indices);
+        CreateVertexBuffers(data);
+        CreateIndexBuffers(data);
     }
 
-    Model::~Model() { }
+    Model::~Model()
+    {
+        GeometryArena& arena = m_Device.GetGeometryArena();
+        if (m_Vertices != GeometryArena::INVALID_HANDLE)
+            arena.Free(m_Vertices);
+        if (m_Indices != GeometryArena::INVALID_HANDLE)
+            arena.Free(m_Indices);
+    }
 
-    std::unique_ptr<Model> Model::CreateModelFromFile(Device& device, const std::string& filepath)
+    std::unique_ptr<Model> Model::CreateModelFromFile(Device& device, const std::string& filepath, const ImportSettings& settings)
     {
-        Builder builder{};
-        builder.LoadModel(filepath);
-        return std::make_unique<Model>(device, builder);
+        ImportResult result{};
+        Import(filepath, settings, result);
+        return std::make_unique<Model>(device, result.data, settings.vertexFormat);
     }
 
-    void Model::Bind(VkCommandBuffer commandBuffer) const
+    void Model::Import(const std::string& filepath, const ImportSettings& settings, ImportResult& result)
     {
-        const VkBuffer buffers[] = { m_VertexBuffer->GetBuffer() };
-        constexpr VkDeviceSize offsets[] = { 0 };
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        // the cache is keyed on the source contents and the import settings, so edited files are
+        // re-imported automatically; each set of settings has its own file, so they do not evict each other
+        const uint64_t settingsHash = settings.Hash();
+        const uint64_t sourceHash = HashBytes(&settingsHash, sizeof(settingsHash), MeshCache::HashSourceFile(filepath));
+        const std::string cachePath = MeshCache::GetCachePath(filepath, settingsHash);
 
+        MeshCache::Entry entry{};
+        if (MeshCache::Load(cachePath, sourceHash, entry))
+        {
+            result.cacheFile = std::move(entry.file);
+            result.data = entry.data;
+            return;
+        }
+
+        result.builder.LoadModel(filepath, settings);
+        result.data = result.builder.GetMeshData();
+        MeshCache::Write(cachePath, sourceHash, result.data);
+    }
+
+    VkDeviceSize Model::GetDeviceSize() const
+    {
+        GeometryArena& arena = m_Device.GetGeometryArena();
+        VkDeviceSize size = arena.GetSize(m_Vertices);
         if (m_HasIndexBuffer)
-            vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+            size += arena.GetSize(m_Indices);
+        return size;
+    }
+
+    size_t Model::GetHostSize() const
+    {
+        return sizeof(Model)
+            + m_IndexRanges.capacity() * sizeof(IndexRange)
+            + m_Lods.capacity() * sizeof(LodRanges)
+            + m_Meshlets.capacity() * sizeof(Meshlet);
+    }
+
+    float Model::ComputeTexCoordDensity(const MeshData& data)
+    {
+        // sqrt of the texcoord area over the surface area, the ratio of a uniformly mapped mesh
+        const uint32_t indexCount = data.lodCount > 0 ? data.lods[0].indexCount : data.indexCount;
+        const uint32_t* indices = data.lodCount > 0 ? data.indices + data.lods[0].firstIndex : data.indices;
+        if (data.vertices == nullptr || indices == nullptr)
+            return 0.0f;
+
+        double surfaceArea = 0.0;
+        double texCoordArea = 0.0;
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const Vertex& v0 = data.vertices[indices[i]];
+            const Vertex& v1 = data.vertices[indices[i + 1]];
+            const Vertex& v2 = data.vertices[indices[i + 2]];
+
+            surfaceArea += glm::length(glm::cross(v1.position - v0.position, v2.position - v0.position));
+            const glm::vec2 e1 = v1.texCoord - v0.texCoord;
+            const glm::vec2 e2 = v2.texCoord - v0.texCoord;
+            texCoordArea += std::abs(e1.x * e2.y - e1.y * e2.x);
+        }
+
+        if (surfaceArea <= 0.0)
+            return 0.0f;
+        return static_cast<float>(std::sqrt(texCoordArea / surfaceArea));
     }
 
-    void Model::Draw(VkCommandBuffer commandBuffer) const
+    void Model::Draw(VkCommandBuffer commandBuffer, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) const
     {
+        // ranges are relative to the model, the arena places them in the shared buffers
+        const GeometryArena& arena = m_Device.GetGeometryArena();
+        const uint32_t vertexBase = arena.GetFirstElement(m_Vertices);
         if (m_HasIndexBuffer)
-            vkCmdDrawIndexed(commandBuffer, m_IndexCount, 1, 0, 0, 0);
+        {
+            assert(lod < m_Lods.size() && "LOD index out of range");
+            const uint32_t indexBase = arena.GetFirstElement(m_Indices);
+            const LodRanges& ranges = m_Lods[lod];
+            for (uint32_t i = ranges.firstRange; i < ranges.firstRange + ranges.rangeCount; i++)
+            {
+                const IndexRange& range = m_IndexRanges[i];
+                vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, indexBase + range.firstIndex,
+                    static_cast<int32_t>(vertexBase) + range.vertexOffset, firstInstance);
+            }
+        }
         else
-            vkCmdDraw(commandBuffer, m_VertexCount, 1, 0, 0);
+            vkCmdDraw(commandBuffer, m_VertexCount, instanceCount, vertexBase, firstInstance);
     }
 
-    void Model::CreateVertexBuffers(const std::vector<Vertex>& vertices) {
-        m_VertexCount = static_cast<uint32_t>(vertices.size());
-        assert(m_VertexCount >= 3 && "Vertex count must be at least 3");
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * m_VertexCount;
-        uint32_t vertexSize = sizeof(vertices[0]);
+    void Model::DrawMeshlets(VkCommandBuffer commandBuffer, const std::vector<uint32_t>& visibleMeshlets, uint32_t firstInstance) const
+    {
+        assert(m_HasIndexBuffer && "Meshlets need an index buffer");
+
+        const GeometryArena& arena = m_Device.GetGeometryArena();
+        const int32_t vertexBase = static_cast<int32_t>(arena.GetFirstElement(m_Vertices));
+        const uint32_t indexBase = arena.GetFirstElement(m_Indices);
+
+        const LodRanges& lod = m_Lods[0];
+        uint32_t rangeIndex = lod.firstRange;
+        const uint32_t rangeEnd = lod.firstRange + lod.rangeCount;
+
+        for (size_t i = 0; i < visibleMeshlets.size();)
+        {
+            // merge runs of meshlets that are adjacent in the index buffer
+            const Meshlet& first = m_Meshlets[visibleMeshlets[i]];
+            uint32_t begin = first.firstIndex;
+            uint32_t end = first.firstIndex + first.indexCount;
+            for (i++; i < visibleMeshlets.size() && m_Meshlets[visibleMeshlets[i]].firstIndex == end; i++)
+                end += m_Meshlets[visibleMeshlets[i]].indexCount;
+
+            // the run can cross 16-bit index ranges, which all have their own vertex offset
+            while (rangeIndex < rangeEnd && begin < end)
+            {
+                const IndexRange& range = m_IndexRanges[rangeIndex];
+                const uint32_t rangeLast = range.firstIndex + range.indexCount;
+                if (begin >= rangeLast)
+                {
+                    rangeIndex++;
+                    continue;
+                }
+
+                const uint32_t drawEnd = std::min(end, rangeLast);
+                vkCmdDrawIndexed(commandBuffer, drawEnd - begin, 1, indexBase + begin, vertexBase + range.vertexOffset, firstInstance);
+                begin = drawEnd;
+            }
+        }
+    }
 
-        Buffer stagingBuffer{
-            m_Device,
-            vertexSize,
-            m_VertexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        };
+    void Model::CreateVertexBuffers(const MeshData& data)
+    {
+        if (m_VertexFormat == VertexFormat::Float)
+        {
+            CreateVertexBuffers(data.vertices, sizeof(Vertex), data.vertexCount);
+            return;
+        }
+
+        VertexQuantizer::Result quantized;
+        VertexQuantizer::Quantize(data, m_VertexFormat, quantized);
+        m_PositionTransform = quantized.positionTransform;
+        m_TexCoordTransform = quantized.texCoordTransform;
 
-        stagingBuffer.Map();
-        stagingBuffer.WriteToBuffer((void*)vertices.data());
+        const auto& error = quantized.error;
+        LOTUS_CORE_INFO("Quantized {0} vertices to {1} bytes each (was {2}): max error position {3:.6f}, normal {4:.4f} deg, uv {5:.6f}, color {6:.4f}",
+            data.vertexCount, quantized.vertexSize, sizeof(Vertex), error.position, error.normalDegrees, error.texCoord, error.color);
 
-        m_VertexBuffer = std::make_unique<Buffer>(
-            m_Device,
-            vertexSize,
-            m_VertexCount,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        CreateVertexBuffers(quantized.vertices.data(), quantized.vertexSize, data.vertexCount);
+    }
+
+    void Model::CreateVertexBuffers(const void* vertices, uint32_t vertexSize, uint32_t vertexCount) {
+        m_VertexCount = vertexCount;
+        assert(m_VertexCount >= 3 && "Vertex count must be at least 3");
 
-        m_Device.CopyBuffer(stagingBuffer.GetBuffer(), m_VertexBuffer->GetBuffer(), bufferSize);
+        // goes out with the next upload batch, which is submitted before the frame that draws it
+        GeometryArena& arena = m_Device.GetGeometryArena();
+        m_Vertices = arena.Allocate(GeometryArena::Stream::Vertex, vertexSize, m_VertexCount);
+        arena.Upload(m_Vertices, vertices);
     }
 
-    void Model::CreateIndexBuffers(const std::vector<uint32_t>& indices) {
-        m_IndexCount = static_cast<uint32_t>(indices.size());
+    void Model::CreateIndexBuffers(const MeshData& data) {
+        const uint32_t* indices = data.indices;
+        m_IndexCount = data.indexCount;
         m_HasIndexBuffer = m_IndexCount > 0;
 
+        const Lod fullLod{ 0, m_IndexCount, 0.0f };
+        const Lod* lods = data.lodCount > 0 ? data.lods : &fullLod;
+        const uint32_t lodCount = data.lodCount > 0 ? data.lodCount : 1;
+
+        m_Lods.clear();
+        m_IndexRanges.clear();
         if (!m_HasIndexBuffer) {
+            m_Lods.push_back({});
             return;
         }
 
-        VkDeviceSize bufferSize = sizeof(indices[0]) * m_IndexCount;
-        uint32_t indexSize = sizeof(indices[0]);
+        // every LOD gets its own ranges; if any of them needs 32-bit indices the whole buffer uses them
+        m_IndexType = VK_INDEX_TYPE_UINT16;
+        std::vector<IndexRange> lodRanges;
+        for (uint32_t lod = 0; lod < lodCount && m_IndexType == VK_INDEX_TYPE_UINT16; lod++)
+        {
+            if (!BuildIndexRanges16(indices + lods[lod].firstIndex, lods[lod].indexCount, lodRanges))
+            {
+                m_IndexType = VK_INDEX_TYPE_UINT32;
+                break;
+            }
+
+            m_Lods.push_back({ lods[lod].error, static_cast<uint32_t>(m_IndexRanges.size()), static_cast<uint32_t>(lodRanges.size()) });
+            for (IndexRange range : lodRanges)
+            {
+                range.firstIndex += lods[lod].firstIndex;
+                m_IndexRanges.push_back(range);
+            }
+        }
 
-        Buffer stagingBuffer{
-            m_Device,
-            indexSize,
-            m_IndexCount,
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        };
+        if (m_IndexType == VK_INDEX_TYPE_UINT32)
+        {
+            m_Lods.clear();
+            m_IndexRanges.clear();
+            for (uint32_t lod = 0; lod < lodCount; lod++)
+            {
+                m_Lods.push_back({ lods[lod].error, lod, 1 });
+                m_IndexRanges.push_back({ lods[lod].firstIndex, lods[lod].indexCount, 0 });
+            }
+        }
 
-        stagingBuffer.Map();
-        stagingBuffer.WriteToBuffer((void*)indices.data());
+        uint32_t indexSize = m_IndexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(indexSize) * m_IndexCount;
 
-        m_IndexBuffer = std::make_unique<Buffer>(
-            m_Device,
-            indexSize,
-            m_IndexCount,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        GeometryArena& arena = m_Device.GetGeometryArena();
+        m_Indices = arena.Allocate(GeometryArena::Stream::Index, indexSize, m_IndexCount);
+        const UploadManager::StagingAllocation staging = m_Device.GetUploadManager().Stage(bufferSize);
+        if (m_IndexType == VK_INDEX_TYPE_UINT16)
+        {
+            // narrow straight into the mapped staging memory, rebased onto each range's vertex offset
+            uint16_t* mapped = static_cast<uint16_t*>(staging.data);
+            for (const IndexRange& range : m_IndexRanges)
+            {
+                for (uint32_t i = range.firstIndex; i < range.firstIndex + range.indexCount; i++)
+                    mapped[i] = static_cast<uint16_t>(indices[i] - static_cast<uint32_t>(range.vertexOffset));
+            }
+        }
+        else
+        {
+            memcpy(staging.data, indices, bufferSize);
+        }
 
-        m_Device.CopyBuffer(stagingBuffer.GetBuffer(), m_IndexBuffer->GetBuffer(), bufferSize);
+        arena.Write(m_Indices, staging);
+    }
+
+    bool Model::BuildIndexRanges16(const uint32_t* indices, uint32_t indexCount, std::vector<IndexRange>& ranges)
+    {
+        constexpr uint32_t maxRangeVertex = 0xFFFF;
+        // every extra range costs a draw call; past this many 32-bit indices are the better deal
+        constexpr uint32_t maxExtraRanges = 8;
+
+        uint32_t maxIndex = 0;
+        for (uint32_t i = 0; i < indexCount; i++)
+            maxIndex = std::max(maxIndex, indices[i]);
+
+        ranges.clear();
+        if (maxIndex <= maxRangeVertex)
+        {
+            ranges.push_back({ 0, indexCount, 0 });
+            return true;
+        }
+
+        // Sliding window over the index buffer: a triangle that does not fit the current
+        // [base, base + 0xFFFF] window starts a new range based at its lowest vertex. Meshes
+        // that went through MeshOptimizer fetch vertices in first-use order, so this stays close
+        // to vertexCount / 64K ranges.
+        const uint32_t rangeLimit = maxIndex / (maxRangeVertex + 1) + 1 + maxExtraRanges;
+        IndexRange current{ 0, 0, 0 };
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            const uint32_t a = indices[i + 0], b = indices[i + 1], c = indices[i + 2];
+            const uint32_t low = std::min(a, std::min(b, c));
+            const uint32_t high = std::max(a, std::max(b, c));
+            if (high - low > maxRangeVertex)
+                return false;
+
+            const uint32_t base = static_cast<uint32_t>(current.vertexOffset);
+            if (low < base || high - base > maxRangeVertex)
+            {
+                if (current.indexCount > 0)
+                    ranges.push_back(current);
+                if (ranges.size() >= rangeLimit)
+                    return false;
+
+                // indices mostly grow, so put most of the window above the new base while keeping
+                // some slack below it for triangles that reach back to recently used vertices
+                const uint32_t slack = std::min(high, maxRangeVertex / 16);
+                current = { i, 0, static_cast<int32_t>(std::min(low, high - slack)) };
+            }
+            current.indexCount += 3;
+        }
+
+        if (current.indexCount > 0)
+            ranges.push_back(current);
+        return true;
     }
 
     std::vector<VkVertexInputBindingDescription> Model::Vertex::GetBindingDescriptions()
@@ -146,63 +346,215 @@ namespace Lotus
         return attributeDescriptions;
     }
 
-    void Model::Builder::LoadModel(const std::string& filepath)
+    std::vector<VkVertexInputBindingDescription> Model::QuantizedVertex::GetBindingDescriptions()
+    {
+        return { { 0, sizeof(QuantizedVertex), VK_VERTEX_INPUT_RATE_VERTEX } };
+    }
+
+    std::vector<VkVertexInputAttributeDescription> Model::QuantizedVertex::GetAttributeDescriptions()
+    {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+        attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(QuantizedVertex, position) });
+        attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(QuantizedVertex, normal) });
+        attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_UNORM, offsetof(QuantizedVertex, texCoord) });
+
+        return attributeDescriptions;
+    }
+
+    std::vector<VkVertexInputBindingDescription> Model::QuantizedColorVertex::GetBindingDescriptions()
+    {
+        return { { 0, sizeof(QuantizedColorVertex), VK_VERTEX_INPUT_RATE_VERTEX } };
+    }
+
+    std::vector<VkVertexInputAttributeDescription> Model::QuantizedColorVertex::GetAttributeDescriptions()
+    {
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+
+        attributeDescriptions.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(QuantizedColorVertex, position) });
+        attributeDescriptions.push_back({ 1, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(QuantizedColorVertex, color) });
+        attributeDescriptions.push_back({ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(QuantizedColorVertex, normal) });
+        attributeDescriptions.push_back({ 3, 0, VK_FORMAT_R16G16_UNORM, offsetof(QuantizedColorVertex, texCoord) });
+
+        return attributeDescriptions;
+    }
+
+    std::vector<VkVertexInputBindingDescription> Model::GetBindingDescriptions(VertexFormat format)
     {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials; // we won't use materials for now
-        std::string warn, error;
+        switch (format)
+        {
+        case VertexFormat::Quantized:      return QuantizedVertex::GetBindingDescriptions();
+        case VertexFormat::QuantizedColor: return QuantizedColorVertex::GetBindingDescriptions();
+        default:                           return Vertex::GetBindingDescriptions();
+        }
+    }
 
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &error, filepath.c_str()))
+    std::vector<VkVertexInputAttributeDescription> Model::GetAttributeDescriptions(VertexFormat format)
+    {
+        switch (format)
         {
-            throw std::runtime_error(warn + error);
+        case VertexFormat::Quantized:      return QuantizedVertex::GetAttributeDescriptions();
+        case VertexFormat::QuantizedColor: return QuantizedColorVertex::GetAttributeDescriptions();
+        default:                           return Vertex::GetAttributeDescriptions();
         }
+    }
+
+    uint64_t Model::ImportSettings::Hash() const
+    {
+        uint64_t hash = HashBytes(&weldEpsilon, sizeof(weldEpsilon));
+        hash = HashBytes(&optimizeMesh, sizeof(optimizeMesh), hash);
+        hash = HashBytes(&maxLodCount, sizeof(maxLodCount), hash);
+        hash = HashBytes(&lodReduction, sizeof(lodReduction), hash);
+        return HashBytes(&buildMeshlets, sizeof(buildMeshlets), hash);
+    }
+
+    void Model::Builder::LoadModel(const std::string& filepath, const ImportSettings& settings)
+    {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+
+        ObjLoader::Result obj;
+        ObjLoader::Load(filepath, obj);
 
         vertices.clear();
         indices.clear();
+        lods.clear();
+        meshlets.clear();
+        indices.reserve(obj.indices.size());
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-        for (const auto& shape : shapes)
+        VertexWelder welder{ vertices, obj.positions.size() / 3, settings.weldEpsilon };
+        for (const auto& index : obj.indices)
         {
-            for (const auto& index : shape.mesh.indices)
+            Vertex vertex{};
+            if (index.vertex >= 0)
             {
-                Vertex vertex{};
-                if (index.vertex_index >= 0)
-                {
-                    vertex.position = {
-                        attrib.vertices[3 * index.vertex_index + 0],
-                        attrib.vertices[3 * index.vertex_index + 1],
-                        attrib.vertices[3 * index.vertex_index + 2]
-                    };
-                    vertex.color = {
-                        attrib.colors[3 * index.vertex_index + 0],
-                        attrib.colors[3 * index.vertex_index + 1],
-                        attrib.colors[3 * index.vertex_index + 2]
-                    };
-                }
-                if (index.normal_index >= 0)
-                {
-                    vertex.normal = {
-                        attrib.normals[3 * index.normal_index + 0],
-                        attrib.normals[3 * index.normal_index + 1],
-                        attrib.normals[3 * index.normal_index + 2]
-                    };
-                }
-                if (index.texcoord_index >= 0)
-                {
-                    vertex.texCoord = {
-                        attrib.texcoords[2 * index.texcoord_index + 0],
-                        attrib.texcoords[2 * index.texcoord_index + 1]
-                    };
-                }
-
-                if (uniqueVertices.count(vertex) == 0)
-                {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
-                }
-                indices.push_back(uniqueVertices[vertex]);
+                vertex.position = {
+                    obj.positions[3 * index.vertex + 0],
+                    obj.positions[3 * index.vertex + 1],
+                    obj.positions[3 * index.vertex + 2]
+                };
+                vertex.color = {
+                    obj.colors[3 * index.vertex + 0],
+                    obj.colors[3 * index.vertex + 1],
+                    obj.colors[3 * index.vertex + 2]
+                };
+            }
+            if (index.normal >= 0)
+            {
+                vertex.normal = {
+                    obj.normals[3 * index.normal + 0],
+                    obj.normals[3 * index.normal + 1],
+                    obj.normals[3 * index.normal + 2]
+                };
             }
+            if (index.texcoord >= 0)
+            {
+                vertex.texCoord = {
+                    obj.texcoords[2 * index.texcoord + 0],
+                    obj.texcoords[2 * index.texcoord + 1]
+                };
+            }
+
+            indices.push_back(welder.Insert(vertex));
         }
+
+        if (settings.optimizeMesh)
+            Optimize(filepath);
+        ComputeBounds();
+        GenerateLods(settings.maxLodCount, settings.lodReduction);
+        if (settings.buildMeshlets)
+            BuildMeshlets();
+
+        const auto endTime = std::chrono::high_resolution_clock::now();
+        LOTUS_CORE_INFO("Loaded {0}: {1} vertices, {2} indices, {3} LODs in {4:.2f} ms (weld table {5} KB)", filepath, vertices.size(),
+            lods.empty() ? indices.size() : lods[0].indexCount, std::max<size_t>(lods.size(), 1),
+            std::chrono::duration<float, std::milli>(endTime - startTime).count(), welder.GetMemoryUsage() / 1024);
+    }
+
+    void Model::Builder::ComputeBounds()
+    {
+        if (vertices.empty())
+        {
+            bounds = {};
+            return;
+        }
+
+        bounds.min = bounds.max = vertices[0].position;
+        for (const auto& vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.position);
+            bounds.max = glm::max(bounds.max, vertex.position);
+        }
+    }
+
+    void Model::Builder::Optimize(const std::string& name)
+    {
+        assert(lods.empty() && "Optimize reorders vertices, it has to run before GenerateLods");
+        if (indices.empty())
+            return;
+
+        const auto before = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+        const auto clusters = MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+        MeshOptimizer::OptimizeOverdraw(indices, vertices, clusters);
+        MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+        const auto after = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        LOTUS_CORE_INFO("Optimized {0}: ACMR {1:.3f} -> {2:.3f}, ATVR {3:.3f} -> {4:.3f}",
+            name, before.acmr, after.acmr, before.atvr, after.atvr);
+    }
+
+    void Model::Builder::GenerateLods(uint32_t maxLodCount, float reduction)
+    {
+        // coarser levels stop once they would deviate by more than this fraction of the bounds diagonal
+        constexpr float maxRelativeError = 0.02f;
+        // a level has to drop at least this fraction of the previous one's triangles to be worth keeping
+        constexpr float minLodReduction = 0.1f;
+
+        lods.clear();
+        if (indices.empty())
+            return;
+
+        const std::vector<uint32_t> fullIndices = indices;
+        lods.push_back({ 0, static_cast<uint32_t>(fullIndices.size()), 0.0f });
+
+        const float maxError = glm::length(bounds.max - bounds.min) * maxRelativeError;
+        std::vector<uint32_t> lodIndices;
+        while (lods.size() < maxLodCount)
+        {
+            const Lod& previous = lods.back();
+            const size_t targetIndexCount = static_cast<size_t>(previous.indexCount * reduction) / 3 * 3;
+
+            // always simplify the full mesh so the error is measured against it. A level that barely
+            // shrinks, like every level of a mesh whose vertices are all locked seams, would only make
+            // SelectLod switch between copies of the same geometry: the chain ends there
+            const float error = MeshSimplifier::Simplify(vertices, fullIndices, targetIndexCount, maxError, lodIndices);
+            if (lodIndices.empty() || lodIndices.size() > previous.indexCount * (1.0f - minLodReduction))
+                break;
+
+            MeshOptimizer::OptimizeVertexCache(lodIndices, vertices.size());
+            lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()), std::max(error, previous.error) });
+            indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+        }
+    }
+
+    void Model::Builder::BuildMeshlets()
+    {
+        const size_t lod0IndexCount = lods.empty() ? indices.size() : lods[0].indexCount;
+        MeshletBuilder::Build(vertices, indices.data(), lod0IndexCount, meshlets);
+    }
+
+    Model::MeshData Model::Builder::GetMeshData() const
+    {
+        MeshData data{};
+        data.vertices = vertices.data();
+        data.vertexCount = static_cast<uint32_t>(vertices.size());
+        data.indices = indices.data();
+        data.indexCount = static_cast<uint32_t>(indices.size());
+        data.bounds = bounds;
+        data.lods = lods.data();
+        data.lodCount = static_cast<uint32_t>(lods.size());
+        data.meshlets = meshlets.data();
+        data.meshletCount = static_cast<uint32_t>(meshlets.size());
+        return data;
     }
 }
\ No newline at end of file
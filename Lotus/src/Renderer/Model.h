@@ -1,6 +1,7 @@
 #pragma once
 #include "Device.h"
-#include "Buffer.h"
+#include "GeometryArena.h"
+#include "Utils/MappedFile.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -27,37 +28,205 @@ namespace Lotus {
 			}
 		};
 
+		// GPU vertex layouts a Model can be uploaded with. Float matches Vertex, the quantized
+		// layouts are decoded in the vertex shader (see QuantizedShader.vert).
+		enum class VertexFormat : uint8_t
+		{
+			Float,          // Vertex, 44 bytes
+			Quantized,      // QuantizedVertex, 16 bytes, no vertex color
+			QuantizedColor, // QuantizedColorVertex, 20 bytes
+			Count
+		};
+
+		struct QuantizedVertex
+		{
+			int16_t position[4];  // snorm16 within the mesh bounds, w is padding
+			int16_t normal[2];    // octahedral snorm16
+			uint16_t texCoord[2]; // unorm16 within the texcoord bounds
+
+			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+		};
+
+		struct QuantizedColorVertex
+		{
+			int16_t position[4];
+			int16_t normal[2];
+			uint16_t texCoord[2];
+			uint8_t color[4];     // unorm8 rgba
+
+			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
+			static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+		};
+
+		static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions(VertexFormat format);
+		static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions(VertexFormat format);
+
+		struct Bounds
+		{
+			glm::vec3 min{ 0.f };
+			glm::vec3 max{ 0.f };
+		};
+
+		// One level of detail: a range of the shared index buffer, all levels use the same vertices
+		struct Lod
+		{
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			float error = 0.0f; // largest deviation from the full mesh, in model space
+		};
+
+		// Cluster of up to 64 vertices / 124 triangles of LOD0 with bounds for culling, see MeshletBuilder
+		struct Meshlet
+		{
+			glm::vec3 center{ 0.f };
+			float radius = 0.0f;
+			glm::vec3 coneAxis{ 0.f, 0.f, 1.f };
+			float coneCutoff = 1.0f; // sine of the normal cone half-angle, 1 disables cone culling
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+		};
+
+		// Non-owning view of vertex and index data that is ready to be uploaded
+		struct MeshData
+		{
+			const Vertex* vertices = nullptr;
+			uint32_t vertexCount = 0;
+			const uint32_t* indices = nullptr;
+			uint32_t indexCount = 0;
+			Bounds bounds{};
+			// without LODs the whole index buffer is drawn as one level
+			const Lod* lods = nullptr;
+			uint32_t lodCount = 0;
+			const Meshlet* meshlets = nullptr;
+			uint32_t meshletCount = 0;
+		};
+
+		struct ImportSettings
+		{
+			// 0 welds equal vertices only (-0 and +0 count as equal), otherwise attributes are quantized to a
+			// grid of this spacing before exact matching: close values on either side of a cell boundary stay
+			// apart. Must be finite and not negative
+			float weldEpsilon = 0.0f;
+			// reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch
+			bool optimizeMesh = true;
+			// applied when the mesh is uploaded, so it is not part of the cache key
+			VertexFormat vertexFormat = VertexFormat::Float;
+			// number of levels including the full mesh, each one aiming for lodReduction times the triangles of the previous
+			uint32_t maxLodCount = 4;
+			float lodReduction = 0.5f;
+			// split LOD0 into meshlets so the renderer can cull parts of the mesh
+			bool buildMeshlets = true;
+
+			uint64_t Hash() const;
+		};
+
 		struct Builder
 		{
 			std::vector<Vertex> vertices;
 			std::vector<uint32_t> indices;
+			Bounds bounds{};
+			std::vector<Lod> lods;
+			std::vector<Meshlet> meshlets;
+
+			void LoadModel(const std::string& filepath, const ImportSettings& settings = {});
+			void ComputeBounds();
+			// name only labels the log line
+			void Optimize(const std::string& name);
+			// Appends simplified index ranges for the coarser levels, call after ComputeBounds
+			void GenerateLods(uint32_t maxLodCount, float reduction);
+			void BuildMeshlets();
+			MeshData GetMeshData() const;
+		};
 
-			void LoadModel(const std::string& filepath);
+		// CPU side of a model import; data points either into the cache file or into the builder
+		struct ImportResult
+		{
+			Builder builder{};
+			MappedFile cacheFile;
+			MeshData data{};
 		};
 
-		Model(Device& device, const Builder& builder);
+		Model(Device& device, const Builder& builder, VertexFormat format = VertexFormat::Float);
+		Model(Device& device, const MeshData& data, VertexFormat format = VertexFormat::Float);
 		~Model();
 
 		Model(const Model&) = delete; // delete copy constructor
 		Model operator=(const Model&) = delete; // delete copy operator
 
-		static std::unique_ptr<Model> CreateModelFromFile(Device& device, const std::string& filepath);
+		// Contiguous run of indices drawn with one vkCmdDrawIndexed; 16-bit indices are relative to vertexOffset
+		struct IndexRange
+		{
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			int32_t vertexOffset = 0;
+		};
+
+		static std::unique_ptr<Model> CreateModelFromFile(Device& device, const std::string& filepath, const ImportSettings& settings = {});
+		// Reads, processes and caches the mesh without touching the device, safe to call from any thread
+		static void Import(const std::string& filepath, const ImportSettings& settings, ImportResult& result);
+
+		// Geometry lives in the device's GeometryArena: bind its vertex buffer, and its index buffer with
+		// GetIndexType, before drawing. Shaders see instances firstInstance onwards in gl_InstanceIndex
+		void Draw(VkCommandBuffer commandBuffer, uint32_t lod = 0, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const;
+		// Draws the given meshlets of LOD0; indices must be ascending, neighbouring meshlets are merged into one draw
+		void DrawMeshlets(VkCommandBuffer commandBuffer, const std::vector<uint32_t>& visibleMeshlets, uint32_t firstInstance = 0) const;
 
-		void Bind(VkCommandBuffer commandBuffer) const;
-		void Draw(VkCommandBuffer commandBuffer) const;
+		const Bounds& GetBounds() const { return m_Bounds; }
+		VkIndexType GetIndexType() const { return m_IndexType; }
+		VertexFormat GetVertexFormat() const { return m_VertexFormat; }
+		uint32_t GetLodCount() const { return static_cast<uint32_t>(m_Lods.size()); }
+		float GetLodError(uint32_t lod) const { return m_Lods[lod].error; }
+		const std::vector<Meshlet>& GetMeshlets() const { return m_Meshlets; }
+
+		// Maps quantized positions back into model space; identity for VertexFormat::Float
+		const glm::mat4& GetPositionTransform() const { return m_PositionTransform; }
+		// xy = texcoord offset, zw = texcoord scale; (0, 0, 1, 1) for VertexFormat::Float
+		const glm::vec4& GetTexCoordTransform() const { return m_TexCoordTransform; }
+		// Texcoord units per model-space unit, averaged over the surface of LOD0.
+		// Multiplied by a texture's size it gives texels per unit, which the texture streamer turns into a mip level.
+		float GetTexCoordDensity() const { return m_TexCoordDensity; }
+
+		// Bytes held in the geometry arena and in the CPU side tables, used for the asset memory budget
+		VkDeviceSize GetDeviceSize() const;
+		size_t GetHostSize() const;
 	private:
-		void CreateVertexBuffers(const std::vector<Vertex>& vertices);
-		void CreateIndexBuffers(const std::vector<uint32_t>& indices);
+		void CreateVertexBuffers(const MeshData& data);
+		void CreateVertexBuffers(const void* vertices, uint32_t vertexSize, uint32_t vertexCount);
+		void CreateIndexBuffers(const MeshData& data);
+
+		// Splits the index buffer into ranges spanning at most 64K vertices each.
+		// Returns false when the mesh has to keep 32-bit indices.
+		static bool BuildIndexRanges16(const uint32_t* indices, uint32_t indexCount, std::vector<IndexRange>& ranges);
+		static float ComputeTexCoordDensity(const MeshData& data);
 
 	private:
 		Device& m_Device;
+		Bounds m_Bounds{};
 
-		std::unique_ptr<Buffer> m_VertexBuffer;
+		VertexFormat m_VertexFormat = VertexFormat::Float;
+		glm::mat4 m_PositionTransform{ 1.f };
+		glm::vec4 m_TexCoordTransform{ 0.f, 0.f, 1.f, 1.f };
+		float m_TexCoordDensity = 0.0f;
+
+		GeometryArena::Handle m_Vertices = GeometryArena::INVALID_HANDLE;
 		uint32_t m_VertexCount;
 
 		bool m_HasIndexBuffer;
-		std::unique_ptr<Buffer> m_IndexBuffer;
+		GeometryArena::Handle m_Indices = GeometryArena::INVALID_HANDLE;
 		uint32_t m_IndexCount;
+		VkIndexType m_IndexType = VK_INDEX_TYPE_UINT32;
+		std::vector<IndexRange> m_IndexRanges;
+
+		struct LodRanges
+		{
+			float error = 0.0f;
+			uint32_t firstRange = 0;
+			uint32_t rangeCount = 0;
+		};
+		std::vector<LodRanges> m_Lods;
+
+		std::vector<Meshlet> m_Meshlets;
 	};
 
 }
\ No newline at end of file
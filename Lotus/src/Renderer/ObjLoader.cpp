@@ -0,0 +1,537 @@
+#include "lotuspch.h"
+#include "ObjLoader.h"
+#include "Utils/MappedFile.h"
+#include "Utils/ThreadPool.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Lotus
+{
+    namespace
+    {
+        // chunks smaller than this are not worth handing to another thread
+        constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+        constexpr int32_t MISSING_INDEX = INT32_MIN;
+
+        struct RawIndex
+        {
+            // absolute zero-based index, or chunk-relative when the matching bit in relativeMask is set
+            int32_t value[3] = { MISSING_INDEX, MISSING_INDEX, MISSING_INDEX }; // vertex, texcoord, normal
+            uint8_t relativeMask = 0;
+        };
+
+        struct Chunk
+        {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+
+            std::vector<float> positions;
+            std::vector<float> colors;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+            std::vector<RawIndex> faceIndices;
+            std::vector<uint32_t> faceSizes;
+            size_t triangleIndexCount = 0;
+            size_t line = 0;
+            std::string error;
+        };
+
+        inline uint32_t CountTrailingZeros(uint32_t mask)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<uint32_t>(index);
+#else
+            return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+        }
+
+        // SSE2 scan for the next '\n', 16 bytes per iteration
+        const char* FindLineEnd(const char* p, const char* end)
+        {
+            const __m128i newline = _mm_set1_epi8('\n');
+            while (end - p >= 16)
+            {
+                const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline));
+                if (mask != 0)
+                    return p + CountTrailingZeros(static_cast<uint32_t>(mask));
+                p += 16;
+            }
+
+            while (p < end && *p != '\n')
+                ++p;
+            return p;
+        }
+
+        inline bool IsDigit(char c) { return static_cast<unsigned char>(c - '0') < 10; }
+        inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        inline void SkipSpaces(const char*& p, const char* end)
+        {
+            while (p < end && IsSpace(*p))
+                ++p;
+        }
+
+        // SWAR digit parsing: checks and converts eight ASCII digits held in one 64-bit register
+        // (see Lemire, "Fast number parsing, faster than strtod")
+        inline bool IsEightDigits(uint64_t chunk)
+        {
+            return ((chunk & 0xF0F0F0F0F0F0F0F0ull) |
+                (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+        }
+
+        inline uint32_t ParseEightDigits(uint64_t chunk)
+        {
+            constexpr uint64_t mask = 0x000000FF000000FFull;
+            constexpr uint64_t mul1 = 0x000F424000000064ull; // 100 + (1000000 << 32)
+            constexpr uint64_t mul2 = 0x0000271000000001ull; // 1 + (10000 << 32)
+            chunk -= 0x3030303030303030ull;
+            chunk = (chunk * 10) + (chunk >> 8);
+            chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+            return static_cast<uint32_t>(chunk);
+        }
+
+        // Accumulates a run of digits into mantissa, keeping at most 19 significant digits.
+        // Returns the number of digits consumed; dropped digits are reported through droppedDigits.
+        inline int ParseDigits(const char*& p, const char* end, uint64_t& mantissa, int& significantDigits, int& droppedDigits)
+        {
+            const char* start = p;
+
+            while (end - p >= 8 && significantDigits <= 11)
+            {
+                uint64_t chunk;
+                std::memcpy(&chunk, p, sizeof(chunk));
+                if (!IsEightDigits(chunk))
+                    break;
+                const bool leadingZeros = mantissa == 0;
+                mantissa = mantissa * 100000000ull + ParseEightDigits(chunk);
+                p += 8;
+
+                if (!leadingZeros)
+                    significantDigits += 8;
+                else
+                    for (uint64_t rest = mantissa; rest != 0; rest /= 10)
+                        significantDigits++;
+            }
+
+            for (; p < end && IsDigit(*p); ++p)
+            {
+                if (significantDigits < 19)
+                {
+                    mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                    if (mantissa != 0)
+                        significantDigits++;
+                }
+                else
+                {
+                    droppedDigits++;
+                }
+            }
+
+            return static_cast<int>(p - start);
+        }
+
+        inline double ScaleByPow10(double mantissa, int exponent)
+        {
+            // powers of ten up to 1e22 are exact in a double
+            static constexpr double table[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+            };
+            if (exponent >= 0 && exponent <= 22)
+                return mantissa * table[exponent];
+            if (exponent < 0 && exponent >= -22)
+                return mantissa / table[-exponent];
+            return mantissa * std::pow(10.0, exponent);
+        }
+
+        bool ParseFloat(const char*& p, const char* end, float& value)
+        {
+            SkipSpaces(p, end);
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negative = *p == '-';
+                ++p;
+            }
+
+            uint64_t mantissa = 0;
+            int significantDigits = 0;
+            int droppedDigits = 0;
+            int exponent = 0;
+
+            int digits = ParseDigits(p, end, mantissa, significantDigits, droppedDigits);
+            exponent += droppedDigits;
+
+            if (p < end && *p == '.')
+            {
+                ++p;
+                droppedDigits = 0;
+                const int fractionDigits = ParseDigits(p, end, mantissa, significantDigits, droppedDigits);
+                exponent -= fractionDigits - droppedDigits;
+                digits += fractionDigits;
+            }
+
+            if (digits == 0)
+                return false;
+
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                ++p;
+                bool negativeExponent = false;
+                if (p < end && (*p == '-' || *p == '+'))
+                {
+                    negativeExponent = *p == '-';
+                    ++p;
+                }
+
+                int explicitExponent = 0;
+                if (p >= end || !IsDigit(*p))
+                    return false;
+                for (; p < end && IsDigit(*p); ++p)
+                {
+                    if (explicitExponent < 10000)
+                        explicitExponent = explicitExponent * 10 + (*p - '0');
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+
+            const double result = ScaleByPow10(static_cast<double>(mantissa), exponent);
+            value = static_cast<float>(negative ? -result : result);
+            return true;
+        }
+
+        bool ParseInt(const char*& p, const char* end, int32_t& value)
+        {
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negative = *p == '-';
+                ++p;
+            }
+
+            if (p >= end || !IsDigit(*p))
+                return false;
+
+            int64_t result = 0;
+            for (; p < end && IsDigit(*p); ++p)
+            {
+                result = result * 10 + (*p - '0');
+                if (result > INT32_MAX)
+                    return false;
+            }
+
+            value = static_cast<int32_t>(negative ? -result : result);
+            return true;
+        }
+
+        // OBJ indices are one-based; negative values count back from the last element seen so far
+        bool ResolveIndex(int32_t raw, size_t localCount, RawIndex& index, int component)
+        {
+            if (raw > 0)
+            {
+                index.value[component] = raw - 1;
+                return true;
+            }
+            if (raw < 0)
+            {
+                // relative to the start of this chunk, may point into an earlier chunk
+                index.value[component] = static_cast<int32_t>(localCount) + raw;
+                index.relativeMask |= static_cast<uint8_t>(1u << component);
+                return true;
+            }
+            return false;
+        }
+
+        bool ParseFaceVertex(const char*& p, const char* end, const Chunk& chunk, RawIndex& index)
+        {
+            int32_t raw;
+            if (!ParseInt(p, end, raw) || !ResolveIndex(raw, chunk.positions.size() / 3, index, 0))
+                return false;
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (p < end && *p != '/')
+                {
+                    if (!ParseInt(p, end, raw) || !ResolveIndex(raw, chunk.texcoords.size() / 2, index, 1))
+                        return false;
+                }
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (!ParseInt(p, end, raw) || !ResolveIndex(raw, chunk.normals.size() / 3, index, 2))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        bool ParseLine(const char* p, const char* end, Chunk& chunk)
+        {
+            if (end - p < 2)
+                return true;
+
+            if (p[0] == 'v')
+            {
+                if (IsSpace(p[1]))
+                {
+                    p += 2;
+                    float x, y, z;
+                    if (!ParseFloat(p, end, x) || !ParseFloat(p, end, y) || !ParseFloat(p, end, z))
+                        return false;
+                    chunk.positions.insert(chunk.positions.end(), { x, y, z });
+
+                    // either a w component (ignored) or the vertex color extension: v x y z r g b
+                    float extra[3] = { 1.0f, 1.0f, 1.0f };
+                    int extraCount = 0;
+                    for (; extraCount < 3; extraCount++)
+                    {
+                        SkipSpaces(p, end);
+                        if (p >= end)
+                            break;
+                        if (!ParseFloat(p, end, extra[extraCount]))
+                            return false;
+                    }
+                    if (extraCount != 3)
+                        extra[0] = extra[1] = extra[2] = 1.0f;
+                    chunk.colors.insert(chunk.colors.end(), { extra[0], extra[1], extra[2] });
+                    return true;
+                }
+                if (p[1] == 't' && end - p > 2 && IsSpace(p[2]))
+                {
+                    p += 3;
+                    float u, v = 0.0f;
+                    if (!ParseFloat(p, end, u))
+                        return false;
+                    SkipSpaces(p, end);
+                    if (p < end && !ParseFloat(p, end, v))
+                        return false;
+                    chunk.texcoords.insert(chunk.texcoords.end(), { u, v });
+                    return true;
+                }
+                if (p[1] == 'n' && end - p > 2 && IsSpace(p[2]))
+                {
+                    p += 3;
+                    float x, y, z;
+                    if (!ParseFloat(p, end, x) || !ParseFloat(p, end, y) || !ParseFloat(p, end, z))
+                        return false;
+                    chunk.normals.insert(chunk.normals.end(), { x, y, z });
+                    return true;
+                }
+                return true;
+            }
+
+            if (p[0] == 'f' && IsSpace(p[1]))
+            {
+                p += 2;
+                uint32_t faceSize = 0;
+                for (;;)
+                {
+                    SkipSpaces(p, end);
+                    if (p >= end)
+                        break;
+                    RawIndex index;
+                    if (!ParseFaceVertex(p, end, chunk, index))
+                        return false;
+                    chunk.faceIndices.push_back(index);
+                    faceSize++;
+                }
+
+                if (faceSize < 3)
+                    return false;
+
+                // polygons are triangulated after the merge, splitting a quad needs its positions
+                chunk.faceSizes.push_back(faceSize);
+                chunk.triangleIndexCount += (faceSize - 2) * 3;
+                return true;
+            }
+
+            // comments, o, g, s, usemtl, mtllib, ...
+            return true;
+        }
+
+        void ParseChunk(Chunk& chunk)
+        {
+            const char* p = chunk.begin;
+            while (p < chunk.end)
+            {
+                const char* lineEnd = FindLineEnd(p, chunk.end);
+                SkipSpaces(p, lineEnd);
+                if (!ParseLine(p, lineEnd, chunk))
+                {
+                    chunk.error = std::string(p, lineEnd);
+                    return;
+                }
+                chunk.line++;
+                p = lineEnd + 1;
+            }
+        }
+
+        template <typename T>
+        void CopyInto(std::vector<T>& dst, size_t offset, const std::vector<T>& src)
+        {
+            if (!src.empty())
+                std::memcpy(dst.data() + offset, src.data(), src.size() * sizeof(T));
+        }
+    }
+
+    void ObjLoader::Load(const std::string& filepath, Result& result)
+    {
+        MappedFile file;
+        if (!file.Open(filepath))
+            throw std::runtime_error("failed to open obj file: " + filepath);
+
+        try
+        {
+            Parse(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), result);
+        }
+        catch (const std::runtime_error& e)
+        {
+            throw std::runtime_error(filepath + ": " + e.what());
+        }
+    }
+
+    void ObjLoader::Parse(const char* data, size_t size, Result& result)
+    {
+        ThreadPool& pool = ThreadPool::Get();
+
+        // split the file into line-aligned chunks, a few per worker to even out the load
+        const size_t maxChunks = static_cast<size_t>(pool.GetThreadCount() + 1) * 4;
+        const size_t chunkCount = std::max<size_t>(1, std::min(maxChunks, size / MIN_CHUNK_SIZE));
+
+        std::vector<Chunk> chunks(chunkCount);
+        const char* end = data + size;
+        const char* begin = data;
+        for (size_t i = 0; i < chunkCount; i++)
+        {
+            const char* chunkEnd = end;
+            if (i + 1 < chunkCount)
+            {
+                chunkEnd = std::max(begin, data + size * (i + 1) / chunkCount);
+                chunkEnd = FindLineEnd(chunkEnd, end);
+                if (chunkEnd < end)
+                    ++chunkEnd;
+            }
+            chunks[i].begin = begin;
+            chunks[i].end = chunkEnd;
+            begin = chunkEnd;
+        }
+
+        pool.ParallelFor(static_cast<uint32_t>(chunkCount), [&](uint32_t i) { ParseChunk(chunks[i]); });
+
+        // prefix sums give every chunk its base offset in the merged arrays
+        std::vector<size_t> positionBase(chunkCount), texcoordBase(chunkCount), normalBase(chunkCount), indexBase(chunkCount);
+        size_t positionCount = 0, texcoordCount = 0, normalCount = 0, indexCount = 0, line = 1;
+        for (size_t i = 0; i < chunkCount; i++)
+        {
+            if (!chunks[i].error.empty())
+                throw std::runtime_error("line " + std::to_string(line + chunks[i].line) + ": invalid statement '" + chunks[i].error + "'");
+            line += chunks[i].line;
+
+            positionBase[i] = positionCount;
+            texcoordBase[i] = texcoordCount;
+            normalBase[i] = normalCount;
+            indexBase[i] = indexCount;
+            positionCount += chunks[i].positions.size() / 3;
+            texcoordCount += chunks[i].texcoords.size() / 2;
+            normalCount += chunks[i].normals.size() / 3;
+            indexCount += chunks[i].triangleIndexCount;
+        }
+
+        result.positions.resize(positionCount * 3);
+        result.colors.resize(positionCount * 3);
+        result.texcoords.resize(texcoordCount * 2);
+        result.normals.resize(normalCount * 3);
+        result.indices.resize(indexCount);
+
+        pool.ParallelFor(static_cast<uint32_t>(chunkCount), [&](uint32_t i)
+        {
+            const Chunk& chunk = chunks[i];
+            CopyInto(result.positions, positionBase[i] * 3, chunk.positions);
+            CopyInto(result.colors, positionBase[i] * 3, chunk.colors);
+            CopyInto(result.texcoords, texcoordBase[i] * 2, chunk.texcoords);
+            CopyInto(result.normals, normalBase[i] * 3, chunk.normals);
+        });
+
+        const size_t counts[3] = { positionCount, texcoordCount, normalCount };
+
+        pool.ParallelFor(static_cast<uint32_t>(chunkCount), [&](uint32_t i)
+        {
+            const Chunk& chunk = chunks[i];
+            const size_t bases[3] = { positionBase[i], texcoordBase[i], normalBase[i] };
+
+            auto resolve = [&](const RawIndex& raw)
+            {
+                int32_t resolved[3];
+                for (int c = 0; c < 3; c++)
+                {
+                    if (raw.value[c] == MISSING_INDEX)
+                    {
+                        resolved[c] = -1;
+                        continue;
+                    }
+
+                    const int64_t value = (raw.relativeMask & (1u << c))
+                        ? static_cast<int64_t>(bases[c]) + raw.value[c]
+                        : static_cast<int64_t>(raw.value[c]);
+                    if (value < 0 || value >= static_cast<int64_t>(counts[c]))
+                        throw std::runtime_error("face index out of range");
+                    resolved[c] = static_cast<int32_t>(value);
+                }
+                return Index{ resolved[0], resolved[2], resolved[1] };
+            };
+
+            auto squaredDistance = [&](const Index& a, const Index& b)
+            {
+                const float* pa = &result.positions[3 * static_cast<size_t>(a.vertex)];
+                const float* pb = &result.positions[3 * static_cast<size_t>(b.vertex)];
+                const float dx = pb[0] - pa[0], dy = pb[1] - pa[1], dz = pb[2] - pa[2];
+                return dx * dx + dy * dy + dz * dz;
+            };
+
+            Index* out = result.indices.data() + indexBase[i];
+            const RawIndex* face = chunk.faceIndices.data();
+            Index polygon[4];
+            for (const uint32_t faceSize : chunk.faceSizes)
+            {
+                if (faceSize == 4)
+                {
+                    // split quads along the shorter diagonal, like tinyobj does
+                    for (int k = 0; k < 4; k++)
+                        polygon[k] = resolve(face[k]);
+
+                    const bool split02 = squaredDistance(polygon[0], polygon[2]) < squaredDistance(polygon[1], polygon[3]);
+                    const int order[6] = { 0, 1, split02 ? 2 : 3, split02 ? 0 : 1, 2, 3 };
+                    for (int k = 0; k < 6; k++)
+                        *out++ = polygon[order[k]];
+                }
+                else
+                {
+                    // fan triangulation for triangles and larger convex polygons
+                    const Index first = resolve(face[0]);
+                    Index previous = resolve(face[1]);
+                    for (uint32_t k = 2; k < faceSize; k++)
+                    {
+                        const Index current = resolve(face[k]);
+                        *out++ = first;
+                        *out++ = previous;
+                        *out++ = current;
+                        previous = current;
+                    }
+                }
+                face += faceSize;
+            }
+        });
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Lotus {
+
+	// Native Wavefront OBJ reader used by Model::Builder. The file is memory-mapped, split into
+	// line-aligned chunks and every chunk is parsed in parallel on the ThreadPool. Only geometry
+	// (v, vt, vn, f) is read; groups, smoothing groups and materials are skipped.
+	class ObjLoader
+	{
+	public:
+		// Same convention as tinyobj::index_t: zero-based, -1 when the attribute is missing
+		struct Index
+		{
+			int32_t vertex = -1;
+			int32_t normal = -1;
+			int32_t texcoord = -1;
+		};
+
+		struct Result
+		{
+			std::vector<float> positions; // xyz per vertex
+			std::vector<float> colors;    // rgb per vertex, 1.0 when the file has no vertex colors
+			std::vector<float> normals;   // xyz per normal
+			std::vector<float> texcoords; // uv per texcoord
+			std::vector<Index> indices;   // triangulated faces, three per triangle
+		};
+
+		static void Load(const std::string& filepath, Result& result);
+		static void Parse(const char* data, size_t size, Result& result);
+	};
+
+}
@@ -2,44 +2,22 @@
 #include "Pipeline.h"
 #include "Model.h"
 
-
 namespace Lotus
 {
-    Pipeline::Pipeline(Device& device, const std::string& vertFilepath,
-        const std::string& fragFilepath, const PipelineConfigInfo& configInfo)
+    Pipeline::Pipeline(Device& device, VkShaderModule vertShaderModule,
+        VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo)
         : m_Device{ device }
     {
-        CreateGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
+        CreateGraphicsPipeline(vertShaderModule, fragShaderModule, configInfo);
     }
 
     Pipeline::~Pipeline()
     {
-        vkDestroyShaderModule(m_Device.GetDevice(), m_VertShaderModule, nullptr);
-        vkDestroyShaderModule(m_Device.GetDevice(), m_FragShaderModule, nullptr);
         vkDestroyPipeline(m_Device.GetDevice(), m_GraphicsPipeline, nullptr);
     }
 
-    std::vector<char> Pipeline::ReadFile(const std::string& filepath)
-    {
-        std::ifstream file{ filepath, std::ios::ate | std::ios::binary };
-
-        if (!file.is_open())
-        {
-            throw std::runtime_error("failed to open file: " + filepath);
-        }
-
-        const size_t fileSize = file.tellg();
-        std::vector<char> buffer(fileSize);
-
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-
-        file.close();
-        return buffer;
-    }
-
-    void Pipeline::CreateGraphicsPipeline(const std::string& vertFilepath,
-        const std::string& fragFilepath, const PipelineConfigInfo& configInfo)
+    void Pipeline::CreateGraphicsPipeline(VkShaderModule vertShaderModule,
+        VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo)
     {
         assert(
             configInfo.pipelineLayout != VK_NULL_HANDLE &&
@@ -49,28 +27,33 @@ namespace Lotus
             configInfo.renderPass != VK_NULL_HANDLE &&
             "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-        const auto vertCode = ReadFile(vertFilepath);
-        const auto fragCode = ReadFile(fragFilepath);
-
-        CreateShaderModule(vertCode, &m_VertShaderModule);
-        CreateShaderModule(fragCode, &m_FragShaderModule);
-
         VkPipelineShaderStageCreateInfo shaderStages[2];
         shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shaderStages[0].module = m_VertShaderModule;
+        shaderStages[0].module = vertShaderModule;
         shaderStages[0].pName = "main";
         shaderStages[0].flags = 0;
         shaderStages[0].pNext = nullptr;
         shaderStages[0].pSpecializationInfo = nullptr;
         shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shaderStages[1].module = m_FragShaderModule;
+        shaderStages[1].module = fragShaderModule;
         shaderStages[1].pName = "main";
         shaderStages[1].flags = 0;
         shaderStages[1].pNext = nullptr;
         shaderStages[1].pSpecializationInfo = nullptr;
 
+        VkSpecializationInfo specializationInfo{};
+        if (!configInfo.specializationEntries.empty())
+        {
+            specializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.specializationEntries.size());
+            specializationInfo.pMapEntries = configInfo.specializationEntries.data();
+            specializationInfo.dataSize = configInfo.specializationData.size();
+            specializationInfo.pData = configInfo.specializationData.data();
+            shaderStages[0].pSpecializationInfo = &specializationInfo;
+            shaderStages[1].pSpecializationInfo = &specializationInfo;
+        }
+
         auto bindingDescriptions = configInfo.bindingDescriptions;
         auto attributeDescriptions = configInfo.attributeDescriptions;
 
@@ -101,9 +84,10 @@ namespace Lotus
         pipelineInfo.basePipelineIndex = -1;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
+        // the device's cache turns compiles seen in an earlier run into a lookup
         if (vkCreateGraphicsPipelines(
             m_Device.GetDevice(),
-            VK_NULL_HANDLE,
+            m_Device.GetPipelineCache(),
             1,
             &pipelineInfo,
             nullptr,
@@ -113,19 +97,6 @@ namespace Lotus
         }
     }
 
-    void Pipeline::CreateShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule)
-    {
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-        if (vkCreateShaderModule(m_Device.GetDevice(), &createInfo, nullptr, shaderModule) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create shader module");
-        }
-    }
-
     void Pipeline::Bind(VkCommandBuffer commandBuffer)
     {
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_GraphicsPipeline);
@@ -221,4 +192,24 @@ namespace Lotus
         configInfo.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
         configInfo.colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
     }
+
+    void Pipeline::SetSpecializationConstant(PipelineConfigInfo& configInfo, uint32_t constantId, uint32_t value)
+    {
+        for (const VkSpecializationMapEntry& entry : configInfo.specializationEntries)
+        {
+            if (entry.constantID == constantId)
+            {
+                memcpy(configInfo.specializationData.data() + entry.offset, &value, sizeof(value));
+                return;
+            }
+        }
+
+        VkSpecializationMapEntry entry{};
+        entry.constantID = constantId;
+        entry.offset = static_cast<uint32_t>(configInfo.specializationData.size());
+        entry.size = sizeof(value);
+        configInfo.specializationEntries.push_back(entry);
+        configInfo.specializationData.resize(configInfo.specializationData.size() + sizeof(value));
+        memcpy(configInfo.specializationData.data() + entry.offset, &value, sizeof(value));
+    }
 }
\ No newline at end of file
@@ -20,18 +20,23 @@ namespace Lotus
         VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
         std::vector<VkDynamicState> dynamicStateEnables;
         VkPipelineDynamicStateCreateInfo dynamicStateInfo;
+        // specialization constants, given to both shader stages; see Pipeline::SetSpecializationConstant
+        std::vector<VkSpecializationMapEntry> specializationEntries{};
+        std::vector<uint8_t> specializationData{};
         VkPipelineLayout pipelineLayout = nullptr;
         VkRenderPass renderPass = nullptr;
         uint32_t subpass = 0;
     };
 
+    // Pipelines are created and owned by the device's PipelineLibrary, which shares shader modules
+    // and identical pipelines between everyone who asks for them
     class Pipeline
     {
     public:
         Pipeline(
             Device& device,
-            const std::string& vertFilepath,
-            const std::string& fragFilepath,
+            VkShaderModule vertShaderModule,
+            VkShaderModule fragShaderModule,
             const PipelineConfigInfo& configInfo);
         ~Pipeline();
 
@@ -44,22 +49,19 @@ namespace Lotus
 
         static void DefaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
         static void EnableAlphaBlending(PipelineConfigInfo& configInfo);
+        // Sets a 32-bit constant (int, uint, float bits or VkBool32) declared with layout(constant_id = ...).
+        // Stages that don't declare the id ignore it
+        static void SetSpecializationConstant(PipelineConfigInfo& configInfo, uint32_t constantId, uint32_t value);
 
     private:
-        static std::vector<char> ReadFile(const std::string& filepath);
-
         void CreateGraphicsPipeline(
-            const std::string& vertFilepath,
-            const std::string& fragFilepath,
+            VkShaderModule vertShaderModule,
+            VkShaderModule fragShaderModule,
             const PipelineConfigInfo& configInfo
         );
 
-        void CreateShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
-
         Device& m_Device;
         VkPipeline m_GraphicsPipeline;
-        VkShaderModule m_VertShaderModule;
-        VkShaderModule m_FragShaderModule;
     };
 }
 
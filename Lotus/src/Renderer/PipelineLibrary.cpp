@@ -0,0 +1,407 @@
+#include "lotuspch.h"
+#include "PipelineLibrary.h"
+
+#include "Device.h"
+#include "Utils/ThreadPool.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+
+namespace Lotus {
+
+    namespace
+    {
+        // Hashes values one by one; whole structs would pull in padding and pNext pointers
+        struct ConfigHasher
+        {
+            uint64_t hash = 0;
+
+            template<typename T>
+            void Add(const T& value) { hash = HashBytes(&value, sizeof(T), hash); }
+
+            template<typename T>
+            void AddArray(const T* values, size_t count)
+            {
+                Add(count);
+                if (count > 0)
+                    hash = HashBytes(values, sizeof(T) * count, hash);
+            }
+        };
+    }
+
+    PipelineLibrary::PipelineLibrary(Device& device)
+        : m_Device{ device }
+    {
+    }
+
+    PipelineLibrary::~PipelineLibrary()
+    {
+        WaitIdle();
+
+        m_Pipelines.clear();
+        for (auto& kv : m_ShaderModules)
+            vkDestroyShaderModule(m_Device.GetDevice(), kv.second.module, nullptr);
+    }
+
+    template<typename Predicate>
+    void PipelineLibrary::WaitForCompiles(std::unique_lock<std::mutex>& lock, Predicate predicate)
+    {
+        // compiles started while the lock was released may match as well, so check again after waiting
+        for (;;)
+        {
+            std::vector<std::shared_future<void>> compiles;
+            for (const auto& kv : m_Pipelines)
+            {
+                if (kv.second.compiling.valid() && predicate(kv))
+                    compiles.push_back(kv.second.compiling);
+            }
+            if (compiles.empty())
+                return;
+
+            lock.unlock();
+            for (const std::shared_future<void>& compile : compiles)
+                compile.wait();
+            lock.lock();
+        }
+    }
+
+    std::vector<Pipeline*> PipelineLibrary::GetPipelines(const std::vector<Request>& requests)
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+
+        struct Compile
+        {
+            uint64_t key;
+            const Request* request;
+            VkShaderModule vertModule;
+            VkShaderModule fragModule;
+            std::unique_ptr<Pipeline> pipeline;
+        };
+
+        std::vector<uint64_t> keys(requests.size());
+        std::vector<Compile> compiles;
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const Request& request = requests[i];
+            assert(request.configInfo != nullptr && "pipeline request without a config");
+
+            VkShaderModule vertModule, fragModule;
+            const uint64_t key = GetKey(request, vertModule, fragModule);
+            keys[i] = key;
+
+            m_Stats.requests++;
+            if (m_Pipelines.count(key) != 0)
+            {
+                m_Stats.reused++;
+                continue;
+            }
+
+            // claimed before compiling, so whoever asks for it meanwhile waits instead of compiling it again
+            Entry& entry = m_Pipelines[key];
+            entry.state = std::make_shared<AsyncPipeline>();
+            entry.pipelineLayout = request.configInfo->pipelineLayout;
+            compiles.push_back({ key, &request, vertModule, fragModule, nullptr });
+        }
+
+        if (!compiles.empty())
+        {
+            std::promise<void> batchDone;
+            const std::shared_future<void> compiling = batchDone.get_future().share();
+            for (const Compile& compile : compiles)
+                m_Pipelines.at(compile.key).compiling = compiling;
+
+            // unlocked, so asynchronous compiles finishing on the workers can publish meanwhile.
+            // Pipeline creation is thread safe and the device's pipeline cache is internally synchronized
+            lock.unlock();
+            std::exception_ptr error;
+            const auto startTime = std::chrono::high_resolution_clock::now();
+            try
+            {
+                ThreadPool::Get().ParallelFor(static_cast<uint32_t>(compiles.size()), [&](uint32_t i)
+                {
+                    Compile& compile = compiles[i];
+                    compile.pipeline = std::make_unique<Pipeline>(m_Device, compile.vertModule, compile.fragModule, *compile.request->configInfo);
+                });
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            const auto endTime = std::chrono::high_resolution_clock::now();
+            const float milliseconds = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+            lock.lock();
+
+            LOTUS_CORE_INFO("Compiled {0} pipelines in {1:.2f} ms ({2} of {3} requests reused)",
+                compiles.size(), milliseconds, requests.size() - compiles.size(), requests.size());
+            m_Stats.compiled += compiles.size();
+            m_Stats.compileMilliseconds += milliseconds;
+
+            for (Compile& compile : compiles)
+                Publish(m_Pipelines.at(compile.key), std::move(compile.pipeline));
+            batchDone.set_value();
+
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        // pipelines of the batch that were already being compiled, asynchronously or by another batch
+        WaitForCompiles(lock, [&keys](const std::pair<const uint64_t, Entry>& kv)
+        {
+            return std::find(keys.begin(), keys.end(), kv.first) != keys.end();
+        });
+
+        std::vector<Pipeline*> pipelines(requests.size());
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            pipelines[i] = m_Pipelines.at(keys[i]).pipeline.get();
+            if (pipelines[i] == nullptr)
+            {
+                throw std::runtime_error("failed to create graphics pipeline!");
+            }
+        }
+        return pipelines;
+    }
+
+    std::shared_ptr<const PipelineLibrary::AsyncPipeline> PipelineLibrary::RequestPipelineAsync(const Request& request)
+    {
+        assert(request.configInfo != nullptr && "pipeline request without a config");
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+
+        VkShaderModule vertModule, fragModule;
+        const uint64_t key = GetKey(request, vertModule, fragModule);
+
+        m_Stats.requests++;
+        auto it = m_Pipelines.find(key);
+        if (it != m_Pipelines.end())
+        {
+            m_Stats.reused++;
+            return it->second.state;
+        }
+
+        // the worker gets its own copy, the caller's config may be gone before it runs
+        auto configInfo = std::make_shared<PipelineConfigInfo>();
+        CopyConfig(*request.configInfo, *configInfo);
+
+        Entry& entry = m_Pipelines[key];
+        entry.state = std::make_shared<AsyncPipeline>();
+        entry.pipelineLayout = configInfo->pipelineLayout;
+        entry.compiling = ThreadPool::Get().Submit([this, key, vertModule, fragModule, configInfo]()
+        {
+            const auto startTime = std::chrono::high_resolution_clock::now();
+            std::unique_ptr<Pipeline> pipeline;
+            try
+            {
+                pipeline = std::make_unique<Pipeline>(m_Device, vertModule, fragModule, *configInfo);
+            }
+            catch (const std::exception& e)
+            {
+                LOTUS_CORE_ERROR("Asynchronous pipeline compile failed: {0}", e.what());
+            }
+            const auto endTime = std::chrono::high_resolution_clock::now();
+
+            // the entry is there: it is only released once its compile has finished
+            std::lock_guard<std::mutex> lock{ m_Mutex };
+            if (pipeline != nullptr)
+            {
+                m_Stats.compiledAsync++;
+                m_Stats.asyncCompileMilliseconds += std::chrono::duration<float, std::milli>(endTime - startTime).count();
+            }
+            Publish(m_Pipelines.at(key), std::move(pipeline));
+        }).share();
+        return entry.state;
+    }
+
+    void PipelineLibrary::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        WaitForCompiles(lock, [](const std::pair<const uint64_t, Entry>&) { return true; });
+    }
+
+    void PipelineLibrary::ReleasePipelines(VkPipelineLayout pipelineLayout)
+    {
+        std::unique_lock<std::mutex> lock{ m_Mutex };
+        WaitForCompiles(lock, [pipelineLayout](const std::pair<const uint64_t, Entry>& kv)
+        {
+            return kv.second.pipelineLayout == pipelineLayout;
+        });
+
+        for (auto it = m_Pipelines.begin(); it != m_Pipelines.end();)
+        {
+            if (it->second.pipelineLayout == pipelineLayout)
+                it = m_Pipelines.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    void PipelineLibrary::Publish(Entry& entry, std::unique_ptr<Pipeline> pipeline)
+    {
+        entry.compiling = {};
+        if (pipeline == nullptr)
+        {
+            entry.state->m_Failed.store(true, std::memory_order_release);
+            return;
+        }
+        entry.pipeline = std::move(pipeline);
+        entry.state->m_Pipeline.store(entry.pipeline.get(), std::memory_order_release);
+    }
+
+    Pipeline* PipelineLibrary::GetPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo)
+    {
+        return GetPipelines({ { vertFilepath, fragFilepath, &configInfo } })[0];
+    }
+
+    uint64_t PipelineLibrary::HashConfig(const PipelineConfigInfo& configInfo)
+    {
+        ConfigHasher hasher;
+        hasher.AddArray(configInfo.bindingDescriptions.data(), configInfo.bindingDescriptions.size());
+        hasher.AddArray(configInfo.attributeDescriptions.data(), configInfo.attributeDescriptions.size());
+
+        // viewports and scissors are dynamic, only their counts are baked in
+        hasher.Add(configInfo.viewportInfo.viewportCount);
+        hasher.Add(configInfo.viewportInfo.scissorCount);
+
+        const VkPipelineInputAssemblyStateCreateInfo& inputAssembly = configInfo.inputAssemblyInfo;
+        hasher.Add(inputAssembly.topology);
+        hasher.Add(inputAssembly.primitiveRestartEnable);
+
+        const VkPipelineRasterizationStateCreateInfo& rasterization = configInfo.rasterizationInfo;
+        hasher.Add(rasterization.depthClampEnable);
+        hasher.Add(rasterization.rasterizerDiscardEnable);
+        hasher.Add(rasterization.polygonMode);
+        hasher.Add(rasterization.cullMode);
+        hasher.Add(rasterization.frontFace);
+        hasher.Add(rasterization.depthBiasEnable);
+        hasher.Add(rasterization.depthBiasConstantFactor);
+        hasher.Add(rasterization.depthBiasClamp);
+        hasher.Add(rasterization.depthBiasSlopeFactor);
+        hasher.Add(rasterization.lineWidth);
+
+        const VkPipelineMultisampleStateCreateInfo& multisample = configInfo.multisampleInfo;
+        hasher.Add(multisample.rasterizationSamples);
+        hasher.Add(multisample.sampleShadingEnable);
+        hasher.Add(multisample.minSampleShading);
+        hasher.Add(multisample.alphaToCoverageEnable);
+        hasher.Add(multisample.alphaToOneEnable);
+        hasher.Add(multisample.pSampleMask != nullptr ? *multisample.pSampleMask : ~0u);
+
+        const VkPipelineColorBlendStateCreateInfo& colorBlend = configInfo.colorBlendInfo;
+        hasher.Add(colorBlend.logicOpEnable);
+        hasher.Add(colorBlend.logicOp);
+        hasher.AddArray(colorBlend.pAttachments, colorBlend.attachmentCount);
+        hasher.Add(colorBlend.blendConstants);
+
+        const VkPipelineDepthStencilStateCreateInfo& depthStencil = configInfo.depthStencilInfo;
+        hasher.Add(depthStencil.depthTestEnable);
+        hasher.Add(depthStencil.depthWriteEnable);
+        hasher.Add(depthStencil.depthCompareOp);
+        hasher.Add(depthStencil.depthBoundsTestEnable);
+        hasher.Add(depthStencil.stencilTestEnable);
+        hasher.Add(depthStencil.front);
+        hasher.Add(depthStencil.back);
+        hasher.Add(depthStencil.minDepthBounds);
+        hasher.Add(depthStencil.maxDepthBounds);
+
+        hasher.AddArray(configInfo.dynamicStateInfo.pDynamicStates, configInfo.dynamicStateInfo.dynamicStateCount);
+        hasher.AddArray(configInfo.specializationEntries.data(), configInfo.specializationEntries.size());
+        hasher.AddArray(configInfo.specializationData.data(), configInfo.specializationData.size());
+
+        // handles are part of the identity: a recreated render pass gets pipelines of its own
+        hasher.Add(configInfo.pipelineLayout);
+        hasher.Add(configInfo.renderPass);
+        hasher.Add(configInfo.subpass);
+        return hasher.hash;
+    }
+
+    PipelineLibrary::Stats PipelineLibrary::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock{ m_Mutex };
+        return m_Stats;
+    }
+
+    uint64_t PipelineLibrary::GetKey(const Request& request, VkShaderModule& vertModule, VkShaderModule& fragModule)
+    {
+        const ShaderModule& vert = GetShaderModule(request.vertFilepath);
+        const ShaderModule& frag = GetShaderModule(request.fragFilepath);
+        vertModule = vert.module;
+        fragModule = frag.module;
+
+        uint64_t key = HashConfig(*request.configInfo);
+        key = HashBytes(&vert.codeHash, sizeof(vert.codeHash), key);
+        key = HashBytes(&frag.codeHash, sizeof(frag.codeHash), key);
+        return key;
+    }
+
+    const PipelineLibrary::ShaderModule& PipelineLibrary::GetShaderModule(const std::string& filepath)
+    {
+        auto it = m_ShaderModules.find(filepath);
+        if (it != m_ShaderModules.end())
+            return it->second;
+
+        const std::vector<char> code = ReadFile(filepath);
+
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = code.size();
+        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        ShaderModule shader{};
+        shader.codeHash = HashBytes(code.data(), code.size());
+        if (vkCreateShaderModule(m_Device.GetDevice(), &createInfo, nullptr, &shader.module) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create shader module");
+        }
+        return m_ShaderModules.emplace(filepath, shader).first->second;
+    }
+
+    void PipelineLibrary::CopyConfig(const PipelineConfigInfo& src, PipelineConfigInfo& dst)
+    {
+        // the pointers DefaultPipelineConfigInfo sets up lead into the config itself
+        assert(src.colorBlendInfo.attachmentCount <= 1 && (src.colorBlendInfo.attachmentCount == 0 || src.colorBlendInfo.pAttachments == &src.colorBlendAttachment)
+            && "color blend attachments must come from colorBlendAttachment");
+        assert(src.dynamicStateInfo.pDynamicStates == src.dynamicStateEnables.data() && "dynamic states must come from dynamicStateEnables");
+        assert(src.multisampleInfo.pSampleMask == nullptr && "sample masks can not be copied");
+
+        dst.bindingDescriptions = src.bindingDescriptions;
+        dst.attributeDescriptions = src.attributeDescriptions;
+        dst.viewportInfo = src.viewportInfo;
+        dst.inputAssemblyInfo = src.inputAssemblyInfo;
+        dst.rasterizationInfo = src.rasterizationInfo;
+        dst.multisampleInfo = src.multisampleInfo;
+        dst.colorBlendAttachment = src.colorBlendAttachment;
+        dst.colorBlendInfo = src.colorBlendInfo;
+        dst.colorBlendInfo.pAttachments = &dst.colorBlendAttachment;
+        dst.depthStencilInfo = src.depthStencilInfo;
+        dst.dynamicStateEnables = src.dynamicStateEnables;
+        dst.dynamicStateInfo = src.dynamicStateInfo;
+        dst.dynamicStateInfo.pDynamicStates = dst.dynamicStateEnables.data();
+        dst.specializationEntries = src.specializationEntries;
+        dst.specializationData = src.specializationData;
+        dst.pipelineLayout = src.pipelineLayout;
+        dst.renderPass = src.renderPass;
+        dst.subpass = src.subpass;
+    }
+
+    std::vector<char> PipelineLibrary::ReadFile(const std::string& filepath)
+    {
+        std::ifstream file{ filepath, std::ios::ate | std::ios::binary };
+
+        if (!file.is_open())
+        {
+            throw std::runtime_error("failed to open file: " + filepath);
+        }
+
+        const size_t fileSize = file.tellg();
+        std::vector<char> buffer(fileSize);
+
+        file.seekg(0);
+        file.read(buffer.data(), fileSize);
+
+        file.close();
+        return buffer;
+    }
+
+}
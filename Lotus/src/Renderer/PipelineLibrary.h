@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Pipeline.h"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Lotus {
+
+	class Device;
+
+	// Owns every pipeline and shader module of the device. A pipeline is identified by a hash of its
+	// PipelineConfigInfo and the contents of its shaders, so asking twice for the same state, from
+	// the same or another system, returns the pipeline compiled the first time. Shader files are read
+	// and turned into modules once, no matter how many pipelines use them.
+	//
+	// GetPipelines compiles everything it does not have yet in parallel on the ThreadPool and waits for
+	// it. RequestPipelineAsync returns at once and compiles on a worker, for variants that show up while
+	// frames are being rendered: the caller draws with a fallback, or skips the draw, until
+	// AsyncPipeline::Get stops returning null. Pipelines live as long as the library.
+	// Thread safe, but don't wait for pipelines from a ThreadPool worker.
+	class PipelineLibrary
+	{
+	public:
+		struct Request
+		{
+			std::string vertFilepath;
+			std::string fragFilepath;
+			const PipelineConfigInfo* configInfo = nullptr;
+		};
+
+		// Compilation state of a pipeline, shared by everyone who requested it
+		class AsyncPipeline
+		{
+		public:
+			// Null until the pipeline is compiled, then the same pipeline until it is released
+			Pipeline* Get() const { return m_Pipeline.load(std::memory_order_acquire); }
+			bool HasFailed() const { return m_Failed.load(std::memory_order_acquire); }
+
+		private:
+			friend class PipelineLibrary;
+			std::atomic<Pipeline*> m_Pipeline{ nullptr };
+			std::atomic<bool> m_Failed{ false };
+		};
+
+		struct Stats
+		{
+			uint64_t requests = 0;
+			uint64_t reused = 0;   // answered with a pipeline compiled or compiling already
+			uint64_t compiled = 0;
+			uint64_t compiledAsync = 0;
+			float compileMilliseconds = 0.0f;      // wall time spent in GetPipelines compiling
+			float asyncCompileMilliseconds = 0.0f; // summed over the workers
+		};
+
+		explicit PipelineLibrary(Device& device);
+		~PipelineLibrary();
+
+		PipelineLibrary(const PipelineLibrary&) = delete;
+		PipelineLibrary& operator=(const PipelineLibrary&) = delete;
+
+		// One pipeline per request, in request order; blocks until all of them are compiled
+		std::vector<Pipeline*> GetPipelines(const std::vector<Request>& requests);
+		Pipeline* GetPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
+
+		// Starts compiling the pipeline on a worker, unless it is compiled or compiling already. The config is
+		// copied and only has to outlive the call; shader modules are still created on the calling thread.
+		std::shared_ptr<const AsyncPipeline> RequestPipelineAsync(const Request& request);
+		// Blocks until every compile started so far has finished
+		void WaitIdle();
+
+		// Destroys the pipelines created with the layout, call before destroying it so a new layout that
+		// reuses the handle value gets pipelines of its own. Waits for their compiles to finish; the
+		// pipelines must no longer be in use.
+		void ReleasePipelines(VkPipelineLayout pipelineLayout);
+
+		// Covers every field vkCreateGraphicsPipelines reads from the config, pointers are followed
+		static uint64_t HashConfig(const PipelineConfigInfo& configInfo);
+
+		Stats GetStats() const;
+
+	private:
+		struct ShaderModule
+		{
+			VkShaderModule module = VK_NULL_HANDLE;
+			uint64_t codeHash = 0; // identity of the shader in pipeline keys
+		};
+
+		struct Entry
+		{
+			std::shared_ptr<AsyncPipeline> state;
+			std::unique_ptr<Pipeline> pipeline; // null while compiling, or when compiling failed
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			std::shared_future<void> compiling; // valid until the pipeline is published
+		};
+
+		// Caller holds m_Mutex
+		const ShaderModule& GetShaderModule(const std::string& filepath);
+		uint64_t GetKey(const Request& request, VkShaderModule& vertModule, VkShaderModule& fragModule);
+		// Stores the compiled pipeline, or records the failure when it is null
+		void Publish(Entry& entry, std::unique_ptr<Pipeline> pipeline);
+		// Waits for the compiles of the entries that match, with the lock released meanwhile; returns
+		// with the lock held and none of those entries compiling
+		template<typename Predicate>
+		void WaitForCompiles(std::unique_lock<std::mutex>& lock, Predicate predicate);
+
+		static void CopyConfig(const PipelineConfigInfo& src, PipelineConfigInfo& dst);
+		static std::vector<char> ReadFile(const std::string& filepath);
+
+	private:
+		Device& m_Device;
+
+		mutable std::mutex m_Mutex;
+		std::unordered_map<std::string, ShaderModule> m_ShaderModules; // keyed on the file path
+		std::unordered_map<uint64_t, Entry> m_Pipelines;
+		Stats m_Stats{};
+	};
+
+}
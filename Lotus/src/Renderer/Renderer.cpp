@@ -1,5 +1,7 @@
 #include "lotuspch.h"
 #include "Renderer.h"
+#include "GeometryArena.h"
+#include "UploadManager.h"
 
 namespace Lotus
 {
@@ -81,6 +83,9 @@ namespace Lotus
             throw std::runtime_error("Failed to acquire swap chain image");
         }
 
+        // the fence of the frame that used this slot has signalled, so its geometry ranges can be reused
+        m_Device.GetGeometryArena().NextFrame();
+
         m_IsFrameStarted = true;
         auto commandBuffer = GetCurrentCommandBuffer();
         VkCommandBufferBeginInfo beginInfo{};
@@ -104,6 +109,9 @@ namespace Lotus
             throw std::runtime_error("Failed to record command buffer");
         }
 
+        // uploads recorded up to now go out first, so this frame can use them
+        m_Device.GetUploadManager().Submit();
+
         auto result = m_SwapChain->SubmitCommandBuffers(&commandBuffer, &m_CurrentImageIndex);
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_Window.Resized())
         {
@@ -17,6 +17,7 @@ namespace Lotus
 
         VkRenderPass GetSwapChainRenderPass() const { return m_SwapChain->GetRenderPass(); }
         float GetAspectRatio() const { return m_SwapChain->ExtentAspectRatio(); }
+        VkExtent2D GetSwapChainExtent() const { return m_SwapChain->GetSwapChainExtent(); }
         bool IsFrameInProgress() const { return m_IsFrameStarted; }
 
         VkCommandBuffer GetCurrentCommandBuffer() const {
@@ -36,7 +36,7 @@ namespace Lotus
         {
             vkDestroyImageView(m_Device.GetDevice(), m_DepthImageViews[i], nullptr);
             vkDestroyImage(m_Device.GetDevice(), m_DepthImages[i], nullptr);
-            vkFreeMemory(m_Device.GetDevice(), m_DepthImageMemorys[i], nullptr);
+            m_Device.FreeMemory(m_DepthImageMemorys[i]);
         }
 
         for (const auto framebuffer : m_SwapChainFramebuffers)
@@ -71,7 +71,7 @@ namespace Lotus
         VkRenderPass m_RenderPass;
 
         std::vector<VkImage> m_DepthImages;
-        std::vector<VkDeviceMemory> m_DepthImageMemorys;
+        std::vector<MemoryAllocation> m_DepthImageMemorys;
         std::vector<VkImageView> m_DepthImageViews;
         std::vector<VkImage> m_SwapChainImages;
         std::vector<VkImageView> m_SwapChainImageViews;
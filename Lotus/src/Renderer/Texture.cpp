@@ -1,6 +1,12 @@
 #include "lotuspch.h"
 #include "Texture.h"
-#include "Buffer.h"
+#include "MipGenerator.h"
+#include "TextureCache.h"
+#include "TextureFile.h"
+#include "UploadManager.h"
+#include "Utils/Utils.h"
+
+#include <cstring>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -16,49 +22,177 @@ namespace Lotus {
         CreateTextureSampler(m_Device);
     }
 
+    Texture::Texture(Device& device, const ImageData& image, uint32_t firstLevel)
+        : m_Device(device)
+    {
+        CreateTextureImage(image, m_Device, firstLevel);
+        CreateTextureImageView(m_Device);
+        CreateTextureSampler(m_Device);
+    }
+
     Texture::~Texture()
     {
-        vkDestroySampler(m_Device.GetDevice(), m_TextureSampler, nullptr);
         vkDestroyImageView(m_Device.GetDevice(), m_TextureImageView, nullptr);
         vkDestroyImage(m_Device.GetDevice(), m_TextureImage, nullptr);
-        vkFreeMemory(m_Device.GetDevice(), m_TextureImageMemory, nullptr);
+        m_Device.FreeMemory(m_TextureImageMemory);
+    }
+
+    void Texture::Decode(const std::string& filePath, ImageData& image, MipGeneration mips)
+    {
+        if (!DecodeTopLevel(filePath, image, mips))
+            FinishDecode(filePath, image, mips);
+    }
+
+    bool Texture::DecodeTopLevel(const std::string& filePath, ImageData& image, MipGeneration mips)
+    {
+        // KTX2 / DDS files already hold GPU-ready levels
+        if (TextureFile::IsTextureFile(filePath))
+        {
+            TextureFile::Load(filePath, image);
+            if (image.levels.size() == 1 && !TextureFile::IsBlockCompressed(image.format))
+            {
+                image.generateMipsOnGpu = mips == MipGeneration::Gpu;
+                if (mips == MipGeneration::Cpu)
+                {
+                    image.DetachFromFile();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // the cache is keyed on the source contents and the mip settings,
+        // so edited files are decoded again automatically
+        const uint64_t sourceHash = HashBytes(&mips, sizeof(mips), TextureCache::HashSourceFile(filePath));
+        const std::string cachePath = TextureCache::GetCachePath(filePath);
+        if (TextureCache::Load(cachePath, sourceHash, image))
+            return true;
+
+        int width, height, texChannels;
+        // Forces the image to be loaded with an alpha channel, even if it doesn't have one
+        stbi_uc* pixels = stbi_load(filePath.c_str(), &width, &height, &texChannels, STBI_rgb_alpha);
+
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image: " + filePath);
+        }
+
+        image.width = static_cast<uint32_t>(width);
+        image.height = static_cast<uint32_t>(height);
+        image.format = VK_FORMAT_R8G8B8A8_SRGB;
+        image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        image.levels = { { image.width, image.height, 0, image.pixels.size() } };
+        image.generateMipsOnGpu = mips == MipGeneration::Gpu;
+
+        stbi_image_free(pixels);
+        image.mappedFile.reset();
+
+        if (mips == MipGeneration::Cpu)
+            return false;
+
+        TextureCache::Write(cachePath, sourceHash, image);
+        return true;
+    }
+
+    void Texture::FinishDecode(const std::string& filePath, ImageData& image, MipGeneration mips)
+    {
+        MipGenerator::Generate(image);
+        if (TextureFile::IsTextureFile(filePath))
+            return;
+
+        const uint64_t sourceHash = HashBytes(&mips, sizeof(mips), TextureCache::HashSourceFile(filePath));
+        TextureCache::Write(TextureCache::GetCachePath(filePath), sourceHash, image);
+    }
+
+    void Texture::ImageData::DetachFromFile()
+    {
+        if (!mappedFile)
+            return;
+
+        std::vector<uint8_t> packed;
+        for (MipLevel& level : levels)
+        {
+            const size_t offset = packed.size();
+            packed.insert(packed.end(), mappedFile->GetData() + level.offset, mappedFile->GetData() + level.offset + level.size);
+            level.offset = offset;
+        }
+        pixels = std::move(packed);
+        mappedFile.reset();
     }
 
     void Texture::CreateTextureImage(std::string filePath, Device& device)
 	{
         // Loading an image /////////////////////////////
-        int texChannels;
-        // Forces the image to be loaded with an alpha channel, even if it doesn't have one
-        stbi_uc* pixels = stbi_load(filePath.c_str(), &m_Width, &m_Height, &texChannels, STBI_rgb_alpha);
+        ImageData image;
+        Decode(filePath, image);
+        CreateTextureImage(image, device);
+    }
 
-        if (!pixels) {
-            throw std::runtime_error("failed to load texture image!");
+    void Texture::CreateTextureImage(const ImageData& image, Device& device, uint32_t firstLevel)
+    {
+        assert(firstLevel < image.levels.size() && "image has no level to start from");
+
+        m_Width = static_cast<int>(image.levels[firstLevel].width);
+        m_Height = static_cast<int>(image.levels[firstLevel].height);
+        m_Format = image.format;
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device.GetPhysicalDevice(), m_Format, &formatProperties);
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+            throw std::runtime_error("texture format " + std::to_string(static_cast<int>(m_Format)) + " is not supported by the device!");
         }
 
-        // Creating a staging buffer /////////////////////////////
+        const ImageData* source = &image;
+        ImageData cpuMips;
+        // compressed levels can't be blitted or filtered, they come with the file or not at all
+        bool blitMips = image.generateMipsOnGpu && image.levels.size() == 1 && !TextureFile::IsBlockCompressed(m_Format);
+        if (blitMips && !SupportsLinearBlit(m_Format))
+        {
+            LOTUS_CORE_WARN("Format {0} can't be blitted with linear filtering, generating mips on the CPU", static_cast<int>(m_Format));
+            cpuMips = image;
+            cpuMips.DetachFromFile();
+            MipGenerator::Generate(cpuMips);
+            source = &cpuMips;
+            blitMips = false;
+        }
 
-        Buffer stagingBuffer(
-			device,
-            4,
-			static_cast<uint32_t>(m_Width * m_Height),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
+        assert((firstLevel == 0 || !blitMips) && "mips blitted on the GPU are always created from the full image");
+        const uint32_t uploadLevels = static_cast<uint32_t>(source->levels.size()) - firstLevel;
+        m_MipLevels = static_cast<int>(blitMips ? MipGenerator::GetMipLevelCount(image.width, image.height) : uploadLevels);
 
-        stagingBuffer.Map();
-        stagingBuffer.WriteToBuffer(pixels);
+        // Creating a staging buffer /////////////////////////////
 
-        stbi_image_free(pixels);
+        // holds every uploaded level so they all go out in one copy; levels are packed
+        // at 16 byte boundaries, which covers every texel block size
+        std::vector<VkDeviceSize> stagingOffsets(uploadLevels);
+        VkDeviceSize stagingSize = 0;
+        for (uint32_t level = 0; level < uploadLevels; level++)
+        {
+            stagingOffsets[level] = stagingSize;
+            stagingSize = (stagingSize + source->levels[firstLevel + level].size + 15) & ~VkDeviceSize(15);
+        }
+
+        UploadManager& uploads = device.GetUploadManager();
+        const UploadManager::StagingAllocation staging = uploads.Stage(stagingSize);
+        for (uint32_t level = 0; level < uploadLevels; level++)
+        {
+            const MipLevel& mip = source->levels[firstLevel + level];
+            memcpy(static_cast<uint8_t*>(staging.data) + stagingOffsets[level], source->GetPixels() + mip.offset, mip.size);
+        }
 
         // Creating the image /////////////////////////////
 
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        if (blitMips)
+            usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
         CreateImage(
             device,
             m_Width,
             m_Height,
-            VK_FORMAT_R8G8B8A8_SRGB,
+            static_cast<uint32_t>(m_MipLevels),
+            m_Format,
             VK_IMAGE_TILING_OPTIMAL, 
-            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
+            usage, 
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
             m_TextureImage,
             m_TextureImageMemory
@@ -66,36 +200,158 @@ namespace Lotus {
 
         // Copying buffer to image /////////////////////////////
 
-        device.TransitionImageLayout(
-            m_TextureImage, 
-            VK_FORMAT_R8G8B8A8_SRGB,
-            VK_IMAGE_LAYOUT_UNDEFINED, 
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            m_LayerCount
-        );
+        // layout transitions, copies and mip blits go into the open upload batch, which is
+        // submitted before the frame that samples the texture; the copies may run on the transfer queue
+        const VkCommandBuffer commandBuffer = uploads.GetCommandBuffer();
 
-        device.CopyBufferToImage(
-            stagingBuffer.GetBuffer(), 
-            m_TextureImage, 
-            static_cast<uint32_t>(m_Width), 
-            static_cast<uint32_t>(m_Height), 
-            m_LayerCount
-        );
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_TextureImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = static_cast<uint32_t>(m_MipLevels);
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = m_LayerCount;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        std::vector<VkBufferImageCopy> regions(uploadLevels);
+        for (uint32_t level = 0; level < uploadLevels; level++)
+        {
+            const MipLevel& mip = source->levels[firstLevel + level];
+            VkBufferImageCopy& region = regions[level];
+            region.bufferOffset = staging.offset + stagingOffsets[level];
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = m_LayerCount;
+            region.imageOffset = { 0, 0, 0 };
+            region.imageExtent = { mip.width, mip.height, 1 };
+        }
+        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, m_TextureImage,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uploadLevels, regions.data());
 
         m_TextureLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-        device.TransitionImageLayout(
-            m_TextureImage, 
-            VK_FORMAT_R8G8B8A8_SRGB, 
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-            m_TextureLayout,
-            m_LayerCount
-        );
+        if (blitMips)
+        {
+            // blits need the graphics queue, the image moves there still waiting for its other levels
+            uploads.HandOverImage(m_TextureImage, barrier.subresourceRange,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+            RecordMipBlits(uploads.GetGraphicsCommandBuffer(), 1);
+        }
+        else
+        {
+            uploads.HandOverImage(m_TextureImage, barrier.subresourceRange,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_TextureLayout,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+	}
 
+    bool Texture::SupportsLinearBlit(VkFormat format) const
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(m_Device.GetPhysicalDevice(), format, &properties);
 
-	}
+        constexpr VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        return (properties.optimalTilingFeatures & required) == required;
+    }
+
+    void Texture::RecordMipBlits(VkCommandBuffer commandBuffer, uint32_t firstLevel)
+    {
+        // every level up to firstLevel is in TRANSFER_DST_OPTIMAL with its data in place;
+        // each iteration turns level - 1 into a blit source, fills level from it and hands level - 1 to the shaders
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_TextureImage;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = m_LayerCount;
+
+        // levels already uploaded above firstLevel - 1 are final
+        if (firstLevel > 1)
+        {
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = firstLevel - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+            barrier.subresourceRange.levelCount = 1;
+        }
+
+        int32_t mipWidth = std::max(1, m_Width >> (firstLevel - 1));
+        int32_t mipHeight = std::max(1, m_Height >> (firstLevel - 1));
+
+        for (uint32_t level = firstLevel; level < static_cast<uint32_t>(m_MipLevels); level++)
+        {
+            barrier.subresourceRange.baseMipLevel = level - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            const int32_t nextWidth = std::max(1, mipWidth / 2);
+            const int32_t nextHeight = std::max(1, mipHeight / 2);
+
+            // sRGB formats are converted to linear before filtering and back when written
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = { 0, 0, 0 };
+            blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = m_LayerCount;
+            blit.dstOffsets[0] = { 0, 0, 0 };
+            blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = m_LayerCount;
+            vkCmdBlitImage(commandBuffer,
+                m_TextureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                m_TextureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit, VK_FILTER_LINEAR);
+
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+            mipWidth = nextWidth;
+            mipHeight = nextHeight;
+        }
+
+        // the last level was only ever written
+        barrier.subresourceRange.baseMipLevel = static_cast<uint32_t>(m_MipLevels) - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
 
-    void Texture::CreateImage(Device& device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory)
+    void Texture::CreateImage(Device& device, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory)
     {
         VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -103,7 +359,7 @@ namespace Lotus {
 		imageInfo.extent.width = width; // width of image extent
 		imageInfo.extent.height = height; // height of image extent
 		imageInfo.extent.depth = 1; // 1 because 2D image
-		imageInfo.mipLevels = 1; // no mip mapping
+		imageInfo.mipLevels = mipLevels; // full chain unless the texture was loaded without mips
 		imageInfo.arrayLayers = 1; // number of layers in image array
 		imageInfo.format = format; // format of image data
 		imageInfo.tiling = tiling; // optimal for GPU access
@@ -122,10 +378,10 @@ namespace Lotus {
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = m_TextureImage;
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+        viewInfo.format = m_Format;
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.levelCount = static_cast<uint32_t>(m_MipLevels);
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
 
@@ -139,7 +395,7 @@ namespace Lotus {
         VkSamplerCreateInfo samplerInfo{};
 		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 		samplerInfo.magFilter = VK_FILTER_NEAREST; // how to render when image is magnified on screen
-		samplerInfo.minFilter = VK_FILTER_NEAREST; // how to render when image is minified on screen
+		samplerInfo.minFilter = VK_FILTER_LINEAR; // how to render when image is minified on screen
 		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT; // how to handle texture coordinates outside of [0, 1] range in U direction
 		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT; // how to handle texture coordinates outside of [0, 1] range in V direction
 		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT; // how to handle texture coordinates outside of [0, 1] range in W direction
@@ -157,12 +413,11 @@ namespace Lotus {
 		// mipmapping
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR; // how to handle mipmapping
 		samplerInfo.minLod = 0.0f; // lower limit of mip level to use
-		samplerInfo.maxLod = 0.0f; // upper limit of mip level to use
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE; // the image view already limits the levels, so textures can share samplers
 		samplerInfo.mipLodBias = 0.0f; // bias for mip level
 
-        if (vkCreateSampler(device.GetDevice(), &samplerInfo, nullptr, &m_TextureSampler) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create texture sampler!");
-		}
+        // owned by the device
+        m_TextureSampler = device.GetSampler(samplerInfo);
     }
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Device.h"
+#include "Utils/MappedFile.h"
 
 #include <vulkan/vulkan.h>
 
@@ -10,8 +11,43 @@ namespace Lotus {
 	class Texture
 	{
 	public:
+		enum class MipGeneration : uint8_t
+		{
+			None,
+			Cpu, // filtered on the decoding thread, see MipGenerator
+			Gpu  // blitted at upload, falls back to Cpu when the format can't be blitted with linear filtering
+		};
+
+		// One level of the mip chain, offset is relative to ImageData::GetPixels()
+		struct MipLevel
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			size_t offset = 0;
+			size_t size = 0;
+		};
+
+		// Decoded texels ready to be uploaded, levels[0] is the full resolution image
+		struct ImageData
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+			std::vector<uint8_t> pixels;
+			std::vector<MipLevel> levels;
+			bool generateMipsOnGpu = false;
+			// When set the levels are read in place from this memory-mapped file and pixels is empty
+			std::shared_ptr<MappedFile> mappedFile;
+
+			const uint8_t* GetPixels() const { return mappedFile ? mappedFile->GetData() : pixels.data(); }
+			// Copies mapped levels into pixels so the image can be modified
+			void DetachFromFile();
+		};
+
 		Texture() = default;
 		Texture(std::string filePath, Device& device);
+		// Uploads levels[firstLevel] onwards, so the texture's level 0 is the image's firstLevel
+		Texture(Device& device, const ImageData& image, uint32_t firstLevel = 0);
 		~Texture();
 
 		Texture(const Texture&) = delete;
@@ -20,22 +56,38 @@ namespace Lotus {
 		Texture& operator=(Texture&&) = delete;
 
 		void Test(std::string fileath, Device& device);
+		// File I/O and decoding only, safe to call from any thread
+		static void Decode(const std::string& filePath, ImageData& image, MipGeneration mips = MipGeneration::Cpu);
+		// Decode split in two, so the top level can be used before the CPU mips exist: returns false when
+		// the image still needs FinishDecode, which generates the mips and writes the cache entry
+		static bool DecodeTopLevel(const std::string& filePath, ImageData& image, MipGeneration mips = MipGeneration::Cpu);
+		static void FinishDecode(const std::string& filePath, ImageData& image, MipGeneration mips = MipGeneration::Cpu);
+
 		void CreateTextureImage(std::string filePath, Device& device);
-		void CreateImage(Device& device, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-						VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+		void CreateTextureImage(const ImageData& image, Device& device, uint32_t firstLevel = 0);
+		void CreateImage(Device& device, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
+						VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory);
 		void CreateTextureImageView(Device& device);
 		void CreateTextureSampler(Device& device);
 
 		VkImageView GetImageView() const { return m_TextureImageView; }
 		VkSampler GetSampler() const { return m_TextureSampler; }
 		VkImageLayout GetImageLayout() const { return m_TextureLayout; }
+		// Size of the image's memory allocation
+		VkDeviceSize GetDeviceSize() const { return m_TextureImageMemory.size; }
+		uint32_t GetMipLevels() const { return static_cast<uint32_t>(m_MipLevels); }
 
 	private:
-		int m_Width, m_Height, m_MipLevels;
+		bool SupportsLinearBlit(VkFormat format) const;
+		// Leaves every level in SHADER_READ_ONLY_OPTIMAL
+		void RecordMipBlits(VkCommandBuffer commandBuffer, uint32_t firstLevel);
+
+		int m_Width, m_Height, m_MipLevels = 1;
+		VkFormat m_Format = VK_FORMAT_R8G8B8A8_SRGB;
 
 		Device& m_Device;
 		VkImage m_TextureImage;
-		VkDeviceMemory m_TextureImageMemory;
+		MemoryAllocation m_TextureImageMemory;
 
 		VkImageView m_TextureImageView;
 		VkSampler m_TextureSampler;
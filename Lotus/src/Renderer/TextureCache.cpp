@@ -0,0 +1,150 @@
+#include "lotuspch.h"
+#include "TextureCache.h"
+#include "TextureFile.h"
+#include "Utils/MappedFile.h"
+#include "Utils/Utils.h"
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace Lotus
+{
+    namespace
+    {
+        // level data is aligned for every block size and for the staging copy
+        constexpr uint64_t DATA_ALIGNMENT = 16;
+
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    std::string TextureCache::GetCachePath(const std::string& sourcePath)
+    {
+        return sourcePath + ".ltex";
+    }
+
+    uint64_t TextureCache::HashSourceFile(const std::string& sourcePath)
+    {
+        MappedFile source;
+        if (!source.Open(sourcePath))
+            throw std::runtime_error("failed to open texture source: " + sourcePath);
+        return HashBytes(source.GetData(), source.GetSize());
+    }
+
+    bool TextureCache::Load(const std::string& cachePath, uint64_t sourceHash, Texture::ImageData& image)
+    {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(cachePath))
+            return false;
+
+        const uint8_t* bytes = file->GetData();
+        const size_t size = file->GetSize();
+        if (size < sizeof(Header))
+            return false;
+
+        Header header;
+        std::memcpy(&header, bytes, sizeof(Header));
+        if (header.magic != MAGIC || header.version != VERSION)
+        {
+            LOTUS_CORE_INFO("Texture cache {0} is outdated, rebuilding", cachePath);
+            return false;
+        }
+        if (header.sourceHash != sourceHash)
+        {
+            LOTUS_CORE_INFO("Texture cache {0} does not match its source, rebuilding", cachePath);
+            return false;
+        }
+
+        const VkFormat format = static_cast<VkFormat>(header.format);
+        if (!TextureFile::IsSupportedFormat(format) || header.levelCount == 0 || header.levelCount > 32 ||
+            header.levelOffset + static_cast<uint64_t>(header.levelCount) * sizeof(Level) > size)
+        {
+            LOTUS_CORE_WARN("Texture cache {0} is truncated or corrupt, rebuilding", cachePath);
+            return false;
+        }
+
+        std::vector<Texture::MipLevel> levels(header.levelCount);
+        for (uint32_t i = 0; i < header.levelCount; i++)
+        {
+            Level level;
+            std::memcpy(&level, bytes + header.levelOffset + i * sizeof(Level), sizeof(Level));
+            if (level.offset % DATA_ALIGNMENT != 0 || level.offset + level.size > size ||
+                level.size != TextureFile::GetLevelSize(format, level.width, level.height))
+            {
+                LOTUS_CORE_WARN("Texture cache {0} is truncated or corrupt, rebuilding", cachePath);
+                return false;
+            }
+            levels[i] = { level.width, level.height, static_cast<size_t>(level.offset), static_cast<size_t>(level.size) };
+        }
+
+        image.width = header.width;
+        image.height = header.height;
+        image.format = format;
+        image.generateMipsOnGpu = header.generateMipsOnGpu != 0;
+        image.levels = std::move(levels);
+        image.pixels.clear();
+        image.mappedFile = std::move(file);
+        return true;
+    }
+
+    void TextureCache::Write(const std::string& cachePath, uint64_t sourceHash, const Texture::ImageData& image)
+    {
+        Header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.sourceHash = sourceHash;
+        header.format = static_cast<uint32_t>(image.format);
+        header.width = image.width;
+        header.height = image.height;
+        header.levelCount = static_cast<uint32_t>(image.levels.size());
+        header.generateMipsOnGpu = image.generateMipsOnGpu ? 1 : 0;
+        header.levelOffset = sizeof(Header);
+
+        std::vector<Level> levels(image.levels.size());
+        uint64_t offset = AlignUp(header.levelOffset + levels.size() * sizeof(Level), DATA_ALIGNMENT);
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            levels[i] = { image.levels[i].width, image.levels[i].height, offset, image.levels[i].size };
+            offset = AlignUp(offset + image.levels[i].size, DATA_ALIGNMENT);
+        }
+
+        // write to a temporary file and rename it, so a crash never leaves a half-written entry behind
+        const std::string tempPath = cachePath + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+        {
+            std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open())
+            {
+                LOTUS_CORE_WARN("Failed to write texture cache {0}", cachePath);
+                return;
+            }
+
+            const char padding[DATA_ALIGNMENT] = {};
+            uint64_t position = sizeof(Header) + levels.size() * sizeof(Level);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+            file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(Level)));
+            for (size_t i = 0; i < levels.size(); i++)
+            {
+                file.write(padding, static_cast<std::streamsize>(levels[i].offset - position));
+                file.write(reinterpret_cast<const char*>(image.GetPixels() + image.levels[i].offset), static_cast<std::streamsize>(levels[i].size));
+                position = levels[i].offset + levels[i].size;
+            }
+
+            if (!file.good())
+            {
+                LOTUS_CORE_WARN("Failed to write texture cache {0}", cachePath);
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        if (error)
+        {
+            LOTUS_CORE_WARN("Failed to write texture cache {0}: {1}", cachePath, error.message());
+            std::filesystem::remove(tempPath, error);
+        }
+    }
+}
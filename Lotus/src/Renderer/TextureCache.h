@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Texture.h"
+
+namespace Lotus {
+
+	// Binary cache (.ltex) of decoded textures. Holds the final GPU-ready texels of every mip level
+	// so later runs can memory-map them and copy them straight into the staging buffer, skipping
+	// PNG inflate, unfiltering and mip generation.
+	//
+	// An entry is only used when its header matches the current format version and the hash of the
+	// source file contents and decode settings; anything else is rebuilt.
+	class TextureCache
+	{
+	public:
+		static constexpr uint32_t MAGIC = 0x5845544C; // "LTEX"
+		static constexpr uint32_t VERSION = 1;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceHash;
+			uint32_t format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t levelCount;
+			uint32_t generateMipsOnGpu;
+			uint32_t reserved;
+			uint64_t levelOffset;
+		};
+
+		struct Level
+		{
+			uint32_t width;
+			uint32_t height;
+			uint64_t offset;
+			uint64_t size;
+		};
+
+		static std::string GetCachePath(const std::string& sourcePath);
+		static uint64_t HashSourceFile(const std::string& sourcePath);
+
+		// On success the image's levels point into the mapped cache file
+		static bool Load(const std::string& cachePath, uint64_t sourceHash, Texture::ImageData& image);
+		static void Write(const std::string& cachePath, uint64_t sourceHash, const Texture::ImageData& image);
+	};
+
+}
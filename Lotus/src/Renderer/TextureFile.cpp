@@ -0,0 +1,461 @@
+#include "lotuspch.h"
+#include "TextureFile.h"
+#include "Utils/MappedFile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace Lotus {
+
+    namespace {
+
+        constexpr uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        // level data is aligned to a multiple of every supported block size and of 4, as the spec asks
+        constexpr size_t KTX2_LEVEL_ALIGNMENT = 16;
+
+        struct Ktx2Header
+        {
+            uint8_t identifier[12];
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+        static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout");
+
+        struct Ktx2LevelIndex
+        {
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        constexpr uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+        constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+        constexpr uint32_t DDPF_FOURCC = 0x4;
+        constexpr uint32_t DDS_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+        constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+        {
+            return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) |
+                (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+        }
+
+        struct DdsPixelFormat
+        {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t fourCC;
+            uint32_t rgbBitCount;
+            uint32_t rBitMask;
+            uint32_t gBitMask;
+            uint32_t bBitMask;
+            uint32_t aBitMask;
+        };
+
+        struct DdsHeader
+        {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t height;
+            uint32_t width;
+            uint32_t pitchOrLinearSize;
+            uint32_t depth;
+            uint32_t mipMapCount;
+            uint32_t reserved1[11];
+            DdsPixelFormat pixelFormat;
+            uint32_t caps;
+            uint32_t caps2;
+            uint32_t caps3;
+            uint32_t caps4;
+            uint32_t reserved2;
+        };
+        static_assert(sizeof(DdsHeader) == 124, "DDS header must match the file layout");
+
+        struct DdsHeaderDx10
+        {
+            uint32_t dxgiFormat;
+            uint32_t resourceDimension;
+            uint32_t miscFlag;
+            uint32_t arraySize;
+            uint32_t miscFlags2;
+        };
+
+        VkFormat FromDxgiFormat(uint32_t dxgiFormat)
+        {
+            switch (dxgiFormat)
+            {
+            case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+            case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+            case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+            case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+            case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+            case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+            case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+            case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+            }
+        }
+
+        // Lays out levelCount back to back levels starting at the full extent and checks them against the file size
+        void ReadLevels(size_t size, size_t firstOffset, uint32_t levelCount, Texture::ImageData& image)
+        {
+            size_t offset = firstOffset;
+            image.levels.clear();
+            for (uint32_t level = 0; level < levelCount; level++)
+            {
+                const uint32_t width = std::max(1u, image.width >> level);
+                const uint32_t height = std::max(1u, image.height >> level);
+                const size_t levelSize = TextureFile::GetLevelSize(image.format, width, height);
+                image.levels.push_back({ width, height, offset, levelSize });
+                offset += levelSize;
+            }
+
+            if (offset > size)
+                throw std::runtime_error("texture file is truncated");
+        }
+
+        // Basic data format descriptor, KTX2 requires one even though this loader never reads it
+        std::vector<uint32_t> BuildDataFormatDescriptor(VkFormat format)
+        {
+            struct Sample
+            {
+                uint32_t bitOffset;
+                uint32_t bitLength;
+                uint32_t channel;
+                uint32_t upper;
+            };
+
+            const bool srgb = format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+                format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+
+            // KHR_DF_MODEL_* and KHR_DF_CHANNEL_* values from the Khronos data format specification
+            uint32_t colorModel = 1; // RGBSDA
+            std::vector<Sample> samples;
+            switch (format)
+            {
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                colorModel = 128;
+                samples = { { 0, 63, 1, UINT32_MAX } }; // color with punch-through alpha
+                break;
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+                colorModel = 130;
+                samples = { { 0, 63, 15, UINT32_MAX }, { 64, 63, 0, UINT32_MAX } };
+                break;
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+                colorModel = 132;
+                samples = { { 0, 63, 0, UINT32_MAX }, { 64, 63, 1, UINT32_MAX } };
+                break;
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+                colorModel = 134;
+                samples = { { 0, 127, 0, UINT32_MAX } };
+                break;
+            default:
+                samples = { { 0, 7, 0, 255 }, { 8, 7, 1, 255 }, { 16, 7, 2, 255 }, { 24, 7, 15, 255 } };
+                break;
+            }
+
+            const bool compressed = TextureFile::IsBlockCompressed(format);
+            const uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+
+            std::vector<uint32_t> words;
+            words.push_back(4 + blockSize);                     // dfdTotalSize
+            words.push_back(0);                                 // vendorId, descriptorType
+            words.push_back(2 | (blockSize << 16));             // versionNumber, descriptorBlockSize
+            words.push_back(colorModel | (1 << 8) | ((srgb ? 2u : 1u) << 16)); // BT709 primaries, transfer function
+            words.push_back(compressed ? 0x0303 : 0);           // texelBlockDimension - 1
+            words.push_back(TextureFile::GetBlockByteSize(format)); // bytesPlane0
+            words.push_back(0);
+            for (const Sample& sample : samples)
+            {
+                // alpha is linear even in sRGB formats
+                const uint32_t qualifiers = sample.channel == 15 && srgb ? 0x10 : 0;
+                words.push_back(sample.bitOffset | (sample.bitLength << 16) | ((sample.channel | qualifiers) << 24));
+                words.push_back(0);
+                words.push_back(0);
+                words.push_back(sample.upper);
+            }
+            return words;
+        }
+
+        size_t AlignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+    }
+
+    bool TextureFile::IsTextureFile(const std::string& filePath)
+    {
+        std::string extension = std::filesystem::path(filePath).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".ktx2" || extension == ".dds";
+    }
+
+    void TextureFile::Load(const std::string& filePath, Texture::ImageData& image)
+    {
+        auto file = std::make_shared<MappedFile>();
+        if (!file->Open(filePath))
+            throw std::runtime_error("failed to open texture file: " + filePath);
+
+        try
+        {
+            if (file->GetSize() >= sizeof(KTX2_IDENTIFIER) && std::memcmp(file->GetData(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+                LoadKtx2(file->GetData(), file->GetSize(), image);
+            else
+                LoadDds(file->GetData(), file->GetSize(), image);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error(std::string(e.what()) + ": " + filePath);
+        }
+
+        // the levels are uploaded straight from the mapping
+        image.pixels.clear();
+        image.mappedFile = std::move(file);
+    }
+
+    void TextureFile::LoadKtx2(const uint8_t* data, size_t size, Texture::ImageData& image)
+    {
+        Ktx2Header header;
+        if (size < sizeof(header))
+            throw std::runtime_error("KTX2 file is truncated");
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+            throw std::runtime_error("not a KTX2 file");
+        if (header.supercompressionScheme != 0)
+            throw std::runtime_error("supercompressed KTX2 files are not supported");
+        if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1)
+            throw std::runtime_error("only 2D KTX2 textures are supported");
+
+        image.format = static_cast<VkFormat>(header.vkFormat);
+        if (!IsSupportedFormat(image.format))
+            throw std::runtime_error("unsupported KTX2 format " + std::to_string(header.vkFormat));
+
+        image.width = header.pixelWidth;
+        image.height = header.pixelHeight;
+        image.generateMipsOnGpu = false;
+        if (image.width == 0 || image.height == 0)
+            throw std::runtime_error("KTX2 texture has no extent");
+
+        // zero levels asks the loader to generate mips, which only uncompressed formats allow
+        const uint32_t levelCount = std::max(1u, header.levelCount);
+        if (levelCount > 32 || sizeof(header) + levelCount * sizeof(Ktx2LevelIndex) > size)
+            throw std::runtime_error("KTX2 level index is out of range");
+
+        // levels are stored smallest first; the level index gives each one's place in the file
+        std::vector<Ktx2LevelIndex> index(levelCount);
+        std::memcpy(index.data(), data + sizeof(header), levelCount * sizeof(Ktx2LevelIndex));
+
+        image.levels.clear();
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            const uint32_t width = std::max(1u, image.width >> level);
+            const uint32_t height = std::max(1u, image.height >> level);
+            const size_t levelSize = GetLevelSize(image.format, width, height);
+            if (index[level].byteLength != levelSize || index[level].byteOffset > size || size - index[level].byteOffset < levelSize)
+                throw std::runtime_error("KTX2 level " + std::to_string(level) + " is out of range");
+            image.levels.push_back({ width, height, static_cast<size_t>(index[level].byteOffset), levelSize });
+        }
+    }
+
+    void TextureFile::LoadDds(const uint8_t* data, size_t size, Texture::ImageData& image)
+    {
+        uint32_t magic;
+        DdsHeader header;
+        if (size < sizeof(magic) + sizeof(header))
+            throw std::runtime_error("DDS file is truncated");
+        std::memcpy(&magic, data, sizeof(magic));
+        std::memcpy(&header, data + sizeof(magic), sizeof(header));
+        if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader))
+            throw std::runtime_error("not a DDS file");
+
+        size_t dataOffset = sizeof(magic) + sizeof(header);
+        image.format = VK_FORMAT_UNDEFINED;
+
+        if (header.pixelFormat.flags & DDPF_FOURCC)
+        {
+            switch (header.pixelFormat.fourCC)
+            {
+            case MakeFourCC('D', 'X', 'T', '1'): image.format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK; break;
+            case MakeFourCC('D', 'X', 'T', '5'): image.format = VK_FORMAT_BC3_UNORM_BLOCK; break;
+            case MakeFourCC('A', 'T', 'I', '2'):
+            case MakeFourCC('B', 'C', '5', 'U'): image.format = VK_FORMAT_BC5_UNORM_BLOCK; break;
+            case MakeFourCC('D', 'X', '1', '0'):
+            {
+                DdsHeaderDx10 dx10;
+                if (size < dataOffset + sizeof(dx10))
+                    throw std::runtime_error("DDS file is truncated");
+                std::memcpy(&dx10, data + dataOffset, sizeof(dx10));
+                dataOffset += sizeof(dx10);
+
+                if (dx10.resourceDimension != DDS_RESOURCE_DIMENSION_TEXTURE2D || dx10.arraySize > 1)
+                    throw std::runtime_error("only 2D DDS textures are supported");
+                image.format = FromDxgiFormat(dx10.dxgiFormat);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        else if (header.pixelFormat.rgbBitCount == 32 && header.pixelFormat.rBitMask == 0x000000FF &&
+            header.pixelFormat.gBitMask == 0x0000FF00 && header.pixelFormat.bBitMask == 0x00FF0000)
+        {
+            image.format = VK_FORMAT_R8G8B8A8_UNORM;
+        }
+
+        if (!IsSupportedFormat(image.format))
+            throw std::runtime_error("unsupported DDS format");
+
+        image.width = header.width;
+        image.height = header.height;
+        image.generateMipsOnGpu = false;
+        if (image.width == 0 || image.height == 0)
+            throw std::runtime_error("DDS texture has no extent");
+
+        const uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+        if (levelCount > 32)
+            throw std::runtime_error("DDS level count is out of range");
+
+        // DDS stores levels largest first and back to back
+        ReadLevels(size, dataOffset, levelCount, image);
+    }
+
+    void TextureFile::WriteKtx2(const std::string& filePath, const Texture::ImageData& image)
+    {
+        assert(IsSupportedFormat(image.format) && "format can't be stored");
+
+        const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+        const std::vector<uint32_t> dfd = BuildDataFormatDescriptor(image.format);
+
+        Ktx2Header header{};
+        std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+        header.vkFormat = static_cast<uint32_t>(image.format);
+        header.typeSize = 1;
+        header.pixelWidth = image.width;
+        header.pixelHeight = image.height;
+        header.pixelDepth = 0;
+        header.layerCount = 0;
+        header.faceCount = 1;
+        header.levelCount = levelCount;
+        header.supercompressionScheme = 0;
+        header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex));
+        header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+        // smallest level first, each one aligned
+        std::vector<Ktx2LevelIndex> index(levelCount);
+        size_t offset = header.dfdByteOffset + header.dfdByteLength;
+        for (uint32_t level = levelCount; level-- > 0;)
+        {
+            offset = AlignUp(offset, KTX2_LEVEL_ALIGNMENT);
+            index[level] = { offset, image.levels[level].size, image.levels[level].size };
+            offset += image.levels[level].size;
+        }
+
+        // same write-then-rename as the mesh cache, so readers never see a partial file
+        const std::string tempPath = filePath + ".tmp";
+        {
+            std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+            if (!file.is_open())
+                throw std::runtime_error("failed to write texture file: " + filePath);
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2LevelIndex));
+            file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+
+            size_t position = header.dfdByteOffset + header.dfdByteLength;
+            const char padding[KTX2_LEVEL_ALIGNMENT] = {};
+            for (uint32_t level = levelCount; level-- > 0;)
+            {
+                file.write(padding, index[level].byteOffset - position);
+                file.write(reinterpret_cast<const char*>(image.GetPixels() + image.levels[level].offset), image.levels[level].size);
+                position = index[level].byteOffset + image.levels[level].size;
+            }
+
+            if (!file.good())
+                throw std::runtime_error("failed to write texture file: " + filePath);
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, filePath, error);
+        if (error)
+        {
+            std::filesystem::remove(tempPath, error);
+            throw std::runtime_error("failed to write texture file: " + filePath);
+        }
+    }
+
+    bool TextureFile::IsSupportedFormat(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool TextureFile::IsBlockCompressed(VkFormat format)
+    {
+        return IsSupportedFormat(format) && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB;
+    }
+
+    uint32_t TextureFile::GetBlockByteSize(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            return 8;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    size_t TextureFile::GetLevelSize(VkFormat format, uint32_t width, uint32_t height)
+    {
+        if (!IsBlockCompressed(format))
+            return static_cast<size_t>(width) * height * GetBlockByteSize(format);
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * GetBlockByteSize(format);
+    }
+
+}
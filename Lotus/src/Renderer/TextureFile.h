@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Texture.h"
+
+#include <cstdint>
+#include <string>
+
+namespace Lotus {
+
+	// Reads textures stored in GPU formats: KTX2 (uncompressed, no supercompression) and DDS
+	// (DXT1/DXT5/ATI2 and DX10 headers). Supported formats are RGBA8 and BC1/BC3/BC5/BC7;
+	// every mip level in the file is kept so nothing has to be generated at load time.
+	class TextureFile
+	{
+	public:
+		static bool IsTextureFile(const std::string& filePath);
+		// Throws when the file is malformed or uses a format the engine can't sample
+		static void Load(const std::string& filePath, Texture::ImageData& image);
+
+		// Level offsets are relative to data, which has to outlive the image; Load keeps the file mapped for that
+		static void LoadKtx2(const uint8_t* data, size_t size, Texture::ImageData& image);
+		static void LoadDds(const uint8_t* data, size_t size, Texture::ImageData& image);
+		static void WriteKtx2(const std::string& filePath, const Texture::ImageData& image);
+
+		static bool IsSupportedFormat(VkFormat format);
+		static bool IsBlockCompressed(VkFormat format);
+		// Bytes per 4x4 block for compressed formats, per texel otherwise
+		static uint32_t GetBlockByteSize(VkFormat format);
+		static size_t GetLevelSize(VkFormat format, uint32_t width, uint32_t height);
+	};
+
+}
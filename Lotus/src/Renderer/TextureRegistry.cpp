@@ -0,0 +1,172 @@
+#include "lotuspch.h"
+#include "TextureRegistry.h"
+
+#include <algorithm>
+
+namespace Lotus {
+
+    TextureRegistry::TextureRegistry(Device& device)
+        : m_Device{ device }
+    {
+        // the update-after-bind limits are the ones that allow thousands of textures in one set
+        VkPhysicalDeviceVulkan12Properties properties12{};
+        properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &properties12;
+        vkGetPhysicalDeviceProperties2(m_Device.GetPhysicalDevice(), &properties);
+
+        m_Capacity = std::min({ MAX_TEXTURES,
+            properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+            properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            properties12.maxDescriptorSetUpdateAfterBindSamplers,
+            properties12.maxDescriptorSetUpdateAfterBindSampledImages });
+
+        m_SetLayout =
+            DescriptorSetLayout::Builder(m_Device)
+            .AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, m_Capacity,
+                VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT)
+            .Build();
+
+        m_Pool =
+            DescriptorPool::Builder(m_Device)
+            .SetMaxSets(SwapChain::MAX_FRAMES_IN_FLIGHT)
+            .AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_Capacity * SwapChain::MAX_FRAMES_IN_FLIGHT)
+            .SetPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT)
+            .Build();
+
+        Texture::ImageData white;
+        white.width = 1;
+        white.height = 1;
+        white.pixels = { 255, 255, 255, 255 };
+        white.levels = { { 1, 1, 0, 4 } };
+        m_DefaultTexture = std::make_shared<Texture>(m_Device, white);
+
+        // every slot starts out as the default texture, so a stale index never reads an unwritten descriptor
+        VkDescriptorImageInfo defaultInfo{};
+        defaultInfo.sampler = m_DefaultTexture->GetSampler();
+        defaultInfo.imageView = m_DefaultTexture->GetImageView();
+        defaultInfo.imageLayout = m_DefaultTexture->GetImageLayout();
+        const std::vector<VkDescriptorImageInfo> defaultInfos(m_Capacity, defaultInfo);
+
+        for (VkDescriptorSet& set : m_DescriptorSets)
+        {
+            if (!m_Pool->AllocateDescriptorSets(m_SetLayout->GetDescriptorSetLayout(), set))
+            {
+                throw std::runtime_error("failed to allocate the bindless texture set!");
+            }
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = 0;
+            write.dstArrayElement = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = m_Capacity;
+            write.pImageInfo = defaultInfos.data();
+            vkUpdateDescriptorSets(m_Device.GetDevice(), 1, &write, 0, nullptr);
+        }
+
+        Slot& defaultSlot = m_Slots.emplace_back();
+        defaultSlot.texture = m_DefaultTexture;
+        defaultSlot.bound.fill(m_DefaultTexture);
+    }
+
+    uint32_t TextureRegistry::Register(std::shared_ptr<Texture> texture)
+    {
+        uint32_t index;
+        if (!m_FreeSlots.empty())
+        {
+            index = m_FreeSlots.back();
+            m_FreeSlots.pop_back();
+        }
+        else
+        {
+            if (m_Slots.size() >= m_Capacity)
+            {
+                throw std::runtime_error("bindless texture table is full!");
+            }
+            index = static_cast<uint32_t>(m_Slots.size());
+            m_Slots.emplace_back();
+        }
+
+        m_Slots[index].texture = std::move(texture);
+        m_TextureCount++;
+        MarkDirty(index);
+        return index;
+    }
+
+    void TextureRegistry::Replace(uint32_t index, std::shared_ptr<Texture> texture)
+    {
+        assert(index != DEFAULT_TEXTURE_INDEX && index < m_Slots.size() && !m_Slots[index].released && "texture index is not registered");
+
+        m_Slots[index].texture = std::move(texture);
+        MarkDirty(index);
+    }
+
+    void TextureRegistry::Release(uint32_t index)
+    {
+        assert(index != DEFAULT_TEXTURE_INDEX && index < m_Slots.size() && !m_Slots[index].released && "texture index is not registered");
+
+        // the slot goes back to the default texture in every set before it is reused
+        m_Slots[index].texture.reset();
+        m_Slots[index].released = true;
+        m_TextureCount--;
+        MarkDirty(index);
+    }
+
+    void TextureRegistry::Update(int frameIndex)
+    {
+        const uint32_t frameBit = 1u << frameIndex;
+
+        // reserved up front, the writes point into it
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        imageInfos.reserve(m_DirtySlots.size());
+        DescriptorWriter writer{ *m_SetLayout, *m_Pool };
+
+        size_t remaining = 0;
+        for (uint32_t index : m_DirtySlots)
+        {
+            Slot& slot = m_Slots[index];
+            if (slot.pendingFrames & frameBit)
+            {
+                const std::shared_ptr<Texture>& texture = slot.texture ? slot.texture : m_DefaultTexture;
+                VkDescriptorImageInfo& imageInfo = imageInfos.emplace_back();
+                imageInfo.sampler = texture->GetSampler();
+                imageInfo.imageView = texture->GetImageView();
+                imageInfo.imageLayout = texture->GetImageLayout();
+                writer.WriteImage(0, &imageInfo, index);
+
+                slot.bound[frameIndex] = texture;
+                slot.pendingFrames &= ~frameBit;
+            }
+
+            if (slot.pendingFrames != 0)
+            {
+                m_DirtySlots[remaining++] = index;
+            }
+            else if (slot.released)
+            {
+                slot.released = false;
+                m_FreeSlots.push_back(index);
+            }
+        }
+        m_DirtySlots.resize(remaining);
+
+        if (!imageInfos.empty())
+        {
+            writer.Overwrite(m_DescriptorSets[frameIndex]);
+        }
+    }
+
+    void TextureRegistry::MarkDirty(uint32_t index)
+    {
+        Slot& slot = m_Slots[index];
+        if (slot.pendingFrames == 0)
+        {
+            m_DirtySlots.push_back(index);
+        }
+        slot.pendingFrames = (1u << SwapChain::MAX_FRAMES_IN_FLIGHT) - 1;
+    }
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Descriptors.h"
+#include "SwapChain.h"
+#include "Texture.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace Lotus {
+
+	// Bindless texture table: one large array of combined image samplers (set 1, binding 0) that
+	// shaders index with a per-object texture index, so differently textured objects are drawn
+	// with one pipeline and one descriptor set bind.
+	//
+	// An index stays valid until it is released; Replace points it at another texture, e.g. when
+	// the streamer changes the resident levels. There is one set per frame in flight and a frame's
+	// set is only written in Update, once that frame's previous submission has finished. Every set
+	// holds a reference to the textures it points at, so a replaced texture lives on until no set uses it.
+	class TextureRegistry
+	{
+	public:
+		static constexpr uint32_t MAX_TEXTURES = 4096;
+		// 1x1 white texture, used by objects without a texture and by every slot that is not registered
+		static constexpr uint32_t DEFAULT_TEXTURE_INDEX = 0;
+
+		explicit TextureRegistry(Device& device);
+
+		TextureRegistry(const TextureRegistry&) = delete;
+		TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+		// Returns the texture's index; a null texture reserves an index that shows the default texture until Replace
+		uint32_t Register(std::shared_ptr<Texture> texture);
+		void Replace(uint32_t index, std::shared_ptr<Texture> texture);
+		// The index is handed out again once no frame in flight can read it
+		void Release(uint32_t index);
+
+		// Call once per frame after BeginFrame and before the frame's set is bound: writes the changes
+		// made since the frame's set was last written
+		void Update(int frameIndex);
+
+		VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_SetLayout->GetDescriptorSetLayout(); }
+		VkDescriptorSet GetDescriptorSet(int frameIndex) const { return m_DescriptorSets[frameIndex]; }
+		uint32_t GetCapacity() const { return m_Capacity; }
+		uint32_t GetTextureCount() const { return m_TextureCount; }
+
+	private:
+		struct Slot
+		{
+			std::shared_ptr<Texture> texture; // null shows the default texture
+			// what each frame's set points at, keeps the texture alive while it is referenced
+			std::array<std::shared_ptr<Texture>, SwapChain::MAX_FRAMES_IN_FLIGHT> bound;
+			uint32_t pendingFrames = 0; // one bit per frame whose set is out of date
+			bool released = false;
+		};
+
+		void MarkDirty(uint32_t index);
+
+	private:
+		Device& m_Device;
+		uint32_t m_Capacity = 0;
+
+		std::unique_ptr<DescriptorSetLayout> m_SetLayout;
+		std::unique_ptr<DescriptorPool> m_Pool;
+		std::array<VkDescriptorSet, SwapChain::MAX_FRAMES_IN_FLIGHT> m_DescriptorSets{};
+		std::shared_ptr<Texture> m_DefaultTexture;
+
+		std::vector<Slot> m_Slots;
+		std::vector<uint32_t> m_FreeSlots;
+		std::vector<uint32_t> m_DirtySlots;
+		uint32_t m_TextureCount = 0;
+	};
+
+}
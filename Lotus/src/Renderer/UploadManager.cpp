@@ -0,0 +1,407 @@
+#include "lotuspch.h"
+#include "UploadManager.h"
+
+#include "Device.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace Lotus {
+
+    UploadManager::UploadManager(Device& device, VkDeviceSize ringSize)
+        : m_Device{ device }, m_Dedicated{ device.HasDedicatedTransferQueue() }, m_RingSize{ ringSize }
+    {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = m_Device.TransferQueueFamily();
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        if (vkCreateCommandPool(m_Device.GetDevice(), &poolInfo, nullptr, &m_CommandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+
+        if (m_Dedicated)
+        {
+            poolInfo.queueFamilyIndex = m_Device.GraphicsQueueFamily();
+            if (vkCreateCommandPool(m_Device.GetDevice(), &poolInfo, nullptr, &m_GraphicsCommandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create upload command pool!");
+            }
+        }
+
+        m_Device.CreateBuffer(
+            m_RingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            m_RingBuffer,
+            m_RingMemory);
+    }
+
+    UploadManager::~UploadManager()
+    {
+        WaitIdle();
+
+        for (const Batch& batch : m_FreeBatches)
+        {
+            vkDestroyFence(m_Device.GetDevice(), batch.fence, nullptr);
+            if (batch.copiesDone != VK_NULL_HANDLE)
+                vkDestroySemaphore(m_Device.GetDevice(), batch.copiesDone, nullptr);
+        }
+        vkDestroyCommandPool(m_Device.GetDevice(), m_CommandPool, nullptr);
+        if (m_GraphicsCommandPool != VK_NULL_HANDLE)
+            vkDestroyCommandPool(m_Device.GetDevice(), m_GraphicsCommandPool, nullptr);
+
+        vkDestroyBuffer(m_Device.GetDevice(), m_RingBuffer, nullptr);
+        m_Device.FreeMemory(m_RingMemory);
+    }
+
+    UploadManager::StagingAllocation UploadManager::Stage(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        assert(size > 0 && "can't stage zero bytes");
+        assert((alignment & (alignment - 1)) == 0 && m_RingSize % alignment == 0 && "staging alignment must be a power of two");
+
+        m_Stats.stagingCount++;
+        m_Stats.stagedBytes += size;
+        StagingAllocation staging;
+
+        // would block the ring for everything else, a buffer of its own is cheaper
+        if (size > m_RingSize / 2)
+        {
+            if (!m_Recording)
+                BeginBatch();
+
+            VkBuffer buffer;
+            MemoryAllocation memory;
+            m_Device.CreateBuffer(
+                size,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                buffer,
+                memory);
+            m_Open.oversized.emplace_back(buffer, memory);
+
+            staging.data = memory.mapped;
+            staging.buffer = buffer;
+            return staging;
+        }
+
+        Retire();
+
+        VkDeviceSize offset;
+        while (!TryAllocate(size, alignment, offset))
+        {
+            // the open batch's own staging only frees up once it has been submitted
+            if (m_Recording)
+                Submit();
+
+            if (m_InFlight.empty())
+            {
+                // nothing is in use, start over at the beginning of the ring
+                m_RingHead = (m_RingHead + m_RingSize - 1) / m_RingSize * m_RingSize;
+                m_RingTail = m_RingHead;
+                continue;
+            }
+
+            m_Stats.stallCount++;
+            WaitForOldest();
+        }
+
+        if (!m_Recording)
+            BeginBatch();
+
+        staging.data = static_cast<char*>(m_RingMemory.mapped) + offset;
+        staging.buffer = m_RingBuffer;
+        staging.offset = offset;
+        return staging;
+    }
+
+    void UploadManager::CopyToBuffer(const StagingAllocation& staging, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = staging.offset;
+        copyRegion.dstOffset = dstOffset;
+        copyRegion.size = size;
+        vkCmdCopyBuffer(GetCommandBuffer(), staging.buffer, dstBuffer, 1, &copyRegion);
+
+        // on a single queue the barrier at the end of the batch covers every copy
+        if (m_Dedicated)
+        {
+            HandOverBuffer(dstBuffer, dstOffset, size,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+        }
+    }
+
+    void UploadManager::UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+    {
+        const StagingAllocation staging = Stage(size);
+        memcpy(staging.data, data, size);
+        CopyToBuffer(staging, dstBuffer, size, dstOffset);
+    }
+
+    VkCommandBuffer UploadManager::GetCommandBuffer()
+    {
+        if (!m_Recording)
+            BeginBatch();
+        return m_Open.commandBuffer;
+    }
+
+    VkCommandBuffer UploadManager::GetGraphicsCommandBuffer()
+    {
+        if (!m_Recording)
+            BeginBatch();
+        return m_Dedicated ? m_Open.graphicsCommandBuffer : m_Open.commandBuffer;
+    }
+
+    void UploadManager::HandOverBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+
+        if (!m_Dedicated)
+        {
+            vkCmdPipelineBarrier(GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
+            return;
+        }
+
+        // the release and the acquire have to match, apart from the access masks each side ignores
+        barrier.srcQueueFamilyIndex = m_Device.TransferQueueFamily();
+        barrier.dstQueueFamilyIndex = m_Device.GraphicsQueueFamily();
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(GetGraphicsCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+            0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    void UploadManager::HandOverImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+        VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+    {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = range;
+
+        if (!m_Dedicated)
+        {
+            vkCmdPipelineBarrier(GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return;
+        }
+
+        // both halves carry the same layout change, it happens once between the release and the acquire
+        barrier.srcQueueFamilyIndex = m_Device.TransferQueueFamily();
+        barrier.dstQueueFamilyIndex = m_Device.GraphicsQueueFamily();
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(GetCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(GetGraphicsCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    UploadManager::UploadId UploadManager::Submit()
+    {
+        if (!m_Recording)
+            return m_NextId - 1;
+
+        if (!m_Dedicated)
+        {
+            // one barrier for every buffer copied in the batch; images are handed over where they are recorded
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(m_Open.commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        if (vkEndCommandBuffer(m_Open.commandBuffer) != VK_SUCCESS ||
+            (m_Dedicated && vkEndCommandBuffer(m_Open.graphicsCommandBuffer) != VK_SUCCESS))
+        {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_Open.commandBuffer;
+        if (m_Dedicated)
+        {
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &m_Open.copiesDone;
+        }
+
+        if (vkQueueSubmit(m_Device.TransferQueue(), 1, &submitInfo, m_Dedicated ? VK_NULL_HANDLE : m_Open.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit upload command buffer!");
+        }
+
+        if (m_Dedicated)
+        {
+            // the acquires wait for the copies; the frame submitted after this waits for the acquires
+            // through their barriers, not for the transfer queue as a whole
+            const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            VkSubmitInfo acquireInfo{};
+            acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquireInfo.waitSemaphoreCount = 1;
+            acquireInfo.pWaitSemaphores = &m_Open.copiesDone;
+            acquireInfo.pWaitDstStageMask = &waitStage;
+            acquireInfo.commandBufferCount = 1;
+            acquireInfo.pCommandBuffers = &m_Open.graphicsCommandBuffer;
+
+            if (vkQueueSubmit(m_Device.GraphicsQueue(), 1, &acquireInfo, m_Open.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+        }
+
+        m_Open.ringEnd = m_RingHead;
+        m_InFlight.push_back(std::move(m_Open));
+        m_Open = {};
+        m_Recording = false;
+        m_Stats.submittedBatches++;
+        return m_NextId++;
+    }
+
+    bool UploadManager::IsComplete(UploadId id)
+    {
+        Retire();
+        return id <= m_CompletedId;
+    }
+
+    void UploadManager::Wait(UploadId id)
+    {
+        if (id >= m_NextId)
+            Submit();
+
+        while (m_CompletedId < id && !m_InFlight.empty())
+            WaitForOldest();
+    }
+
+    void UploadManager::BeginBatch()
+    {
+        if (!m_FreeBatches.empty())
+        {
+            m_Open = std::move(m_FreeBatches.back());
+            m_FreeBatches.pop_back();
+        }
+        else
+        {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = m_CommandPool;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(m_Device.GetDevice(), &allocInfo, &m_Open.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate upload command buffer!");
+            }
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(m_Device.GetDevice(), &fenceInfo, nullptr, &m_Open.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create upload fence!");
+            }
+
+            if (m_Dedicated)
+            {
+                allocInfo.commandPool = m_GraphicsCommandPool;
+                if (vkAllocateCommandBuffers(m_Device.GetDevice(), &allocInfo, &m_Open.graphicsCommandBuffer) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to allocate upload command buffer!");
+                }
+
+                VkSemaphoreCreateInfo semaphoreInfo{};
+                semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+                if (vkCreateSemaphore(m_Device.GetDevice(), &semaphoreInfo, nullptr, &m_Open.copiesDone) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to create upload semaphore!");
+                }
+            }
+        }
+
+        m_Open.id = m_NextId;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(m_Open.commandBuffer, &beginInfo);
+        if (m_Dedicated)
+            vkBeginCommandBuffer(m_Open.graphicsCommandBuffer, &beginInfo);
+        m_Recording = true;
+    }
+
+    bool UploadManager::TryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+    {
+        const VkDeviceSize position = m_RingHead % m_RingSize;
+        VkDeviceSize alignedPosition = (position + alignment - 1) & ~(alignment - 1);
+        // ranges never wrap around the end, the rest of the lap is skipped instead
+        if (alignedPosition + size > m_RingSize)
+            alignedPosition = m_RingSize;
+
+        const uint64_t begin = m_RingHead - position + alignedPosition;
+        if (begin + size - m_RingTail > m_RingSize)
+            return false;
+
+        offset = begin % m_RingSize;
+        m_RingHead = begin + size;
+        return true;
+    }
+
+    void UploadManager::Retire()
+    {
+        while (!m_InFlight.empty() && vkGetFenceStatus(m_Device.GetDevice(), m_InFlight.front().fence) == VK_SUCCESS)
+        {
+            Batch batch = std::move(m_InFlight.front());
+            m_InFlight.pop_front();
+
+            for (auto& [buffer, memory] : batch.oversized)
+            {
+                vkDestroyBuffer(m_Device.GetDevice(), buffer, nullptr);
+                m_Device.FreeMemory(memory);
+            }
+            batch.oversized.clear();
+
+            vkResetCommandBuffer(batch.commandBuffer, 0);
+            if (batch.graphicsCommandBuffer != VK_NULL_HANDLE)
+                vkResetCommandBuffer(batch.graphicsCommandBuffer, 0);
+            vkResetFences(m_Device.GetDevice(), 1, &batch.fence);
+
+            m_RingTail = batch.ringEnd;
+            m_CompletedId = batch.id;
+            m_FreeBatches.push_back(std::move(batch));
+        }
+    }
+
+    void UploadManager::WaitForOldest()
+    {
+        vkWaitForFences(m_Device.GetDevice(), 1, &m_InFlight.front().fence, VK_TRUE, UINT64_MAX);
+        Retire();
+    }
+
+}
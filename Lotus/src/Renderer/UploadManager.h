@@ -0,0 +1,134 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace Lotus {
+
+	class Device;
+
+	// Batches GPU uploads into one command buffer per frame instead of one queue round trip each.
+	// Data is staged in a persistently mapped ring buffer; copies, layout transitions and mip blits
+	// are recorded into the open batch, which goes out with Submit, usually right before the frame
+	// that first uses the uploads. Every batch has a fence, and the ring space it staged is reused
+	// once that fence has signalled, so the CPU only ever waits when the ring runs full.
+	//
+	// When the device has a separate transfer queue family the copies run there, next to rendering.
+	// Every uploaded resource is then released by the transfer queue and acquired by a small command
+	// buffer on the graphics queue, which waits for the copies with a semaphore and also takes work
+	// only the graphics queue can do, like mip blits. Without one everything is a single command
+	// buffer on the graphics queue. Either way, once Submit has returned, later submissions on the
+	// graphics queue can use the resources right away.
+	// Not thread safe, record uploads from the render thread.
+	class UploadManager
+	{
+	public:
+		using UploadId = uint64_t;
+
+		static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64ull << 20;
+
+		// Staging space valid until the batch it was allocated for has completed
+		struct StagingAllocation
+		{
+			void* data = nullptr;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+		};
+
+		struct Stats
+		{
+			uint64_t submittedBatches = 0;
+			uint64_t stagingCount = 0; // calls to Stage
+			uint64_t stagedBytes = 0;
+			uint64_t stallCount = 0; // waits for a batch because the ring was full
+		};
+
+		UploadManager(Device& device, VkDeviceSize ringSize = DEFAULT_RING_SIZE);
+		~UploadManager();
+
+		UploadManager(const UploadManager&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+
+		// Reserves staging space in the open batch. Making room may submit the open batch, so get the
+		// command buffer after staging. Data larger than half the ring gets its own staging buffer.
+		StagingAllocation Stage(VkDeviceSize size, VkDeviceSize alignment = 16);
+		// Records a copy from staged data, the destination needs TRANSFER_DST usage
+		void CopyToBuffer(const StagingAllocation& staging, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+		// Stages data and records the copy
+		void UploadToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+
+		// The open batch's command buffer on the transfer queue, for copies and layout transitions
+		VkCommandBuffer GetCommandBuffer();
+		// The open batch's command buffer on the graphics queue, for work on resources after they
+		// were handed over. The same as GetCommandBuffer without a dedicated transfer queue.
+		VkCommandBuffer GetGraphicsCommandBuffer();
+
+		// Hand written resources over to the graphics queue: makes the transfer writes visible to
+		// dstStage / dstAccess and transfers queue family ownership when the queues differ.
+		// CopyToBuffer hands its destination over already.
+		void HandOverBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+		// Also moves the image from oldLayout to newLayout
+		void HandOverImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		// Submits the open batch if anything was recorded and returns the id of the last batch submitted
+		UploadId Submit();
+		// Id the open batch will be submitted with; everything recorded so far completes with it
+		UploadId GetPendingId() const { return m_NextId; }
+		bool IsComplete(UploadId id);
+		// Submits the batch first when id is still open
+		void Wait(UploadId id);
+		void WaitIdle() { Wait(m_NextId); }
+
+		const Stats& GetStats() const { return m_Stats; }
+
+	private:
+		struct Batch
+		{
+			UploadId id = 0;
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			// only with a dedicated transfer queue: acquires on the graphics queue after the copies
+			VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+			VkSemaphore copiesDone = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE; // signalled by the last submission of the batch
+			uint64_t ringEnd = 0; // ring head when submitted, the ring tail moves here once complete
+			// staging buffers for data that didn't fit into the ring
+			std::vector<std::pair<VkBuffer, MemoryAllocation>> oversized;
+		};
+
+		void BeginBatch();
+		bool TryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		// Recycles every batch whose fence has signalled
+		void Retire();
+		void WaitForOldest();
+
+	private:
+		Device& m_Device;
+		bool m_Dedicated; // uploads run on a separate transfer queue family
+		VkCommandPool m_CommandPool = VK_NULL_HANDLE;
+		VkCommandPool m_GraphicsCommandPool = VK_NULL_HANDLE;
+
+		VkBuffer m_RingBuffer = VK_NULL_HANDLE;
+		MemoryAllocation m_RingMemory;
+		VkDeviceSize m_RingSize;
+		// running byte counts, positions in the ring are taken modulo m_RingSize
+		uint64_t m_RingHead = 0;
+		uint64_t m_RingTail = 0;
+
+		Batch m_Open;
+		bool m_Recording = false;
+		std::deque<Batch> m_InFlight;
+		std::vector<Batch> m_FreeBatches;
+		UploadId m_NextId = 1;
+		UploadId m_CompletedId = 0;
+
+		Stats m_Stats{};
+	};
+
+}
@@ -0,0 +1,174 @@
+#include "lotuspch.h"
+#include "VertexQuantizer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+namespace Lotus
+{
+    namespace
+    {
+        int16_t EncodeSnorm16(float value)
+        {
+            return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        }
+
+        float DecodeSnorm16(int16_t value)
+        {
+            return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+        }
+
+        uint16_t EncodeUnorm16(float value)
+        {
+            return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+        }
+
+        uint8_t EncodeUnorm8(float value)
+        {
+            return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+        }
+
+        float SignNotZero(float value)
+        {
+            return value >= 0.0f ? 1.0f : -1.0f;
+        }
+
+        // Octahedral normal encoding, see Cigolle et al. "A Survey of Efficient Representations for Independent Unit Vectors"
+        glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+        {
+            const float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+            if (sum == 0.0f)
+                return glm::vec2{ 0.0f };
+
+            glm::vec2 result{ normal.x / sum, normal.y / sum };
+            if (normal.z < 0.0f)
+            {
+                result = glm::vec2{
+                    (1.0f - std::abs(result.y)) * SignNotZero(result.x),
+                    (1.0f - std::abs(result.x)) * SignNotZero(result.y)
+                };
+            }
+            return result;
+        }
+
+        // must match DecodeOctahedral in QuantizedShader.vert
+        glm::vec3 DecodeOctahedral(const glm::vec2& encoded)
+        {
+            glm::vec3 normal{ encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y) };
+            const float t = std::max(-normal.z, 0.0f);
+            normal.x += normal.x >= 0.0f ? -t : t;
+            normal.y += normal.y >= 0.0f ? -t : t;
+            return glm::normalize(normal);
+        }
+
+        float AngleDegrees(const glm::vec3& a, const glm::vec3& b)
+        {
+            return glm::degrees(std::acos(std::clamp(glm::dot(a, b), -1.0f, 1.0f)));
+        }
+
+        template <typename QuantizedVertexType>
+        void QuantizeVertices(const Model::MeshData& data, const glm::vec3& center, const glm::vec3& extent,
+            const glm::vec2& uvMin, const glm::vec2& uvExtent, bool hasColor, VertexQuantizer::Result& result)
+        {
+            result.vertexSize = sizeof(QuantizedVertexType);
+            result.vertices.resize(static_cast<size_t>(data.vertexCount) * sizeof(QuantizedVertexType));
+
+            VertexQuantizer::Error& error = result.error;
+            for (uint32_t i = 0; i < data.vertexCount; i++)
+            {
+                const Model::Vertex& source = data.vertices[i];
+                QuantizedVertexType vertex{};
+
+                for (int k = 0; k < 3; k++)
+                {
+                    vertex.position[k] = EncodeSnorm16((source.position[k] - center[k]) / extent[k]);
+                    const float decoded = center[k] + DecodeSnorm16(vertex.position[k]) * extent[k];
+                    error.position = std::max(error.position, std::abs(decoded - source.position[k]));
+                }
+
+                const glm::vec2 octahedral = EncodeOctahedral(source.normal);
+                vertex.normal[0] = EncodeSnorm16(octahedral.x);
+                vertex.normal[1] = EncodeSnorm16(octahedral.y);
+                if (glm::dot(source.normal, source.normal) > 0.0f)
+                {
+                    const glm::vec3 decoded = DecodeOctahedral({ DecodeSnorm16(vertex.normal[0]), DecodeSnorm16(vertex.normal[1]) });
+                    error.normalDegrees = std::max(error.normalDegrees, AngleDegrees(decoded, glm::normalize(source.normal)));
+                }
+
+                for (int k = 0; k < 2; k++)
+                {
+                    vertex.texCoord[k] = EncodeUnorm16((source.texCoord[k] - uvMin[k]) / uvExtent[k]);
+                    const float decoded = uvMin[k] + static_cast<float>(vertex.texCoord[k]) / 65535.0f * uvExtent[k];
+                    error.texCoord = std::max(error.texCoord, std::abs(decoded - source.texCoord[k]));
+                }
+
+                if constexpr (std::is_same_v<QuantizedVertexType, Model::QuantizedColorVertex>)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        vertex.color[k] = EncodeUnorm8(source.color[k]);
+                        error.color = std::max(error.color, std::abs(vertex.color[k] / 255.0f - source.color[k]));
+                    }
+                    vertex.color[3] = 255;
+                }
+                else if (hasColor)
+                {
+                    // the color is dropped entirely; the shader uses white
+                    for (int k = 0; k < 3; k++)
+                        error.color = std::max(error.color, std::abs(1.0f - source.color[k]));
+                }
+
+                std::memcpy(result.vertices.data() + static_cast<size_t>(i) * sizeof(QuantizedVertexType), &vertex, sizeof(vertex));
+            }
+        }
+    }
+
+    void VertexQuantizer::Quantize(const Model::MeshData& data, Model::VertexFormat format, Result& result)
+    {
+        assert(format != Model::VertexFormat::Float && "Float vertices are uploaded as they are");
+
+        result = {};
+        if (data.vertexCount == 0)
+            return;
+
+        // degenerate axes (flat meshes) get a unit extent to avoid dividing by zero
+        const glm::vec3 center = (data.bounds.min + data.bounds.max) * 0.5f;
+        glm::vec3 extent = (data.bounds.max - data.bounds.min) * 0.5f;
+        for (int k = 0; k < 3; k++)
+        {
+            if (extent[k] <= 0.0f)
+                extent[k] = 1.0f;
+        }
+
+        glm::vec2 uvMin = data.vertices[0].texCoord;
+        glm::vec2 uvMax = uvMin;
+        bool hasColor = false;
+        for (uint32_t i = 0; i < data.vertexCount; i++)
+        {
+            uvMin = glm::min(uvMin, data.vertices[i].texCoord);
+            uvMax = glm::max(uvMax, data.vertices[i].texCoord);
+            hasColor |= data.vertices[i].color != glm::vec3{ 1.0f };
+        }
+        glm::vec2 uvExtent = uvMax - uvMin;
+        for (int k = 0; k < 2; k++)
+        {
+            if (uvExtent[k] <= 0.0f)
+                uvExtent[k] = 1.0f;
+        }
+
+        if (format == Model::VertexFormat::QuantizedColor)
+            QuantizeVertices<Model::QuantizedColorVertex>(data, center, extent, uvMin, uvExtent, hasColor, result);
+        else
+            QuantizeVertices<Model::QuantizedVertex>(data, center, extent, uvMin, uvExtent, hasColor, result);
+
+        // translate(center) * scale(extent)
+        result.positionTransform = glm::mat4{ 1.f };
+        result.positionTransform[0][0] = extent.x;
+        result.positionTransform[1][1] = extent.y;
+        result.positionTransform[2][2] = extent.z;
+        result.positionTransform[3] = glm::vec4{ center, 1.f };
+        result.texCoordTransform = glm::vec4{ uvMin, uvExtent };
+    }
+}
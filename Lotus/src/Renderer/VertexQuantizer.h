@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Model.h"
+
+namespace Lotus {
+
+	// Packs float vertices into one of the quantized Model::VertexFormat layouts.
+	// Positions are normalized to the mesh bounds and texcoords to their own bounds; the
+	// transforms that undo this are returned so the renderer can fold them into its matrices.
+	class VertexQuantizer
+	{
+	public:
+		// Largest round-trip error over all vertices
+		struct Error
+		{
+			float position = 0.0f;      // model-space units
+			float normalDegrees = 0.0f;
+			float texCoord = 0.0f;      // texcoord units
+			float color = 0.0f;
+		};
+
+		struct Result
+		{
+			std::vector<uint8_t> vertices;
+			uint32_t vertexSize = 0;
+			glm::mat4 positionTransform{ 1.f };
+			glm::vec4 texCoordTransform{ 0.f, 0.f, 1.f, 1.f };
+			Error error{};
+		};
+
+		static void Quantize(const Model::MeshData& data, Model::VertexFormat format, Result& result);
+	};
+
+}
@@ -0,0 +1,124 @@
+#include "lotuspch.h"
+#include "VertexWelder.h"
+#include "Utils/Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace Lotus
+{
+    static_assert(sizeof(Model::Vertex) % sizeof(float) == 0, "Vertex must be made of floats only");
+
+    VertexWelder::VertexWelder(std::vector<Model::Vertex>& vertices, size_t expectedVertexCount, float epsilon)
+        : m_Vertices{ vertices }
+    {
+        if (!std::isfinite(epsilon) || epsilon < 0.0f)
+        {
+            throw std::runtime_error("weld epsilon must be finite and not negative!");
+        }
+        // in double, so even a denormal epsilon has a finite inverse
+        if (epsilon > 0.0f)
+            m_InverseEpsilon = 1.0 / epsilon;
+
+        // keep the load factor at or below 1/2 for the expected vertex count
+        size_t capacity = 64;
+        while (capacity < expectedVertexCount * 2)
+            capacity *= 2;
+        Rehash(capacity);
+    }
+
+    uint32_t VertexWelder::Insert(const Model::Vertex& vertex)
+    {
+        if ((m_Vertices.size() + 1) * 4 > m_Slots.size() * 3)
+            Rehash(m_Slots.size() * 2);
+
+        const uint64_t hash = Hash(vertex);
+        const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+        for (size_t slot = static_cast<size_t>(hash) & m_Mask;; slot = (slot + 1) & m_Mask)
+        {
+            Slot& entry = m_Slots[slot];
+            if (entry.index == EMPTY_SLOT)
+            {
+                entry.hash = tag;
+                entry.index = static_cast<uint32_t>(m_Vertices.size());
+                m_Vertices.push_back(vertex);
+                return entry.index;
+            }
+
+            if (entry.hash == tag && Equal(m_Vertices[entry.index], vertex))
+                return entry.index;
+        }
+    }
+
+    uint64_t VertexWelder::Hash(const Model::Vertex& vertex) const
+    {
+        if (m_InverseEpsilon == 0.0)
+        {
+            // -0 and +0 compare equal, so they must hash alike
+            float values[FLOATS_PER_VERTEX];
+            std::memcpy(values, &vertex, sizeof(values));
+            for (float& value : values)
+            {
+                if (value == 0.0f)
+                    value = 0.0f;
+            }
+            return HashBytes(values, sizeof(values));
+        }
+
+        int64_t cells[FLOATS_PER_VERTEX];
+        Quantize(vertex, cells);
+        return HashBytes(cells, sizeof(cells));
+    }
+
+    bool VertexWelder::Equal(const Model::Vertex& a, const Model::Vertex& b) const
+    {
+        if (m_InverseEpsilon == 0.0)
+            return a == b;
+
+        int64_t cellsA[FLOATS_PER_VERTEX];
+        int64_t cellsB[FLOATS_PER_VERTEX];
+        Quantize(a, cellsA);
+        Quantize(b, cellsB);
+        return std::memcmp(cellsA, cellsB, sizeof(cellsA)) == 0;
+    }
+
+    void VertexWelder::Quantize(const Model::Vertex& vertex, int64_t* cells) const
+    {
+        // clamped well inside the int64 range, so huge or infinite attributes cannot overflow the conversion;
+        // NaN gets a cell of its own
+        constexpr double cellLimit = 4.0e18;
+
+        float values[FLOATS_PER_VERTEX];
+        std::memcpy(values, &vertex, sizeof(values));
+        for (size_t i = 0; i < FLOATS_PER_VERTEX; i++)
+        {
+            const double scaled = values[i] * m_InverseEpsilon;
+            cells[i] = std::isnan(scaled) ? std::numeric_limits<int64_t>::min() : std::llround(std::clamp(scaled, -cellLimit, cellLimit));
+        }
+    }
+
+    void VertexWelder::Rehash(size_t capacity)
+    {
+        std::vector<Slot> slots(capacity, Slot{ 0, EMPTY_SLOT });
+        const size_t mask = capacity - 1;
+
+        for (const Slot& entry : m_Slots)
+        {
+            if (entry.index == EMPTY_SLOT)
+                continue;
+
+            // the stored tag is only the upper half of the hash, so recompute the bucket
+            const uint64_t hash = Hash(m_Vertices[entry.index]);
+            size_t slot = static_cast<size_t>(hash) & mask;
+            while (slots[slot].index != EMPTY_SLOT)
+                slot = (slot + 1) & mask;
+            slots[slot] = entry;
+        }
+
+        m_Slots = std::move(slots);
+        m_Mask = mask;
+    }
+}
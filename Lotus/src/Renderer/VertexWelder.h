@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Model.h"
+
+namespace Lotus {
+
+	// Deduplicates vertices while a mesh is being imported. Unique vertices are appended to the
+	// output array and Insert returns the index to put in the index buffer.
+	//
+	// The lookup table is a flat open-addressed array (linear probing) of {hash tag, vertex index}
+	// pairs, so there is no per-vertex allocation and an insert is a single probe sequence.
+	// Vertices are compared like Vertex::operator==, so -0 and +0 weld. With a non-zero epsilon every
+	// attribute is snapped to a grid of that size first, welding vertices that fall into the same cell.
+	class VertexWelder
+	{
+	public:
+		// Throws when epsilon is negative or not finite
+		VertexWelder(std::vector<Model::Vertex>& vertices, size_t expectedVertexCount = 0, float epsilon = 0.0f);
+
+		VertexWelder(const VertexWelder&) = delete;
+		VertexWelder& operator=(const VertexWelder&) = delete;
+
+		uint32_t Insert(const Model::Vertex& vertex);
+
+		size_t GetMemoryUsage() const { return m_Slots.capacity() * sizeof(Slot); }
+
+	private:
+		struct Slot
+		{
+			uint32_t hash;
+			uint32_t index;
+		};
+
+		static constexpr uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+		static constexpr size_t FLOATS_PER_VERTEX = sizeof(Model::Vertex) / sizeof(float);
+
+		uint64_t Hash(const Model::Vertex& vertex) const;
+		bool Equal(const Model::Vertex& a, const Model::Vertex& b) const;
+		void Quantize(const Model::Vertex& vertex, int64_t* cells) const;
+		void Rehash(size_t capacity);
+
+	private:
+		std::vector<Model::Vertex>& m_Vertices;
+		std::vector<Slot> m_Slots;
+		size_t m_Mask = 0;
+		double m_InverseEpsilon = 0.0;
+	};
+
+}
@@ -1,5 +1,6 @@
 #include "lotuspch.h"
 #include "PointLightSystem.h"
+#include "Renderer/PipelineLibrary.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -27,6 +28,7 @@ namespace Lotus
     PointLightSystem::~PointLightSystem()
     {
         vkDeviceWaitIdle(m_Device.GetDevice());
+        m_Device.GetPipelineLibrary().ReleasePipelines(m_PipelineLayout);
         vkDestroyPipelineLayout(m_Device.GetDevice(), m_PipelineLayout, nullptr);
     }
 
@@ -63,8 +65,7 @@ namespace Lotus
         pipelineConfig.attributeDescriptions.clear();
         pipelineConfig.renderPass = renderPass;
         pipelineConfig.pipelineLayout = m_PipelineLayout;
-        m_Pipeline = std::make_unique<Pipeline>(
-            m_Device,
+        m_Pipeline = m_Device.GetPipelineLibrary().GetPipeline(
             "../Lotus/Shaders/pointlightshader.vert.spv",
             "../Lotus/Shaders/pointlightshader.frag.spv",
             pipelineConfig
@@ -99,6 +100,7 @@ namespace Lotus
             }
         }
         ubo.numLights = lightIndex;
+        frameInfo.pointLightCount = static_cast<uint32_t>(lightIndex);
     }
 
     void PointLightSystem::Render(FrameInfo& frameInfo)
@@ -123,8 +125,8 @@ namespace Lotus
             0,
             1,
             &frameInfo.globalDescriptorSet,
-            0,
-            nullptr
+            1,
+            &frameInfo.globalUboOffset
         );
 
         for (auto it = sorted.rbegin(); it != sorted.rend(); it++)
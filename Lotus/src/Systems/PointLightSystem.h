@@ -29,7 +29,7 @@ namespace Lotus
     private:
         Device& m_Device;
 
-        std::unique_ptr<Pipeline> m_Pipeline;
+        Pipeline* m_Pipeline = nullptr; // owned by the device's PipelineLibrary
         VkPipelineLayout m_PipelineLayout;
     };
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "lotuspch.h"
 #include "SimpleRenderSystem.h"
+#include "Renderer/TextureRegistry.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -7,28 +8,38 @@
 #include <glm/gtc/constants.hpp>
 #include <glm/ext/matrix_transform.hpp>
 
+#include <algorithm>
+#include <filesystem>
+#include <tuple>
+
 namespace Lotus
 {
-    struct SimplePushConstantData
-    {
-        glm::mat4 modelMatrix{ 1.0f };
-        glm::mat4 normalMatrix{ 1.0f };
-        //alignas(16) glm::vec3 color;
-    };
+    // a LOD is used while its error projects to less than this many pixels
+    constexpr float LOD_PIXEL_ERROR = 1.0f;
+    // switching to a coarser LOD needs its error to be this far below the threshold, so
+    // objects sitting right at the boundary don't flip between two levels every frame
+    constexpr float LOD_HYSTERESIS = 0.75f;
+
+    // constant_id values in simpleshader.frag
+    constexpr uint32_t LIGHT_COUNT_CONSTANT = 0;
+    constexpr uint32_t TEXTURED_CONSTANT = 1;
+    constexpr uint32_t SPECULAR_CONSTANT = 2;
+    static_assert(MAX_LIGHTS < SimpleRenderSystem::GENERIC_LIGHT_COUNT, "light counts must fit the permutation key");
 
-    SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout)
+    SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout,
+        VkDescriptorSetLayout textureSetLayout, VkDescriptorSetLayout instanceSetLayout)
         : m_Device{ device }
     {
         // default params
-        CreatePipelineLayout(globalSetLayout);
+        CreatePipelineLayout(globalSetLayout, textureSetLayout, instanceSetLayout);
         CreatePipeline(renderPass);
     }
 
     Lotus::SimpleRenderSystem::SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, 
-        VkPrimitiveTopology topology)
+        VkDescriptorSetLayout textureSetLayout, VkDescriptorSetLayout instanceSetLayout, VkPrimitiveTopology topology)
 		: m_Device{ device }
     {
-        CreatePipelineLayout(globalSetLayout);
+        CreatePipelineLayout(globalSetLayout, textureSetLayout, instanceSetLayout);
         CreatePipeline(renderPass, topology);
     }
 
@@ -36,24 +47,23 @@ namespace Lotus
     SimpleRenderSystem::~SimpleRenderSystem()
     {
         vkDeviceWaitIdle(m_Device.GetDevice());
+        m_Device.GetPipelineLibrary().ReleasePipelines(m_PipelineLayout);
         vkDestroyPipelineLayout(m_Device.GetDevice(), m_PipelineLayout, nullptr);
     }
 
-    void SimpleRenderSystem::CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout)
+    void SimpleRenderSystem::CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout,
+        VkDescriptorSetLayout instanceSetLayout)
     {
-        VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(SimplePushConstantData);
-
-        std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { globalSetLayout };
+        // set 0 is per frame, set 1 the bindless texture table, set 2 the per-instance data;
+        // everything per object comes from the instance buffer, there are no push constants
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { globalSetLayout, textureSetLayout, instanceSetLayout };
 
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
         pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
         if (vkCreatePipelineLayout(m_Device.GetDevice(), &pipelineLayoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
         {
@@ -66,57 +76,282 @@ namespace Lotus
     {
         assert(m_PipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
-        PipelineConfigInfo pipelineConfig{};
-        Pipeline::DefaultPipelineConfigInfo(
-            pipelineConfig
-        );
+        m_RenderPass = renderPass;
+        m_Topology = topology;
 
-        pipelineConfig.inputAssemblyInfo.topology = topology;
+        // skipping backfacing meshlets is only invisible if the rasterizer would drop those triangles anyway.
+        // The default config uses VK_CULL_MODE_NONE, so cone culling is currently inactive.
+        PipelineConfigInfo defaultConfig{};
+        Pipeline::DefaultPipelineConfigInfo(defaultConfig);
+        m_MeshletConeCulling = (defaultConfig.rasterizationInfo.cullMode & VK_CULL_MODE_BACK_BIT) != 0;
+
+        // the generic permutation of every vertex format up front, the others when first used. They are
+        // compiled on workers, frames render without them until they are ready
+        for (size_t i = 0; i < m_Pipelines.size(); i++)
+        {
+            const auto format = static_cast<Model::VertexFormat>(i);
+            const char* vertFilepath = GetVertexShaderPath(format);
+            if (format != Model::VertexFormat::Float && !std::filesystem::exists(vertFilepath))
+            {
+                LOTUS_CORE_WARN("{0} not found, models using that vertex format will not be drawn (run CompileShaders.bat)", vertFilepath);
+                continue;
+            }
+
+            // the fallback is queued first so it is ready first
+            if (topology != VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+                m_FallbackPipelines[i] = RequestPipeline(format, GENERIC_PERMUTATION, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+            m_Pipelines[i][GENERIC_PERMUTATION] = RequestPipeline(format, GENERIC_PERMUTATION, topology);
+        }
+    }
 
-        pipelineConfig.renderPass = renderPass;
+    std::shared_ptr<const PipelineLibrary::AsyncPipeline> SimpleRenderSystem::RequestPipeline(Model::VertexFormat format,
+        PermutationKey permutation, VkPrimitiveTopology topology)
+    {
+        PipelineConfigInfo pipelineConfig{};
+        Pipeline::DefaultPipelineConfigInfo(pipelineConfig);
+        pipelineConfig.inputAssemblyInfo.topology = topology;
+        pipelineConfig.renderPass = m_RenderPass;
         pipelineConfig.pipelineLayout = m_PipelineLayout;
-        m_Pipeline = std::make_unique<Pipeline>(
-            m_Device,
-            "../Lotus/Shaders/simpleshader.vert.spv",
-            "../Lotus/Shaders/simpleshader.frag.spv",
-            pipelineConfig
-        );
+        pipelineConfig.bindingDescriptions = Model::GetBindingDescriptions(format);
+        pipelineConfig.attributeDescriptions = Model::GetAttributeDescriptions(format);
+
+        const uint32_t lightCount = permutation & PERMUTATION_LIGHT_COUNT_MASK;
+        Pipeline::SetSpecializationConstant(pipelineConfig, LIGHT_COUNT_CONSTANT, lightCount == GENERIC_LIGHT_COUNT ? static_cast<uint32_t>(-1) : lightCount);
+        Pipeline::SetSpecializationConstant(pipelineConfig, TEXTURED_CONSTANT, (permutation & PERMUTATION_TEXTURED) != 0 ? VK_TRUE : VK_FALSE);
+        Pipeline::SetSpecializationConstant(pipelineConfig, SPECULAR_CONSTANT, (permutation & PERMUTATION_SPECULAR) != 0 ? VK_TRUE : VK_FALSE);
+
+        // the library copies the config
+        return m_Device.GetPipelineLibrary().RequestPipelineAsync({ GetVertexShaderPath(format), "../Lotus/Shaders/simpleshader.frag.spv", &pipelineConfig });
+    }
+
+    const char* SimpleRenderSystem::GetVertexShaderPath(Model::VertexFormat format)
+    {
+        switch (format)
+        {
+        case Model::VertexFormat::Quantized:      return "../Lotus/Shaders/quantizedshader.vert.spv";
+        case Model::VertexFormat::QuantizedColor: return "../Lotus/Shaders/quantizedshader_color.vert.spv";
+        default:                                  return "../Lotus/Shaders/simpleshader.vert.spv";
+        }
+    }
+
+    Pipeline* SimpleRenderSystem::GetPipeline(Model::VertexFormat format, PermutationKey permutation)
+    {
+        auto& pipelines = m_Pipelines[static_cast<size_t>(format)];
+        if (pipelines[GENERIC_PERMUTATION] == nullptr)
+            return nullptr;
+        if (pipelines[permutation] == nullptr)
+            pipelines[permutation] = RequestPipeline(format, permutation, m_Topology);
+
+        // the switch happens on the first frame after a worker has published the pipeline
+        if (Pipeline* pipeline = pipelines[permutation]->Get())
+            return pipeline;
+        if (Pipeline* pipeline = pipelines[GENERIC_PERMUTATION]->Get())
+            return pipeline;
+        const auto& fallback = m_FallbackPipelines[static_cast<size_t>(format)];
+        return fallback != nullptr ? fallback->Get() : nullptr;
+    }
+
+    SimpleRenderSystem::PermutationKey SimpleRenderSystem::MakePermutationKey(const FrameInfo& frameInfo, const GameObject& gameObject)
+    {
+        PermutationKey permutation = std::min<uint32_t>(frameInfo.pointLightCount, MAX_LIGHTS);
+        // objects showing the plain white texture don't need to sample it
+        if (gameObject.textureIndex != TextureRegistry::DEFAULT_TEXTURE_INDEX)
+            permutation |= PERMUTATION_TEXTURED;
+        if (gameObject.specular)
+            permutation |= PERMUTATION_SPECULAR;
+        return permutation;
+    }
+
+    uint32_t SimpleRenderSystem::SelectLod(const FrameInfo& frameInfo, const Model& model, uint32_t currentLod, float scale, float distance) const
+    {
+        const uint32_t lodCount = model.GetLodCount();
+        if (lodCount <= 1)
+            return 0;
+
+        // world-space error to pixels: |projection[1][1]| is 1 / tan(fovy / 2), negative because Y is flipped for Vulkan
+        const float pixelsPerUnit = std::abs(frameInfo.camera.GetProjectionMatrix()[1][1]) * 0.5f * static_cast<float>(frameInfo.extent.height) / distance;
+        const auto projectedError = [&](uint32_t lod) { return model.GetLodError(lod) * scale * pixelsPerUnit; };
+
+        uint32_t lod = std::min(currentLod, lodCount - 1);
+        while (lod > 0 && projectedError(lod) > LOD_PIXEL_ERROR)
+            lod--;
+        while (lod + 1 < lodCount && projectedError(lod + 1) < LOD_PIXEL_ERROR * LOD_HYSTERESIS)
+            lod++;
+        return lod;
+    }
+
+    void SimpleRenderSystem::CullMeshlets(const Model& model, const glm::mat4& transform, const glm::mat3& normalMatrix, float scale,
+        bool coneCulling, const Frustum& frustum, const glm::vec3& cameraPosition, std::vector<uint32_t>& visibleMeshlets) const
+    {
+        visibleMeshlets.clear();
+
+        const auto& meshlets = model.GetMeshlets();
+        for (uint32_t i = 0; i < meshlets.size(); i++)
+        {
+            const Model::Meshlet& meshlet = meshlets[i];
+            const glm::vec3 center = transform * glm::vec4(meshlet.center, 1.0f);
+            const float radius = meshlet.radius * scale;
+            if (!frustum.IntersectsSphere(center, radius))
+                continue;
+
+            // backfacing when the camera sees every normal in the cone from behind:
+            // dot(center - camera, axis) >= |center - camera| * sin(half-angle) + radius
+            if (coneCulling && meshlet.coneCutoff < 1.0f)
+            {
+                const glm::vec3 axis = glm::normalize(normalMatrix * meshlet.coneAxis);
+                const glm::vec3 view = center - cameraPosition;
+                if (glm::dot(view, axis) >= meshlet.coneCutoff * glm::length(view) + radius)
+                    continue;
+            }
+
+            visibleMeshlets.push_back(i);
+        }
     }
 
     void SimpleRenderSystem::RenderGameObjects(FrameInfo& frameInfo)
     {
-        m_Pipeline->Bind(frameInfo.commandBuffer);
+        const Frustum frustum{ frameInfo.camera.GetProjectionMatrix() * frameInfo.camera.GetViewMatrix() };
+        const glm::vec3& cameraPosition = frameInfo.camera.GetPosition();
+
+        m_DrawItems.clear();
+        for (auto& kv : frameInfo.gameObjects)
+        {
+            auto& obj = kv.second;
+            if (obj.model == nullptr)
+                continue;
+
+            // whole-object frustum test against the world-space bounding sphere
+            const glm::mat4 transform = obj.transform.GetTransform();
+            const glm::vec3 scale = glm::abs(obj.transform.scale);
+            const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+            const Model::Bounds& bounds = obj.model->GetBounds();
+            const glm::vec3 center = transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+            const float radius = glm::length(bounds.max - bounds.min) * 0.5f * maxScale;
+            if (!frustum.IntersectsSphere(center, radius))
+                continue;
 
-                vkCmdBindDescriptorSets(
+            const float distance = std::max(glm::length(center - cameraPosition) - radius, 1e-3f);
+            obj.lodIndex = SelectLod(frameInfo, *obj.model, obj.lodIndex, maxScale, distance);
+
+            // looked up only for visible objects, so permutations nothing on screen uses are never compiled;
+            // skipped until its pipeline, or a fallback, has been compiled
+            Pipeline* pipeline = GetPipeline(obj.model->GetVertexFormat(), MakePermutationKey(frameInfo, obj));
+            if (pipeline == nullptr)
+                continue;
+
+            // quantized models fold their dequantization into the model matrix and
+            // carry the texcoord transform in the unused last column of the normal matrix
+            DrawItem item{};
+            item.pipeline = pipeline;
+            item.model = obj.model.get();
+            item.lod = obj.lodIndex;
+            item.gameObject = &obj;
+            item.modelMatrix = transform * obj.model->GetPositionTransform();
+            item.normalMatrix = obj.transform.GetNormalMatrix();
+            item.normalMatrix[3] = obj.model->GetTexCoordTransform();
+            item.textureIndex = obj.textureIndex;
+            m_DrawItems.push_back(item);
+        }
+        if (m_DrawItems.empty())
+            return;
+
+        // runs of the same pipeline, model and LOD become one instanced draw; sorting on the pipeline
+        // first also keeps pipeline binds to one per permutation in use
+        std::sort(m_DrawItems.begin(), m_DrawItems.end(), [](const DrawItem& a, const DrawItem& b)
+        {
+            return std::tie(a.pipeline, a.model, a.lod) < std::tie(b.pipeline, b.model, b.lod);
+        });
+
+        // every object's texture comes from the table and its transforms from the instance buffer,
+        // so the instance set is the only one bound again below
+        const VkDescriptorSet descriptorSets[] = { frameInfo.globalDescriptorSet, frameInfo.textureDescriptorSet };
+        vkCmdBindDescriptorSets(
             frameInfo.commandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             m_PipelineLayout,
             0,
+            2,
+            descriptorSets,
             1,
-            &frameInfo.globalDescriptorSet,
-            0,
-            nullptr
+            &frameInfo.globalUboOffset
         );
 
-        for (auto& kv : frameInfo.gameObjects)
+        // every model lives in the geometry arena: one vertex buffer bind, and an index buffer bind
+        // only when the index type changes
+        const GeometryArena& geometry = m_Device.GetGeometryArena();
+        geometry.BindVertexBuffer(frameInfo.commandBuffer);
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+        const Pipeline* boundPipeline = nullptr;
+        for (size_t chunkBegin = 0; chunkBegin < m_DrawItems.size(); chunkBegin += MAX_INSTANCES)
         {
-            SimplePushConstantData push{};
-            auto& obj = kv.second;
-            if (obj.model == nullptr)
-                continue;
-            push.modelMatrix = obj.transform.GetTransform();
-            push.normalMatrix = obj.transform.GetNormalMatrix();
+            // each chunk of instances gets an allocation of its own size, in draw order, bound with its
+            // own dynamic offset; runs end at the chunk's end, so a run's first instance is its index in the chunk
+            const size_t chunkEnd = std::min<size_t>(chunkBegin + MAX_INSTANCES, m_DrawItems.size());
+            const FrameAllocator::Allocation instances = frameInfo.frameAllocator.Allocate(
+                sizeof(InstanceData) * (chunkEnd - chunkBegin), FrameAllocator::Usage::Storage);
+            InstanceData* instanceData = static_cast<InstanceData*>(instances.data);
+            for (size_t i = chunkBegin; i < chunkEnd; i++)
+            {
+                instanceData[i - chunkBegin].modelMatrix = m_DrawItems[i].modelMatrix;
+                instanceData[i - chunkBegin].normalMatrix = m_DrawItems[i].normalMatrix;
+                instanceData[i - chunkBegin].textureIndex = m_DrawItems[i].textureIndex;
+            }
 
-            vkCmdPushConstants(
+            const uint32_t instanceOffset = instances.GetDynamicOffset();
+            vkCmdBindDescriptorSets(
                 frameInfo.commandBuffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
                 m_PipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                0,
-                sizeof(SimplePushConstantData),
-                &push
+                2,
+                1,
+                &frameInfo.instanceDescriptorSet,
+                1,
+                &instanceOffset
             );
-            obj.model->Bind(frameInfo.commandBuffer);
-            obj.model->Draw(frameInfo.commandBuffer);
+
+            for (size_t first = chunkBegin; first < chunkEnd;)
+            {
+                const DrawItem& item = m_DrawItems[first];
+                size_t end = first + 1;
+                while (end < chunkEnd && m_DrawItems[end].pipeline == item.pipeline && m_DrawItems[end].model == item.model && m_DrawItems[end].lod == item.lod)
+                    end++;
+                const uint32_t instanceCount = static_cast<uint32_t>(end - first);
+                const uint32_t firstInstance = static_cast<uint32_t>(first - chunkBegin);
+                first = end;
+
+                // meshlets are culled per object, so they are only used by objects drawn on their own,
+                // and only exist for the full-detail level
+                const bool useMeshlets = instanceCount == 1 && item.lod == 0 && !item.model->GetMeshlets().empty();
+                if (useMeshlets)
+                {
+                    const TransformComponent& objTransform = item.gameObject->transform;
+                    const glm::vec3 scale = glm::abs(objTransform.scale);
+                    const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+
+                    // normal cones stay valid under uniform, non-mirroring scale only
+                    const glm::vec3& s = objTransform.scale;
+                    const bool coneCulling = m_MeshletConeCulling && s.x > 0.0f && std::abs(s.x - s.y) <= 1e-3f * s.x && std::abs(s.x - s.z) <= 1e-3f * s.x;
+                    CullMeshlets(*item.model, objTransform.GetTransform(), objTransform.GetNormalMatrix(), maxScale, coneCulling, frustum, cameraPosition, m_VisibleMeshlets);
+                    if (m_VisibleMeshlets.empty())
+                        continue;
+                }
+
+                if (item.pipeline != boundPipeline)
+                {
+                    item.pipeline->Bind(frameInfo.commandBuffer);
+                    boundPipeline = item.pipeline;
+                }
+                if (item.model->GetIndexType() != boundIndexType)
+                {
+                    geometry.BindIndexBuffer(frameInfo.commandBuffer, item.model->GetIndexType());
+                    boundIndexType = item.model->GetIndexType();
+                }
+                if (useMeshlets)
+                    item.model->DrawMeshlets(frameInfo.commandBuffer, m_VisibleMeshlets, firstInstance);
+                else
+                    item.model->Draw(frameInfo.commandBuffer, item.lod, instanceCount, firstInstance);
+            }
         }
     }
 }
\ No newline at end of file
@@ -2,11 +2,15 @@
 
 #include "Window/Window.h"
 #include "Renderer/Pipeline.h"
+#include "Renderer/PipelineLibrary.h"
 #include "Renderer/Device.h"
 #include "GameObject/GameObject.h"
 #include "Camera/Camera.h"
 #include "Renderer/FrameInfo.h"
+#include "Renderer/Frustum.h"
+#include "Renderer/Model.h"
 
+#include <array>
 #include <memory>
 
 namespace Lotus
@@ -14,22 +18,88 @@ namespace Lotus
     class SimpleRenderSystem
     {
     public:
-        SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
-        SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkPrimitiveTopology topology);
+        SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout,
+            VkDescriptorSetLayout instanceSetLayout);
+        SimpleRenderSystem(Device& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout,
+            VkDescriptorSetLayout instanceSetLayout, VkPrimitiveTopology topology);
         ~SimpleRenderSystem();
 
         SimpleRenderSystem(const SimpleRenderSystem&) = delete; // delete copy constructor
         SimpleRenderSystem operator=(const SimpleRenderSystem&) = delete; // delete copy operator
 
+        // Objects that share a pipeline, model and LOD are drawn as instances of one draw
         void RenderGameObjects(FrameInfo& frameInfo);
+
+        // Selects the specialization of simpleshader.frag an object is drawn with: the light count in the
+        // low bits, GENERIC_LIGHT_COUNT to read it from the ubo, and the feature bits above
+        using PermutationKey = uint32_t;
+        static constexpr PermutationKey PERMUTATION_LIGHT_COUNT_MASK = 0xf;
+        static constexpr PermutationKey GENERIC_LIGHT_COUNT = 0xf;
+        static constexpr PermutationKey PERMUTATION_TEXTURED = 1 << 4;
+        static constexpr PermutationKey PERMUTATION_SPECULAR = 1 << 5;
+        static constexpr uint32_t PERMUTATION_COUNT = 1 << 6;
+        // draws every object correctly, and is what the others fall back to while they compile
+        static constexpr PermutationKey GENERIC_PERMUTATION = GENERIC_LIGHT_COUNT | PERMUTATION_TEXTURED | PERMUTATION_SPECULAR;
+
+        static PermutationKey MakePermutationKey(const FrameInfo& frameInfo, const GameObject& gameObject);
+
+        // One per drawn object in the frame's instance buffer, read with gl_InstanceIndex; matches the
+        // std430 Instance struct of the vertex shaders
+        struct InstanceData
+        {
+            glm::mat4 modelMatrix{ 1.0f };
+            glm::mat4 normalMatrix{ 1.0f }; // texcoord transform in [3]
+            uint32_t textureIndex = 0;
+            uint32_t padding[3]{};
+        };
+        static_assert(sizeof(InstanceData) == 144, "InstanceData must match the shaders' std430 array stride");
+
+        // Instances are allocated and bound in chunks of at most this many, the most the instance
+        // descriptor's range covers; instanced draws are split at chunk boundaries
+        static constexpr uint32_t MAX_INSTANCES = 4096;
+        static constexpr VkDeviceSize INSTANCE_BUFFER_RANGE = MAX_INSTANCES * sizeof(InstanceData);
     private:
-        void CreatePipelineLayout(VkDescriptorSetLayout globalDescriptorSet);
+        void CreatePipelineLayout(VkDescriptorSetLayout globalSetLayout, VkDescriptorSetLayout textureSetLayout, VkDescriptorSetLayout instanceSetLayout);
         void CreatePipeline(VkRenderPass renderPass, VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
+        static const char* GetVertexShaderPath(Model::VertexFormat format);
+        std::shared_ptr<const PipelineLibrary::AsyncPipeline> RequestPipeline(Model::VertexFormat format, PermutationKey permutation,
+            VkPrimitiveTopology topology);
+        // The permutation if it has finished compiling, else the generic permutation or the triangle list fallback;
+        // null when none of them is ready. Requests permutations the first time they are used
+        Pipeline* GetPipeline(Model::VertexFormat format, PermutationKey permutation);
+        uint32_t SelectLod(const FrameInfo& frameInfo, const Model& model, uint32_t currentLod, float scale, float distance) const;
+        void CullMeshlets(const Model& model, const glm::mat4& transform, const glm::mat3& normalMatrix, float scale,
+            bool coneCulling, const Frustum& frustum, const glm::vec3& cameraPosition, std::vector<uint32_t>& visibleMeshlets) const;
+
     private:
+        // An object that passed culling this frame
+        struct DrawItem
+        {
+            Pipeline* pipeline;
+            const Model* model;
+            uint32_t lod;
+            GameObject* gameObject;
+            glm::mat4 modelMatrix;
+            glm::mat4 normalMatrix; // texcoord transform in [3]
+            uint32_t textureIndex;
+        };
+
         Device& m_Device;
 
-        std::unique_ptr<Pipeline> m_Pipeline;
+        // per vertex format and permutation, null until first used, and for every permutation of a format whose
+        // shader has not been compiled; compiled in the background and owned by the device's PipelineLibrary
+        std::array<std::array<std::shared_ptr<const PipelineLibrary::AsyncPipeline>, PERMUTATION_COUNT>,
+            static_cast<size_t>(Model::VertexFormat::Count)> m_Pipelines{};
+        // drawn with until the generic permutation is ready: its triangle list version, which is what
+        // model index data holds; null when the system draws triangle lists itself
+        std::array<std::shared_ptr<const PipelineLibrary::AsyncPipeline>, static_cast<size_t>(Model::VertexFormat::Count)> m_FallbackPipelines{};
         VkPipelineLayout m_PipelineLayout;
+        VkRenderPass m_RenderPass = VK_NULL_HANDLE;
+        VkPrimitiveTopology m_Topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        std::vector<DrawItem> m_DrawItems;       // scratch for RenderGameObjects, reused every frame
+        std::vector<uint32_t> m_VisibleMeshlets; // scratch for CullMeshlets, reused every draw
+        bool m_MeshletConeCulling = false;
     };
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "lotuspch.h"
+#include "MappedFile.h"
+
+namespace Lotus {
+
+    MappedFile::MappedFile(const std::string& filepath)
+    {
+        if (!Open(filepath))
+            throw std::runtime_error("failed to map file: " + filepath);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            std::swap(m_Data, other.m_Data);
+            std::swap(m_Size, other.m_Size);
+            std::swap(m_File, other.m_File);
+            std::swap(m_Mapping, other.m_Mapping);
+        }
+        return *this;
+    }
+
+    bool MappedFile::Open(const std::string& filepath)
+    {
+        Close();
+
+        HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize{};
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        m_File = file;
+        m_Size = static_cast<size_t>(fileSize.QuadPart);
+
+        // zero-length files cannot be mapped, but are still valid (empty) files
+        if (m_Size == 0)
+            return true;
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            Close();
+            return false;
+        }
+        m_Mapping = mapping;
+
+        m_Data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_Data == nullptr)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_Data)
+            UnmapViewOfFile(m_Data);
+        if (m_Mapping)
+            CloseHandle(static_cast<HANDLE>(m_Mapping));
+        if (m_File)
+            CloseHandle(static_cast<HANDLE>(m_File));
+
+        m_Data = nullptr;
+        m_Size = 0;
+        m_Mapping = nullptr;
+        m_File = nullptr;
+    }
+
+} // namespace Lotus
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Lotus {
+
+    // Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        // Returns false instead of throwing when the file does not exist or cannot be mapped
+        bool Open(const std::string& filepath);
+        void Close();
+
+        bool IsOpen() const { return m_File != nullptr; }
+        const uint8_t* GetData() const { return m_Data; }
+        size_t GetSize() const { return m_Size; }
+
+    private:
+        const uint8_t* m_Data = nullptr;
+        size_t m_Size = 0;
+
+        void* m_File = nullptr;
+        void* m_Mapping = nullptr;
+    };
+
+} // namespace Lotus
@@ -0,0 +1,133 @@
+#include "lotuspch.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+
+namespace Lotus {
+
+    ThreadPool::ThreadPool(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            // leave one core for the main/render thread
+            const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        m_Workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+            m_Workers.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Condition.notify_all();
+
+        for (auto& worker : m_Workers)
+            worker.join();
+    }
+
+    ThreadPool& ThreadPool::Get()
+    {
+        static ThreadPool s_Pool{};
+        return s_Pool;
+    }
+
+    void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn)
+    {
+        if (count == 0)
+            return;
+
+        if (count == 1)
+        {
+            fn(0);
+            return;
+        }
+
+        // Helpers can be dequeued after this call has returned, so everything they touch lives in
+        // shared state. They only call fn while work remains, i.e. while the caller is still waiting.
+        struct SharedState
+        {
+            std::atomic<uint32_t> next{ 0 };
+            std::atomic<uint32_t> remaining{ 0 };
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+            std::exception_ptr error;
+        };
+        auto state = std::make_shared<SharedState>();
+        state->remaining = count;
+
+        const std::function<void(uint32_t)>* body = &fn;
+        auto drain = [state, body, count]()
+        {
+            for (uint32_t i = state->next++; i < count; i = state->next++)
+            {
+                try
+                {
+                    (*body)(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(state->doneMutex);
+                    if (!state->error)
+                        state->error = std::current_exception();
+                }
+
+                if (--state->remaining == 0)
+                {
+                    std::lock_guard<std::mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        const uint32_t helpers = std::min(count - 1, GetThreadCount());
+        for (uint32_t i = 0; i < helpers; i++)
+            Enqueue(drain);
+
+        drain();
+
+        // Every index has been claimed once drain returns, so the caller only waits for the calls other
+        // threads are already running. It never picks up unrelated queued jobs (imports, decodes, pipeline
+        // compiles), and helpers still queued behind them are not waited for. Nested calls from worker
+        // threads cannot deadlock: each claimed index is being run by a thread that makes progress.
+        {
+            std::unique_lock<std::mutex> lock(state->doneMutex);
+            state->doneCondition.wait(lock, [&]() { return state->remaining == 0; });
+        }
+
+        if (state->error)
+            std::rethrow_exception(state->error);
+    }
+
+    void ThreadPool::Enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Jobs.push(std::move(job));
+        }
+        m_Condition.notify_one();
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this]() { return m_Stopping || !m_Jobs.empty(); });
+                if (m_Stopping && m_Jobs.empty())
+                    return;
+                job = std::move(m_Jobs.front());
+                m_Jobs.pop();
+            }
+            job();
+        }
+    }
+
+} // namespace Lotus
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Lotus {
+
+    // Fixed-size pool of worker threads shared by the engine's CPU-heavy jobs (asset import, etc.)
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        static ThreadPool& Get();
+
+        uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+        template <typename Fn>
+        auto Submit(Fn&& fn) -> std::future<decltype(fn())>
+        {
+            using Result = decltype(fn());
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+            std::future<Result> future = task->get_future();
+            Enqueue([task]() { (*task)(); });
+            return future;
+        }
+
+        // Runs fn(i) for every i in [0, count) and blocks until all calls are done.
+        // The calling thread takes part in this batch only, so this is safe to call from a worker
+        // and never runs other queued jobs on the caller.
+        // The first exception thrown by fn is rethrown on the calling thread.
+        void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& fn);
+
+    private:
+        void Enqueue(std::function<void()> job);
+        void WorkerLoop();
+
+    private:
+        std::vector<std::thread> m_Workers;
+        std::queue<std::function<void()>> m_Jobs;
+        std::mutex m_Mutex;
+        std::condition_variable m_Condition;
+        bool m_Stopping = false;
+    };
+
+} // namespace Lotus
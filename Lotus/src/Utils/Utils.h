@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 namespace Lotus {
@@ -12,4 +14,37 @@ namespace Lotus {
         (hash_combine(seed, rest), ...);
     }
 
-} // namespace Lotus
\ No newline at end of file
+    // Fast non-cryptographic 64-bit hash over raw bytes, eight bytes per step.
+    // Good enough for cache keys and hash tables, not for anything security related.
+    inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0)
+    {
+        constexpr uint64_t prime1 = 0x9E3779B185EBCA87ull;
+        constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        uint64_t hash = seed ^ (static_cast<uint64_t>(size) * prime1);
+
+        for (; size >= 8; bytes += 8, size -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            word *= prime2;
+            word ^= word >> 31;
+            hash = (hash ^ word) * prime1;
+            hash ^= hash >> 29;
+        }
+
+        if (size > 0)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bytes, size);
+            hash = (hash ^ (word * prime2)) * prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        return hash;
+    }
+
+} // namespace Lotus
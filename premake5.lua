@@ -17,7 +17,6 @@ IncludeDir["GLFW"] = "Lotus/vendor/GLFW/include"
 IncludeDir["ImGui"] = "Lotus/vendor/imgui"
 IncludeDir["glm"] = "Lotus/vendor/glm"
 IncludeDir["Vulkan"] = "C:/VulkanSDK/1.3.280.0/Include"
-IncludeDir["tinyobjloader"] = "Lotus/vendor/tinyobjloader"
 IncludeDir["stb_image"] = "Lotus/vendor/stb_image"
 
 include "Lotus/vendor/GLFW"
@@ -57,7 +56,6 @@ project "Lotus"
         "%{IncludeDir.ImGui}",
         "%{IncludeDir.glm}",
         "%{IncludeDir.Vulkan}",
-        "%{IncludeDir.tinyobjloader}",
         "%{IncludeDir.stb_image}"
     }
 
@@ -118,7 +116,6 @@ project "Sandbox"
         "%{IncludeDir.glm}",
         "%{IncludeDir.Vulkan}",
         "%{IncludeDir.GLFW}",
-        "%{IncludeDir.tinyobjloader}",
         "%{IncludeDir.stb_image}"
     }
 